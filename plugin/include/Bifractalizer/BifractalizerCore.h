@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <span>
+
+#include "DefractalizerKind.h"
+#include "FractalKernels.h"
+
+
+namespace audio_plugin {
+// The DSP without the plugin (no JUCE): what the processor does to a block of N samples, for anything that
+//   has whole blocks at hand - server-side pipelines, the tests, the command line tools. It runs on the
+//   processor's engines (BlockWork) with the operators of the shared caches, and comes out bit for bit
+//   as an offline bounce of the plugin with the block offset at 0 (minus the latency and the gain).
+// The engines and the solvers (Eigen) stay behind BifractalizerCore.cpp: this header is all a user includes.
+class DefractalizerBackend;
+
+enum class SampleLayout {
+  planar,      // channel after channel: numChannels runs of numFrames samples
+  interleaved  // frame after frame: numFrames runs of numChannels samples
+};
+
+// The plugin's parameters that define the operator
+struct OperatorSettings {
+  int N = 512;
+  int beta = 2;
+  float alpha = 0.5f;         // snapped to the knob's 0.01 steps (see PreparedOperator::prepare)
+  bool defractalize = false;  // "mode"
+  bool infiniteSeries = false;
+  int quality = 2;            // 0 Draft, 1 Normal, 2 Exact
+  int solver = static_cast<int>(DefractalizerKind::numKinds);  // a DefractalizerKind, numKinds is Auto
+  int refinementSteps = 2;    // of the backend solves, 0-2
+};
+
+// Immutable once prepared: any number of threads may process with one operator, each with its own Workspace
+class PreparedOperator {
+public:
+  // Everything slow happens here (see acquireDefractalizerOperator, DefractalizerDiskCache.h). nullptr for
+  //   settings the plugin doesn't take (N < 2, \beta < 2, \alpha outside [0, 1)) or a solver that couldn't
+  //   be prepared. \alpha is rounded to the nearest 0.01 like the plugin's knob (0.995 and up rounds to 1, so
+  //   it's refused), settings() has the rounded one
+  static std::shared_ptr<const PreparedOperator> prepare(const OperatorSettings& settings,
+                                                         KernelLevel kernelLevel = detectKernelLevel());
+  ~PreparedOperator();
+
+  // What processing mutates: scratch, the de-interleaved block, the iterative solver's warm starts
+  class Workspace {
+  public:
+    Workspace(Workspace&&) noexcept;
+    Workspace& operator=(Workspace&&) noexcept;
+    ~Workspace();
+
+    int numChannels() const;
+    // worst ||f - A g|| / ||f|| of the backend solves of the last call, NaN if one needed the closed form
+    double residual() const;
+
+  private:
+    friend class PreparedOperator;
+    struct State;
+    explicit Workspace(std::unique_ptr<State> workspaceState);
+    std::unique_ptr<State> state;
+  };
+  // Allocates, once per thread and channel count
+  Workspace makeWorkspace(int numChannels) const;
+
+  const OperatorSettings& settings() const { return operatorSettings; }
+  int blockSize() const { return operatorSettings.N; }
+  // The backend the defractalizer solves with (Auto resolved), nullptr for the series evaluators
+  const DefractalizerBackend* backend() const;
+
+  // out = the operator on every block of in: both hold workspace.numChannels() channels of numFrames samples
+  //   in layout, blocks start every N frames from the first. Returns how many frames it did: the whole blocks,
+  //   a partial one at the end is left alone; 0 if in and out differ in size or aren't whole frames. in and out
+  //   mustn't overlap. Never allocates
+  int process(std::span<const float> in, std::span<float> out, SampleLayout layout, Workspace& workspace) const;
+  // Several buffers (clips of a batch, say) in one call, each as by process(). Returns the frames done in all
+  int processBatch(std::span<const std::span<const float>> ins, std::span<const std::span<float>> outs,
+                   SampleLayout layout, Workspace& workspace) const;
+
+private:
+  struct Engine;  // the solver, the plans and the engines' setup
+  PreparedOperator();
+
+  OperatorSettings operatorSettings;
+  std::unique_ptr<const Engine> engine;
+
+  double processBlocks(const float* in, float* out, int numFrames, SampleLayout layout,
+                       Workspace::State& workspace) const;
+};
+}  // namespace audio_plugin
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "GatherPlan.h"
+#include "FractalSeries.h"
+#include "SparseLUFactors.h"
+
+
+namespace audio_plugin {
+// A(i, j) != 0 only if j = M^n i, so A couples only indices of the same orbit component of M
+//   (one cycle plus everything that flows into it). After permuting indices by component
+//   A is block diagonal and every block is factorized and solved on its own:
+//   tiny blocks with a dense LU, the rest with SparseLU. Blocks are independent, so the solve
+//   is split into chunks of components of about equal cost that can run on different threads.
+class BlockDefractalizer {
+public:
+  static constexpr int denseLimit = 64;  // components up to this size get a dense LU
+
+  // maxChunks - upper bound on how many threads may solve at once
+  bool prepare(const GatherPlan& plan, const OrbitPlan& orbits, int maxChunks);
+
+  int size() const { return N; }
+  int numComponents() const { return static_cast<int>(components.size()); }
+  int numChunks() const { return static_cast<int>(chunkStart.size()) - 1; }
+  size_t memoryFootprint() const { return footprint; }
+  double cost() const { return totalCost; }
+
+  // g = A^{-1} f on the components of one chunk. scratch holds 2*N floats, every component
+  //   uses its own part of it, so all chunks of one channel may run concurrently with one scratch.
+  void solveChunk(const float* f, float* g, float* scratch, int chunk) const;
+  void solve(const float* f, float* g, float* scratch) const;
+
+  // The factors of every component as plain arrays, to be stored and loaded as they are. deserialize()
+  //   is false (and leaves nothing prepared) unless data holds components of size N covering it once
+  std::vector<uint8_t> serialize() const;
+  bool deserialize(const uint8_t* data, size_t size, int N, int maxChunks);
+
+private:
+  struct Component {
+    std::vector<uint32_t> nodes;  // global indices, ascending
+    std::vector<float> denseLU;     // column-major, unit L below the diagonal, U on and above (small ones)
+    std::vector<int> densePermutation;
+    SparseLUFactors sparse;  // used if n > 0
+    size_t scratchOffset = 0;
+    double cost = 0.0;
+  };
+
+  int N = 0;
+  std::vector<Component> components;
+  std::vector<int> chunkStart;  // components [chunkStart[c], chunkStart[c+1]) form chunk c
+  size_t footprint = 0;
+  double totalCost = 0.0;
+
+  void finishPrepare(int maxChunks);  // costs, scratch and chunks of the factorized components
+  void solveComponents(const float* f, float* g, float* scratch, int begin, int end) const;
+};
+}  // namespace audio_plugin
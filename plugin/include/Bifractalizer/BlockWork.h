@@ -0,0 +1,76 @@
+#pragma once
+
+#include "GatherPlan.h"
+#include "FractalKernels.h"
+#include "FractalSeries.h"
+#include "DefractalizerBackends.h"
+
+
+namespace audio_plugin {
+// One block of every channel through one engine, as a row of work units that can be run in pieces:
+//   runUntil(u1), runUntil(u2), ..., runUntil(units()) writes bit for bit what one runUntil(units()) does.
+//   So the processor can do a block at once or spread it over the callbacks that bring the next one in.
+// Units are those of the pieced evaluators (see FractalSeries.h) per channel, rows of the gather per channel
+//   pair (run in whole 16-row slices), and one per channel for the backends: a factorization is solved
+//   (and refined) in one go, so there a piece is never smaller than a channel's solve.
+class BlockWork {
+public:
+  static constexpr int maxChannels = 8;
+
+  enum class Engine {
+    copy,                    // bypass
+    fractalizeInfinite,      // orbits of plans
+    fractalizeDoubling,
+    fractalizeGather,        // gather plans of plans
+    defractalizeInfinite,
+    defractalizeClosedForm,
+    defractalizeBackend      // backend, the closed form for a channel whose solve blows up
+  };
+
+  struct Setup {
+    Engine engine = Engine::copy;
+    int N = 0;
+    int beta = 2;
+    float alpha = 0.5f;
+    int numTerms = 1;         // doubling, closed form
+    int closedFormSteps = 0;  // closed form
+    int refinementSteps = 0;  // backend
+    double iterationBudget = 0.0;  // backend: seconds a channel's iterative solve may take, 0: no new cap
+    int firstChannel = 0;          // backend: the workspace's channel of in[0] (warm starts are per channel)
+    bool coldStart = false;        // backend: no warm start, the block doesn't depend on the ones before it
+    const DefractalizerProblem* plans = nullptr;
+    const DefractalizerBackend* backend = nullptr;
+    DefractalizerWorkspace* workspace = nullptr;  // only touched by whoever runs the block
+    KernelLevel kernelLevel = KernelLevel::scalar;
+    float* scratch = nullptr;  // 3 N floats, untouched by anything else until the block is done
+  };
+
+  // in and out hold numChannels (up to maxChannels) channels of N samples and stay put until the block is done
+  void start(const Setup& setup, const float* const* in, float* const* out, int numChannels);
+  // Drops the block (what's written so far stays written)
+  void abandon() { done = totalUnits = 0; }
+
+  int units() const { return totalUnits; }
+  int unitsDone() const { return done; }
+  bool finished() const { return done >= totalUnits; }
+  const Setup& setup() const { return work; }
+
+  // Runs the units up to unit (at least, a gather piece ends on a slice), returns how many it ran
+  int runUntil(int unit);
+
+  // Worst ||f - A g|| / ||f|| of the backend solves so far, NaN once a channel needed the closed form
+  double residual() const { return worstResidual; }
+
+private:
+  Setup work;
+  const float* in[maxChannels] = {};
+  float* out[maxChannels] = {};
+  int numChannels = 0;
+  int unitsPerLane = 0;  // a lane: a channel, or a channel pair for the gather
+  int totalUnits = 0, done = 0;
+  InfiniteSeriesCarry carry;
+  double worstResidual = 0.0;
+
+  void runPiece(int lane, int begin, int end);
+};
+}  // namespace audio_plugin
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <Eigen/Sparse>
+
+#include "GatherPlan.h"
+#include "DefractalizerKind.h"
+#include "FractalKernels.h"
+#include "FractalSeries.h"
+#include "IterativeDefractalizer.h"
+
+
+namespace audio_plugin {
+// Every way of solving A g = f behind one interface, so the processor (and the auto-selection)
+//   doesn't care whether it's a factorization, a closed form or an iteration.
+// A prepared backend is read-only: everything solve() mutates lives in a DefractalizerWorkspace.
+
+// Everything that defines A for one (N, \alpha, \beta, quality)
+struct DefractalizerProblem {
+  int N = 0;
+  int beta = 2;
+  float alpha = 0.5f;
+  int numTerms = 0;
+  float tolerance = 1e-7f;  // relative accuracy the iterative backend stops at
+  int closedFormSteps = 0;
+  int maxThreads = 1;       // how many threads the block backend may split a solve into
+  KernelLevel kernelLevel = KernelLevel::scalar;
+  GatherPlan plan;
+  SlicedGatherPlan sliced;
+  OrbitPlan orbits;
+
+  size_t memoryFootprint() const;
+};
+
+// "quality" choice (Draft, Normal, Exact) -> weight below which series terms are dropped
+float qualityTolerance(int quality);
+
+std::shared_ptr<const DefractalizerProblem> makeDefractalizerProblem(int N, int beta, float alpha, int numTerms,
+                                                                     float tolerance, KernelLevel kernelLevel,
+                                                                     int maxThreads);
+
+// Runs task(0) ... task(count - 1), possibly on several threads, and returns when all are done
+using ParallelFor = std::function<void(int count, const std::function<void(int)>& task)>;
+
+// Per-instance mutable state of a solve
+struct DefractalizerWorkspace {
+  std::vector<float> scratch;
+  IterativeDefractalizer iterative;  // warm starts
+  ParallelFor parallelFor;           // empty -> everything on the calling thread
+  int maxIterations = 64;            // iteration cap of the iterative backend
+  std::vector<float> residual, correction;  // for solveRefined
+};
+
+class DefractalizerBackend {
+public:
+  virtual ~DefractalizerBackend() = default;
+
+  virtual DefractalizerKind kind() const = 0;
+
+  // Builds/factorizes whatever the backend needs, may be slow - never call it on the audio thread
+  //   unless cheapToPrepare(). Returns false if A can't be factorized this way.
+  virtual bool prepare(std::shared_ptr<const DefractalizerProblem> problem) = 0;
+  virtual bool cheapToPrepare() const { return false; }
+
+  // Sizes the workspace for this backend and numChannels
+  virtual void prepareWorkspace(DefractalizerWorkspace& workspace, int numChannels) const;
+
+  // g = A^{-1} f for one channel
+  virtual void solve(const float* f, float* g, int channel, DefractalizerWorkspace& workspace) const = 0;
+  // false if refinement steps (solveRefined) are no use: the backend gets to its tolerance by itself
+  virtual bool refinable() const { return true; }
+  // true if a solve leaves something in the workspace for the channel's next solve (a warm start): then
+  //   a channel's blocks go one after another through one workspace, never side by side
+  virtual bool keepsStateBetweenSolves() const { return false; }
+
+  // Prepared state worth keeping on disk (see DefractalizerDiskCache.h). Empty if the backend has
+  //   nothing beyond the problem or can't export it, then prepareFromState() simply prepares again.
+  virtual std::vector<uint8_t> saveState() const { return {}; }
+  virtual bool prepareFromState(std::shared_ptr<const DefractalizerProblem> problem, const uint8_t* state, size_t size) {
+    (void)state;
+    (void)size;
+    return prepare(std::move(problem));
+  }
+
+  // Bytes held by the prepared backend on top of the (shared) problem
+  virtual size_t memoryFootprint() const = 0;
+  // Rough flop count of one solve of one channel
+  virtual double estimatedCost() const = 0;
+
+  const DefractalizerProblem& problem() const { return *problemPtr; }
+
+protected:
+  std::shared_ptr<const DefractalizerProblem> problemPtr;
+};
+
+std::unique_ptr<DefractalizerBackend> makeDefractalizerBackend(DefractalizerKind kind);
+
+// Mixed-precision iterative refinement: after the (float) solve, refinementSteps times
+//   r = f - A g  (accumulated in double),  A d = r  (the same float factorization),  g += d.
+// For \alpha near 1 A is badly conditioned and a float solve alone loses digits, every step wins
+//   them back at the cost of one solve + one gather. Returns ||f - A g|| / ||f|| of the final g
+//   (in double). Non-refinable backends are solved once and only the residual is measured.
+double solveRefined(const DefractalizerBackend& backend, const float* f, float* g, int channel,
+                    DefractalizerWorkspace& workspace, int refinementSteps);
+
+// A(i, j) = sum of weights of the terms of f(i) that read g(j)
+void findDefractalizerMatrix(Eigen::SparseMatrix<float>& A, const GatherPlan& plan);
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~- auto-selection -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-
+struct BackendTiming {
+  DefractalizerKind kind;
+  bool prepared = false;
+  float relativeError = 0.0f;    // worst over the test signals
+  double secondsPerSolve = 0.0;
+  size_t memoryFootprint = 0;
+  double estimatedCost = 0.0;
+};
+
+// Prepares every backend worth trying for this problem (dense LU only up to denseLUMaxN), solves
+//   a few fixed test signals with each and returns the fastest one whose relative error stays
+//   within accuracyTarget. parallelFor is what the chosen backend's workspaces will solve with, so every
+//   backend is timed as it's going to run (empty: on the calling thread). If none does, the closed form is returned, so the result is never empty - unless
+//   it runs on a pool worker whose job gets cancelled (WorkerPool::cancellationRequested), then it stops
+//   before the next backend and returns nullptr.
+constexpr int denseLUMaxN = 1024;
+
+std::unique_ptr<DefractalizerBackend> selectDefractalizerBackend(
+    std::shared_ptr<const DefractalizerProblem> problem, float accuracyTarget,
+    const ParallelFor& parallelFor, std::vector<BackendTiming>* report = nullptr);
+}  // namespace audio_plugin
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include "DefractalizerBackends.h"
+
+
+namespace audio_plugin {
+// What a prepared defractalizer depends on
+struct DefractalizerKey {
+  int N = 0;
+  int beta = 0;
+  int alphaStep = 0;  // round(100 alpha), the resolution of the alpha parameter
+  int quality = 0;
+  int solver = 0;     // "solver" parameter choice, Auto included
+
+  bool operator<(const DefractalizerKey& other) const {
+    return std::tie(N, beta, alphaStep, quality, solver)
+         < std::tie(other.N, other.beta, other.alphaStep, other.quality, other.solver);
+  }
+  bool operator==(const DefractalizerKey& other) const {
+    return std::tie(N, beta, alphaStep, quality, solver)
+        == std::tie(other.N, other.beta, other.alphaStep, other.quality, other.solver);
+  }
+};
+
+// Bounded LRU cache of prepared (immutable) defractalizers. An entry costs its backend's
+//   memoryFootprint() plus its problem's, the least recently used entries are dropped once the
+//   total is over the cap.
+// Entries are reference counted through shared_ptr and an entry that is still held outside the cache
+//   is never dropped: the cache always outlives its users' references, so whoever lets go of an
+//   operator (the audio thread included) only decrements a counter and never frees it.
+//   The memory cap may be exceeded by operators in use.
+// All methods are thread-safe.
+class DefractalizerCache {
+public:
+  explicit DefractalizerCache(size_t memoryCap) : cap(memoryCap) {}
+
+  // nullptr if not cached, a hit becomes the most recently used entry
+  std::shared_ptr<const DefractalizerBackend> find(const DefractalizerKey& key);
+  bool contains(const DefractalizerKey& key) const;
+  // Returns the operator to use from now on: backend, or the one another thread cached first
+  std::shared_ptr<const DefractalizerBackend> insert(const DefractalizerKey& key,
+                                                     std::shared_ptr<const DefractalizerBackend> backend);
+
+  void setMemoryCap(size_t memoryCap);
+  size_t memoryUsed() const;
+  size_t size() const;
+
+private:
+  struct Entry {
+    DefractalizerKey key;
+    std::shared_ptr<const DefractalizerBackend> backend;
+    size_t bytes;
+  };
+
+  mutable std::mutex mutex;
+  std::list<Entry> entries;  // most recently used first
+  std::map<DefractalizerKey, std::list<Entry>::iterator> index;
+  size_t cap;
+  size_t used = 0;
+
+  std::shared_ptr<const DefractalizerBackend> findLocked(const DefractalizerKey& key);
+  void evict();  // under mutex
+};
+
+// The plans of the operator for key: series terms from key.quality, threads from key.N
+std::shared_ptr<const DefractalizerProblem> makeDefractalizerProblem(const DefractalizerKey& key, float alpha,
+                                                                     KernelLevel kernelLevel);
+
+// Prepares the operator for key from scratch (or from problem, if it's given). key.solver is a DefractalizerKind
+//   or Auto (numKinds): Auto measures all backends (selectDefractalizerBackend) unless knownKind >= 0 says which
+//   one won before
+std::shared_ptr<DefractalizerBackend> buildDefractalizerOperator(const DefractalizerKey& key, float alpha,
+                                                                 KernelLevel kernelLevel, const ParallelFor& parallelFor,
+                                                                 float accuracyTarget, int knownKind = -1,
+                                                                 std::shared_ptr<const DefractalizerProblem> problem = nullptr);
+
+// One store for the whole process, so plugin instances with the same settings share one operator
+DefractalizerCache& sharedDefractalizerCache();
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~- handing operators to the audio thread -~-~-~-~-~-~-~-~-~-~-~-~-~-
+// An operator ready to run, workspace included: built on a worker thread, then owned by the audio thread
+struct PublishedDefractalizer {
+  DefractalizerKey key;
+  std::shared_ptr<const DefractalizerBackend> backend;  // nullptr if it couldn't be built
+  DefractalizerWorkspace workspace;
+  // more of them for blocks solved side by side, only for backends that keep no state between solves
+  std::vector<DefractalizerWorkspace> blockWorkspaces;
+  FractalEngine fractalEngine = FractalEngine::gather;  // the cheaper forward evaluator for backend's plans
+  bool interim = false;  // the closed form standing in while the requested backend is prepared
+  PublishedDefractalizer* next = nullptr;  // in the retired list
+};
+
+// Lock-free handover between worker threads and the audio thread. The audio thread never allocates
+//   or frees here: it takes whole operators and gives back the ones it's done with, workers free them.
+class DefractalizerHandover {
+public:
+  DefractalizerHandover() = default;
+  ~DefractalizerHandover();  // frees whatever is still published or retired
+  DefractalizerHandover(const DefractalizerHandover&) = delete;
+  DefractalizerHandover& operator=(const DefractalizerHandover&) = delete;
+
+  // Worker: op is the next one to take, an older one the audio thread didn't take yet is freed
+  void publish(std::unique_ptr<PublishedDefractalizer> op);
+  // Audio thread: the newest published operator (the caller owns it from now on) or nullptr
+  PublishedDefractalizer* take();
+  // Audio thread: hands back an operator that is no longer used
+  void retire(PublishedDefractalizer* op);
+  // Worker: frees everything retired so far
+  void reclaim();
+
+private:
+  std::atomic<PublishedDefractalizer*> published{nullptr};
+  std::atomic<PublishedDefractalizer*> retired{nullptr};  // a stack, only ever emptied as a whole
+};
+}  // namespace audio_plugin
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DefractalizerBackends.h"
+#include "DefractalizerCache.h"
+
+
+namespace audio_plugin {
+// Optional on-disk cache of prepared operators, one file per DefractalizerKey (the solver choice
+//   is the engine, Auto included - the file then remembers which backend won).
+// File layout (little endian, every section 64-byte aligned so the file can be used straight from
+//   a read-only memory mapping):
+//   header | section table | rowStart | indices16 | indices32 | weights | sliceStart | sliced indices |
+//   sliced weights | cycleNodes | cycleStart | transient | engine state
+// The header carries a magic, the format version, the key and an FNV-1a checksum of everything after it,
+//   files of another version, for another key or with a wrong checksum are ignored (and rebuilt).
+// Loading maps the file and copies the sections out: the gather/orbit plans are never recomputed and
+//   backends with a saveState() (dense LU, sparse LU, block LU) don't factorize again, the others prepare
+//   from the loaded plans. Every index of the plans is checked against N first: a file that passes the
+//   checksum may still come from another build, and the kernels don't check.
+class DefractalizerDiskCache {
+public:
+  static constexpr uint32_t formatVersion = 1;
+
+  // Empty directory (the default) turns the cache off
+  void setDirectory(const std::filesystem::path& directory);
+  std::filesystem::path directory() const;
+  bool enabled() const { return !directory().empty(); }
+
+  std::filesystem::path pathFor(const DefractalizerKey& key) const;
+
+  // nullptr if there's no valid file for key
+  std::shared_ptr<DefractalizerBackend> load(const DefractalizerKey& key, KernelLevel kernelLevel) const;
+  // A file for key with a valid header and checksum, what's in it isn't looked at (that's load's job)
+  bool contains(const DefractalizerKey& key) const;
+  // Written to a temporary file and renamed, so readers never see half a file
+  bool save(const DefractalizerKey& key, const DefractalizerBackend& backend) const;
+
+private:
+  mutable std::mutex mutex;
+  std::filesystem::path dir;
+};
+
+// One disk cache for the whole process, off unless BIFRACTALIZER_OPERATOR_CACHE names a directory
+//   or one is set
+DefractalizerDiskCache& sharedDiskCache();
+
+// The operator for key from the shared cache, else from the shared disk cache, else built (Auto measures the
+//   backends unless knownKind says which one won before) and stored in both. problemReady (optional) gets the
+//   plans of a build before the solver is prepared, false from it stops the build there (nullptr).
+// Concurrent requests for one key build it once: the others wait for that build, get its plans through their
+//   own problemReady and then its operator. On a worker they stop waiting (nullptr) once their job is cancelled
+using ProblemReady = std::function<bool(const std::shared_ptr<const DefractalizerProblem>&)>;
+std::shared_ptr<const DefractalizerBackend> acquireDefractalizerOperator(const DefractalizerKey& key, float alpha,
+                                                                         KernelLevel kernelLevel,
+                                                                         const ParallelFor& parallelFor,
+                                                                         float accuracyTarget, int knownKind = -1,
+                                                                         const ProblemReady& problemReady = {});
+
+// Every combination of the lists, alpha in steps of 0.01
+struct DiskCacheGrid {
+  std::vector<int> Ns;
+  std::vector<int> betas;
+  std::vector<int> alphaSteps;
+  std::vector<int> qualities;
+  std::vector<int> solvers;
+};
+
+// Builds and stores every operator of the grid that isn't on disk yet, returns how many were written.
+//   progress (optional) is called after every key.
+int populateDiskCache(const DefractalizerDiskCache& cache, const DiskCacheGrid& grid, KernelLevel kernelLevel,
+                      float accuracyTarget,
+                      const std::function<void(const DefractalizerKey&, bool written)>& progress = {});
+}  // namespace audio_plugin
@@ -0,0 +1,18 @@
+#pragma once
+
+
+namespace audio_plugin {
+// The order matches the choices of the "solver" parameter
+enum class DefractalizerKind {
+  closedForm = 0,
+  sparseLU,         // SparseLU, COLAMD ordering
+  blockLU,          // dense/sparse LU on every orbit component (see BlockDefractalizer.h)
+  iterative,        // warm-started Richardson (see IterativeDefractalizer.h)
+  sparseLUAMD,      // SparseLU, AMD ordering
+  sparseLUNatural,  // SparseLU, no reordering
+  denseLU,          // PartialPivLU of the whole N x N matrix
+  numKinds
+};
+
+const char* defractalizerKindName(DefractalizerKind kind);
+}  // namespace audio_plugin
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "GatherPlan.h"
+
+
+namespace audio_plugin {
+// Instruction sets the fractalizer gather has kernels for, ordered by width
+enum class KernelLevel { scalar = 0, sse41, avx2, avx512 };
+
+// The best level this CPU (and OS) supports, CPUID is queried once
+KernelLevel detectKernelLevel();
+const char* kernelLevelName(KernelLevel level);
+
+// GatherPlan rearranged for SIMD (sliced ELLPACK): rows are grouped in slices of sliceWidth,
+//   every row of a slice is padded to the longest row of the slice with zero weights
+//   and entries are stored slot-major, so one vector load gives the k-th index of sliceWidth rows.
+// Padding is appended after the real entries of a row and adds +-0, so every kernel sums
+//   each row in exactly the same order as applyGatherPlan -> the results are bit-identical.
+struct SlicedGatherPlan {
+  static constexpr int sliceWidth = 16;
+
+  int N = 0;
+  std::vector<uint32_t> sliceStart;  // size numSlices+1, in elements
+  std::vector<uint16_t> indices;
+  std::vector<float> weights;
+
+  // SIMD kernels need 16-bit indices, otherwise the scalar CSR path is used
+  bool valid() const { return N > 0 && !sliceStart.empty(); }
+};
+
+void buildSlicedGatherPlan(SlicedGatherPlan& sliced, const GatherPlan& plan);
+
+// f[ch] = plan(g[ch]) for every channel. Channels are processed in pairs
+//   so each index is decoded once for both channels of a stereo pair.
+// level is clamped to detectKernelLevel()
+void applyFractalKernel(const GatherPlan& plan, const SlicedGatherPlan& sliced,
+                        const float* const* g, float* const* f, int numChannels,
+                        KernelLevel level);
+
+// Only rows [rowBegin, rowEnd) of f. Both are multiples of sliceWidth (rowEnd may also be N), so
+//   the SIMD kernels run whole slices and pieces of one block give exactly the one-shot result
+void applyFractalKernelRows(const GatherPlan& plan, const SlicedGatherPlan& sliced,
+                            const float* const* g, float* const* f, int numChannels,
+                            KernelLevel level, int rowBegin, int rowEnd);
+}  // namespace audio_plugin
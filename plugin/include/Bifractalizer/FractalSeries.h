@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "GatherPlan.h"
+
+
+namespace audio_plugin {
+// Evaluators of S_K(i) = \sum_{n = 0}^{K-1}{\alpha^n g(M^n i)}, M: i -> \beta i mod N,
+//   that don't go through the gather plan term by term.
+
+// Number of terms worth evaluating: never more than the \beta-based count (\beta^K >= 10^6 - the
+//   same as the original series) and none whose weight \alpha^n is below tolerance (0 = keep all)
+int seriesTermCount(int beta, float alpha, float tolerance);
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~- log-depth doubling -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-
+// S_{a+b}(i) = S_a(i) + \alpha^a S_b(M^a i), so S_K is built from S_1 = g by doubling
+//   S_{2k} = S_k + \alpha^k S_k∘M^k and adding the set bits of K: every pass is one gather + one FMA
+//   over the whole buffer and there are only ~log2(K) + popcount(K) - 1 of them.
+
+// Number of full-buffer passes the doubling evaluator needs for K terms
+int doublingPasses(int numTerms);
+
+// f = S_K(g), scratch must hold at least 3*N floats
+void fractalizeDoubling(const float* g, float* f, float* scratch,
+                        int N, int beta, float alpha, int numTerms);
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~-~- infinite series (exact) -~-~-~-~-~-~-~-~-~-~-~-~-~-~-
+// Under M every index reaches a cycle after a few steps, so S_\infty = \sum_{n >= 0}{\alpha^n g∘M^n}
+//   has a closed form: on a cycle c_0 -> c_1 -> ... -> c_{L-1} -> c_0
+//     S(c_0) = \sum_{k < L}{\alpha^k g(c_k)} / (1 - \alpha^L),  S(c_k) = g(c_k) + \alpha S(c_{k+1})
+//   and every transient index follows from its successor, S(i) = g(i) + \alpha S(M i).
+// The cost is N + (total cycle length) per channel, no truncation at all.
+struct OrbitPlan {
+  int N = 0;
+  int beta = 0;
+  std::vector<uint32_t> cycleNodes;  // all cycles one after another, cycleNodes[k+1] = M cycleNodes[k]
+  std::vector<uint32_t> cycleStart;  // size numCycles+1
+  std::vector<uint32_t> transient;   // the rest, sorted by distance to the cycle (M i always comes first)
+};
+
+void buildOrbitPlan(OrbitPlan& plan, int N, int beta);
+
+// f = S_\infty(g)
+void fractalizeInfinite(const OrbitPlan& plan, float alpha, const float* g, float* f);
+
+// exact inverse of S_\infty: g = f - \alpha f∘M
+void defractalizeInfinite(int N, int beta, float alpha, const float* f, float* g);
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~- closed-form inverse -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-
+// With P: g -> g∘M the truncated operator is A = \sum_{n < K}{(\alpha P)^n} = (I - (\alpha P)^K) (I - \alpha P)^{-1},
+//   so A^{-1} = (I - \alpha P) (I - \alpha^K P^K)^{-1}.
+// The tail factor is applied by the fixed-point iteration h <- f + \alpha^K h∘M^K (starting from h = f),
+//   whose error shrinks by \alpha^K per step. No matrix, no factorization: O(N) per refinement step.
+
+// Refinement steps needed to bring the tail error \alpha^{K (steps+1)} below tolerance
+int closedFormRefinements(float alpha, int numTerms, float tolerance);
+
+// g = A^{-1} f, scratch must hold at least 2*N floats
+void defractalizeClosedForm(const float* f, float* g, float* scratch,
+                            int N, int beta, float alpha, int numTerms, int refinements);
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~- in pieces -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-
+// The evaluators above as a row of work units, so one block can be spread over several calls
+//   (see BlockWork.h). A unit is one sample of one pass: the one-shot calls run units [0, ...Units()),
+//   running them in consecutive pieces [0, u1), [u1, u2), ... gives bit for bit the same.
+//   The scratch must be left alone between the pieces of one evaluation.
+int fractalizeDoublingUnits(int N, int numTerms);
+void fractalizeDoublingPiece(const float* g, float* f, float* scratch,
+                             int N, int beta, float alpha, int numTerms, int begin, int end);
+
+// Two units per cycle node (summing the cycle up, then going back through it) and one per transient.
+//   A cycle's sum may span pieces, carry holds it in between
+struct InfiniteSeriesCarry {
+  float sum = 0.0f;
+  float alphaPow = 1.0f;
+};
+int fractalizeInfiniteUnits(const OrbitPlan& plan);
+void fractalizeInfinitePiece(const OrbitPlan& plan, float alpha, const float* g, float* f,
+                             InfiniteSeriesCarry& carry, int begin, int end);
+
+// N units
+void defractalizeInfinitePiece(int N, int beta, float alpha, const float* f, float* g, int begin, int end);
+
+int defractalizeClosedFormUnits(int N, int refinements);
+void defractalizeClosedFormPiece(const float* f, float* g, float* scratch,
+                                 int N, int beta, float alpha, int numTerms, int refinements, int begin, int end);
+
+enum class FractalEngine { gather, doubling };
+
+// Picks the cheaper evaluator for this plan: gather reads plan.nonZeros() samples per channel,
+//   doubling reads N samples per pass
+FractalEngine chooseFractalEngine(const GatherPlan& plan, int numTerms);
+}  // namespace audio_plugin
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace audio_plugin {
+// Precomputed form of f(i) = \sum_{n = 0}^{max_terms}{w_n g((\beta^n i) mod N)}
+//   x_i = i/N and \beta^n is an integer, so {\beta^n x_i} * N is exactly (\beta^n i) mod N
+//   and the whole fractalizer is a weighted gather over g.
+// Compact CSR: row i lives in [rowStart[i], rowStart[i+1]) of indices/weights,
+//   indices inside a row are sorted and unique (weights of equal indices are pre-summed).
+struct GatherPlan {
+  int N = 0;
+  int maxRowLength = 0;
+  bool compactIndices = true;      // true -> indices16 is used, false -> indices32
+  std::vector<uint32_t> rowStart;  // size N+1
+  std::vector<uint16_t> indices16;
+  std::vector<uint32_t> indices32;
+  std::vector<float> weights;
+
+  size_t nonZeros() const { return weights.size(); }
+  uint32_t index(size_t k) const {
+    return compactIndices ? indices16[k] : indices32[k];
+  }
+};
+
+// termWeights[n] = w_n, term count is termWeights.size()
+void buildGatherPlan(GatherPlan& plan, int N, int beta, const std::vector<float>& termWeights);
+
+// f = plan(g), size(f) == size(g) == plan.N
+void applyGatherPlan(const GatherPlan& plan, const float* g, float* f);
+}  // namespace audio_plugin
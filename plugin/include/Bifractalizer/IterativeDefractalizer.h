@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "GatherPlan.h"
+#include "FractalKernels.h"
+
+
+namespace audio_plugin {
+// Matrix-free iterative defractalizer: preconditioned Richardson iteration
+//   x <- x + B (f - A x),  B = I - \alpha P  (P: g -> g∘M)
+// where A is applied through the fractalizer gather plan and B is the exact inverse of the
+//   infinite series, so the error shrinks by \alpha^K per iteration for the truncated one.
+// Every channel starts from its previous block's solution (warm start), nothing is factorized,
+//   so parameter changes never leave the defractalizer without a solution.
+class IterativeDefractalizer {
+public:
+  // What a float residual reliably gets down to (relative), the rounding noise is just below
+  static constexpr float residualFloor = 2.5e-7f;
+
+  // Resets the warm start when N or the channel count changes
+  void prepare(int N, int numChannels);
+  // The next solve of channel starts from zero
+  void forget(int channel);
+
+  // g = A^{-1} f for one channel: stops at ||f - A x|| <= tolerance * ||f|| (tolerance no lower than
+  //   residualFloor), once the residual stops falling, or after maxIterations. Returns the number of iterations done.
+  int solve(const GatherPlan& plan, const SlicedGatherPlan& sliced, KernelLevel kernelLevel,
+            int beta, float alpha, const float* f, float* g, int channel,
+            float tolerance, int maxIterations);
+
+  // Iteration cap that fits into budgetSeconds, based on the measured cost of an iteration
+  int iterationsForBudget(double budgetSeconds, int minIterations, int maxIterations) const;
+
+  float lastRelativeResidual() const { return lastResidual; }
+
+private:
+  int N = 0;
+  std::vector<std::vector<float>> previous;  // warm start, per channel
+  std::vector<float> Ax, residual;
+  double secondsPerIteration = 0.0;  // moving average
+  float lastResidual = 0.0f;
+};
+}  // namespace audio_plugin
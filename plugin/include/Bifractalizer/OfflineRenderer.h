@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "BifractalizerCore.h"
+#include "PluginProcessor.h"
+
+
+namespace audio_plugin {
+// Renders a whole file through the processor, offline (see isNonRealtime), cut into segments that are
+//   rendered side by side on fresh instances and come out bit for bit as one instance would render it.
+// Offline every block is independent of the ones before it (the operator is waited for, the iterative
+//   solver starts cold), so a segment only has to start on the file's block grid: its instance is fed
+//   from one block before the segment (that block comes out wrong and is dropped) and the first callback
+//   is short enough for its gain ramp to fall into the dropped part.
+// The output is latency compensated: sample t of the output is the plugin's answer to sample t of the input,
+//   as many samples as the input (the last block is completed with silence).
+// Memory stays bounded: a segment's output is held until it's written, and at most 2 per thread are.
+struct OfflineRenderOptions {
+  double sampleRate = 48000.0;
+  int numChannels = 2;
+  int64_t numSamples = 0;
+  int hostBlockSize = 4096;         // the callbacks the instances get
+  int numThreads = 0;               // 0: all cores
+  int64_t segmentSamples = 1 << 18;  // about, in whole blocks
+};
+
+struct OfflineRenderStats {
+  int segments = 0;
+  int threads = 0;
+  double seconds = 0.0;
+  int missedOperators = 0;  // blocks rendered on a stand-in, the operator took too long (see getMissedOperators)
+};
+
+// A new instance with the parameters (or the state) to render with, on any thread
+using ProcessorFactory = std::function<std::unique_ptr<AudioPluginAudioProcessor>()>;
+// Input samples [start, start + count) of every channel, silence outside the input. Called from several threads
+using SampleReader = std::function<void(float* const* channels, int64_t start, int count)>;
+// Output samples [start, start + count), in order, one call at a time (on the calling thread)
+using SampleWriter = std::function<void(const float* const* channels, int64_t start, int count)>;
+
+OfflineRenderStats renderOffline(const ProcessorFactory& makeProcessor, const OfflineRenderOptions& options,
+                                 const SampleReader& read, const SampleWriter& write);
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~- many short clips -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-
+// A clip of a batch, rendered whole by an instance of its own with its own settings
+struct OfflineBatchJob {
+  double sampleRate = 48000.0;
+  int numChannels = 2;
+  ProcessorFactory makeProcessor;
+  // what the parameters of makeProcessor's instances come to (N at sampleRate, see
+  //   AudioPluginAudioProcessor::blockSizeFor), for the grouping: no instance is made for it. Settings that
+  //   don't match only cost builds, every instance still waits for its own operator
+  OperatorSettings operatorSettings;
+  // sizes clip and fills it with the input, false skips the job (it counts as failed)
+  std::function<bool(juce::AudioBuffer<float>& clip)> load;
+  // the rendered clip, latency compensated and as long as the input, false counts as failed
+  std::function<bool(const juce::AudioBuffer<float>& clip)> save;
+};
+
+struct OfflineBatchStats {
+  int files = 0, failed = 0;
+  int operators = 0;  // groups of jobs with the same operator, one build each
+  int missedOperators = 0;  // as in OfflineRenderStats, in all the files
+  int threads = 0;
+  double audioSeconds = 0.0, seconds = 0.0;
+  // per stage, summed over the threads
+  double loadSeconds = 0.0, operatorSeconds = 0.0, prepareSeconds = 0.0, renderSeconds = 0.0, saveSeconds = 0.0;
+};
+
+// Spreads the jobs over numThreads threads (0: all cores). Jobs are grouped by operator (their operatorSettings'
+//   N, alpha, beta and the mode, series and solver) and a group's jobs go one after another: the first builds
+//   the operator while the others of the group wait for it, then they all take it from the cache
+OfflineBatchStats renderBatch(const std::vector<OfflineBatchJob>& jobs, int hostBlockSize, int numThreads = 0);
+}  // namespace audio_plugin
@@ -1,11 +1,21 @@
 #pragma once
 
 #include <juce_audio_processors/juce_audio_processors.h>
-#include <Eigen/Sparse>
-#include <Eigen/SparseLU>
 
-using FloatSolver = Eigen::SparseLU<Eigen::SparseMatrix<float>>;
-//using FloatSolver = Eigen::BiCGSTAB<Eigen::SparseMatrix<float>>;
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include "GatherPlan.h"
+#include "FractalKernels.h"
+#include "FractalSeries.h"
+#include "BlockWork.h"
+#include "SpscQueue.h"
+#include "DefractalizerBackends.h"
+#include "DefractalizerCache.h"
+#include "DefractalizerDiskCache.h"
+#include "BifractalizerCore.h"
+#include "WorkerPool.h"
 
 
 namespace audio_plugin {
@@ -46,6 +56,34 @@ public:
 
   juce::AudioProcessorValueTreeState& getAPVTS() { return apvts; }
 
+  // ||f - A g|| / ||f|| of the last defractalized block (worst channel)
+  float getDefractalizerResidual() const { return defrResidual.load(); }
+
+  // an open editor puts this instance's operator builds before the other instances'
+  void setEditorOpen(bool open) { editorOpen.store(open); }
+
+  // Since the last reset: the most of a block's engine work one callback did (1 = a whole block) and
+  //   the longest the engines took in one callback. Spread over the next block the share stays within
+  //   hostBlockSize / N + one piece of BlockWork (a sample, a gather slice, or a channel's backend solve),
+  //   "on a worker" the callbacks do none of it
+  float getWorstCallbackShare() const { return worstCallbackShare.load(); }
+  float getWorstCallbackSeconds() const { return worstCallbackSeconds.load(); }
+  void resetCallbackLoad() {
+    worstCallbackShare.store(0.0f);
+    worstCallbackSeconds.store(0.0f);
+  }
+  // blocks that went out dry because the worker hadn't finished them in time ("spread" on a worker)
+  int getMissedDeadlines() const { return missedDeadlines.load(); }
+  // offline blocks that gave up waiting for their operator and went out on whatever was live: a render with
+  //   any of these isn't what the settings ask for
+  int getMissedOperators() const { return missedOperators.load(); }
+
+  // N and where the blocks start: block j takes the input samples [j N - offset, (j + 1) N - offset)
+  int getBlockSize() const;
+  // what getBlockSize comes to at sampleRate with the frequency parameter at frequency, without an instance
+  static int blockSizeFor(double sampleRate, float frequency);
+  int getBlockOffset() const;
+
 private:
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioPluginAudioProcessor)
 
@@ -54,34 +92,143 @@ private:
 
   bool bypass = false;
 
-  juce::AudioBuffer<float> inputBuffer, outputBuffer, 
-    processInBuffer, processOutBuffer, prevBuffer;
-  int inBufPos, outBufPosRead, outBufPosWrite, prevBlockOffset, prevHostBlockSize;
+  // the input ring collects a block, the output ring holds the processed ones until they're due
+  juce::AudioBuffer<float> inputBuffer, outputBuffer;
+  int inBufPos, outBufPosRead, outBufPosWrite, prevBlockOffset;
+  int maxHostBlockSize = 1;  // from prepareToPlay, callbacks may be any size up to it
+  // "spread": 1 - a complete block waits in pendingInput and is worked on while the next one comes in,
+  //   2 - it goes to a realtime worker of the pool and the result is collected when the next one is complete
+  int spreadMode = 0;
+  juce::AudioBuffer<float> pendingInput;
+  BlockWork blockWork;
+  double callbackShare = 0.0, callbackSeconds = 0.0;  // of the current callback
+  std::atomic<float> worstCallbackShare{0.0f}, worstCallbackSeconds{0.0f};
   float previousGain = 1.0f;
+  // -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~- blocks on the worker -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-
+  struct OffloadedBlock {
+    juce::AudioBuffer<float> input, output;
+    BlockWork work;
+    int outBufPos = 0;              // where the result goes in the output ring
+    bool inFlight = false;          // audio thread: handed over, not back yet
+    bool done = false;              // audio thread: back with the result, not collected yet
+    std::atomic<bool> abandoned{false};  // missed its deadline or the settings changed: the result is dropped
+  };
+  static constexpr int numOffloadedBlocks = 4;  // one being worked on, one queued, late ones on their way back
+  OffloadedBlock offloaded[numOffloadedBlocks];
+  SpscQueue<int, numOffloadedBlocks + 1> toWorker, fromWorker;  // indices into offloaded
+  int blockDue = -1;        // collected when the next block is complete
+  int blocksInFlight = 0;   // while there are any the worker owns the live operator's workspace
+  std::vector<float> workerScratch;
+  std::atomic<int> missedDeadlines{0};
+  std::atomic<int> missedOperators{0};
+  // -~-~-~-~-~-~-~- whole blocks of one host buffer, worked on side by side -~-~-~-~-~-~-~-
+  static constexpr int maxBatchBlocks = 8;
+  BlockWork batch[maxBatchBlocks];
+  int batchSize = 0;
+  std::vector<float> batchScratch;        // seriesScratch.size() floats per block
+  std::atomic<uint32_t> batchClaim{0};    // blocks << 16 | the next one to claim
+  std::atomic<int> batchDone{0};
+  std::unique_ptr<WorkerPool::Job> batchHelpers[maxBatchBlocks - 1];
+  // -~-~-~-~-~-~- the chunks of one backend solve (Block LU, long blocks) side by side -~-~-~-~-~-~-
+  static constexpr int maxSolveHelpers = 4;
+  const std::function<void(int)>* solveTask = nullptr;
+  std::atomic<uint32_t> solveClaim{0};  // chunks << 16 | the next one to claim
+  std::atomic<int> solveDone{0};
+  std::unique_ptr<WorkerPool::Job> solveHelpers[maxSolveHelpers];
+  std::atomic<bool> solvesOffline{false};  // isNonRealtime() as of the current callback, for the workers
   // -~-~-~-~-~-~-~-~-~-~ vs clicks when changing settings -~-~-~-~-~-~-~-~-~-
   int buffers2Update = 0;
   int need2UpdateBuffers = 0;
   // -~-~-~-~-~-~-~-~-~-~-~-~-~--~-~-~-~-~-~-~-~-~-~-~-~-~--~-~-~-~-~-~-~-~-~-
 
   // -~-~-~-~-~-~-~-~-~-~-~-~-~ for </de>fractalizer -~-~-~-~-~-~-~-~-~-~-~-~-
+  static constexpr float minFrequency = 20.0f;  // the longest block is sampleRate / minFrequency
   int processingN, max_terms = 20;
-  std::vector<float> xGrid, beta_pow_n, weights;
+  int infiniteTerms = 1;
+  KernelLevel kernelLevel = detectKernelLevel();
+  std::vector<float> seriesScratch;
   float prevAlpha = 0.5f;
   int prevBeta = 2;
+  int prevQuality = 1;
+  float seriesTolerance = 1e-7f;
   void updateCoeffs();
   // -~-~-~-~-~-~-~-~-~-~-~-~-~- for defractalizer -~-~-~-~-~-~-~-~-~-~-~-~-~-
-  bool actualDefrMatrix = false; 
-  Eigen::SparseMatrix<float> defrMatrix;
-  FloatSolver defrSolver;
-  juce::ThreadPool threadPool;
-  std::atomic<bool> solverReady{true};
-  void prepareDefractalizer();
+  static constexpr int autoSolver = static_cast<int>(DefractalizerKind::numKinds);  // "Auto" choice
+  static constexpr float autoAccuracyTarget = 1e-3f;
+  int closedFormSteps = 0;
+  std::atomic<float> defrResidual{0.0f};
+  float iterativeCpuBudget = 0.1f;  // share of a block's duration the iterative solver may take
+  // the operator the audio thread runs (owned by it, its plans also drive the fractalizer)
+  //   and what it asked the worker for last
+  PublishedDefractalizer* liveDefractalizer = nullptr;
+  DefractalizerKey requestedDefrKey;
+  std::atomic<uint64_t> defrRequest{0};  // the request packed into one word (see requestDefractalizer)
+  std::atomic<bool> editorOpen{false};
+  DefractalizerHandover defrHandover;
+  // prepared operators of recently used configurations, shared by all instances in the process,
+  //   so going back to one (or another instance using it) doesn't refactorize
+  DefractalizerCache& operatorCache = sharedDefractalizerCache();
+  // (N, beta, alpha) to prepare ahead of time, set by prepareToPlay
+  std::vector<std::tuple<int, int, float>> prewarmConfigs;
+  int prewarmSolver = autoSolver, prewarmQuality = 1;
+  std::mutex prewarmMutex;
+  // measured auto choices, (N, beta, round(100 alpha), terms) -> DefractalizerKind, saved with the state
+  std::map<std::tuple<int, int, int, int>, int> autoSolverChoices;
+  std::mutex autoSolverMutex;
+  // the process-wide pool runs the builds, a newer request cancels the build that's under way
+  WorkerPool& workerPool = sharedWorkerPool();
+  WorkerPool::Job defrBuildJob{[this] { runDefractalizerBuild(); }};
+  WorkerPool::Job prewarmJob{[this] { runPrewarm(); }};
+  WorkerPool::Job offloadJob{[this] { runOffloadedBlocks(); }};
+  // asks the pool for the operator for key (audio thread, no allocation, never blocks)
+  void requestDefractalizer(const DefractalizerKey& key);
+  // builds what's requested last and publishes it to defrHandover
+  void runDefractalizerBuild();
+  // cached or freshly prepared, may be slow - never on the audio thread. problemReady (optional) gets
+  //   the plans as soon as they're built, before the (slow) preparation of the solver
+  using ProblemCallback = std::function<void(const std::shared_ptr<const DefractalizerProblem>&)>;
+  std::shared_ptr<const DefractalizerBackend> buildDefractalizer(int N, int beta, float alpha, int quality, int solver,
+                                                                 const ProblemCallback& problemReady = {});
+  // fills operatorCache with the current configuration and its neighbours in the background
+  void prewarmDefractalizers();
+  void runPrewarm();
   // -~-~-~-~-~-~-~-~-~-~-~-~-~--~-~-~-~-~-~-~-~-~-~-~-~-~--~-~-~-~-~-~-~-~-~-
 
-  int getBlockSize() const;
-  int getBlockOffset() const;
+  int getQuality() const;  // offline it's always Exact
   float getGain() const;
-  void updateBuffers(int hostBlockSize);
-  void processCustomBlock();
+  void updateBuffers();
+  // in: N samples (the input ring, or a whole block in the host buffer) -> the output ring at outBufPosWrite,
+  //   right away or (spread) by the time the next block is complete
+  void processCustomBlock(const juce::AudioBuffer<float>& in);
+  // picks the engine for numChannels channels of in (from firstChannel on) and sets work up to write
+  //   to out (batchSlot: the block's place in the batch)
+  void startBlockWork(BlockWork& work, const float* const* in, float* const* out, int firstChannel,
+                      int numChannels, float* scratch, int batchSlot = -1);
+  // offline: takes operators until the one for wanted is live (it was requested already)
+  void waitForDefractalizer(const DefractalizerKey& wanted, bool plansWillDo);
+  // runs blockWork up to unit and books it on the current callback
+  void runBlockWork(int unit);
+  void storeResidual(const BlockWork& work);
+  // audio thread: writes the block due to the output ring and hands in over to the worker
+  void offloadBlock(const juce::AudioBuffer<float>& in);
+  void collectOffloadedBlocks();
+  // the block due now to the output ring: the worker's result if it's back, else the dry block
+  void writeDueBlock();
+  // worker: runs what's handed over, in order
+  void runOffloadedBlocks();
+  // audio thread: results still on their way are dropped
+  void abandonOffloadedBlocks();
+  // in: a whole block, it's done by the next runBatch (at the latest). Offline its channels go separately
+  void batchBlock(const juce::AudioBuffer<float>& in);
+  // offline from here on: what spreading or the worker has in hand is finished now
+  void finishPendingBlocks();
+  // the batched blocks, spread over the pool when they're independent, bit for bit as one after another
+  void runBatch();
+  // audio thread and helpers: claims batched blocks and runs them until there are none left
+  void runBatchBlocks();
+  // the live operator's solves in real time: the chunks on the calling thread and the realtime workers,
+  //   without allocating
+  void solveOnRealtimeWorkers(int count, const std::function<void(int)>& task);
+  void runSolveChunks();
 };
 }  // namespace audio_plugin
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include <Eigen/SparseLU>
+
+
+namespace audio_plugin {
+// The factors of an Eigen::SparseLU (P_r A P_c^T = L U) copied out into plain CSC arrays.
+//   Eigen's own solve allocates a work vector on every call (and a mask for the in-place
+//   column permutation), this one only touches caller memory, so it can run on the audio thread.
+//   Plain arrays can also be stored and loaded as they are.
+struct SparseLUFactors {
+  int n = 0;
+  std::vector<int> rowPerm;  // x[rowPerm[i]] = b[i]
+  std::vector<int> colPerm;  // out[k] = x[colPerm[k]]
+  std::vector<int> lStart, lRows;  // strictly lower part of L (unit diagonal), by column
+  std::vector<float> lValues;
+  std::vector<int> uStart, uRows;  // strictly upper part of U, by column
+  std::vector<float> uValues;
+  std::vector<float> uDiagonal;
+
+  template <typename LU>
+  void extract(const LU& lu);
+
+  // out = A^{-1} b. out may be b, work holds n floats and must be neither
+  void solve(const float* b, float* out, float* work) const;
+
+  size_t nonZeros() const { return lValues.size() + uValues.size() + uDiagonal.size(); }
+  size_t memoryFootprint() const;
+
+  std::vector<uint8_t> serialize() const;
+  bool deserialize(const uint8_t* data, size_t size);  // false (and empty) if data isn't valid
+};
+
+// The states are sequences of arrays, each one its element count (64 bits) and then its elements
+template <typename T>
+void putArray(std::vector<uint8_t>& data, const std::vector<T>& values) {
+  const uint64_t count = values.size();
+  const size_t at = data.size();
+  data.resize(at + sizeof(count) + sizeof(T) * values.size());
+  std::memcpy(data.data() + at, &count, sizeof(count));
+  if (!values.empty())
+    std::memcpy(data.data() + at + sizeof(count), values.data(), sizeof(T) * values.size());
+}
+
+// false if the array runs past end, data is left after it otherwise
+template <typename T>
+bool getArray(const uint8_t*& data, const uint8_t* end, std::vector<T>& values) {
+  uint64_t count = 0;
+  if (static_cast<size_t>(end - data) < sizeof(count))
+    return false;
+  std::memcpy(&count, data, sizeof(count));
+  data += sizeof(count);
+  if (count > static_cast<size_t>(end - data) / sizeof(T))
+    return false;
+  values.resize(count);
+  if (count != 0)
+    std::memcpy(values.data(), data, sizeof(T) * values.size());
+  data += sizeof(T) * values.size();
+  return true;
+}
+
+
+template <typename LU>
+void SparseLUFactors::extract(const LU& lu) {
+  // L's supernodes also hold the diagonal blocks of U, the rest of U is stored separately.
+  //   The public matrixL()/matrixU() views expose both storages (m_mapL, m_mapU).
+  const auto lView = lu.matrixL();
+  const auto uView = lu.matrixU();
+  const auto& supernodes = lView.m_mapL;
+  const auto& upper = uView.m_mapU;
+  using SupernodalIterator = typename std::decay_t<decltype(supernodes)>::InnerIterator;
+  using UpperIterator = typename std::decay_t<decltype(upper)>::InnerIterator;
+
+  n = static_cast<int>(lu.rows());
+  const size_t size = static_cast<size_t>(n);
+  lStart.assign(1, 0);
+  uStart.assign(1, 0);
+  lRows.clear();
+  lValues.clear();
+  uRows.clear();
+  uValues.clear();
+  uDiagonal.assign(size, 0.0f);
+  for (int j = 0; j < n; ++j) {
+    for (SupernodalIterator it(supernodes, j); it; ++it) {
+      const int row = static_cast<int>(it.index());
+      if (row > j) {
+        lRows.push_back(row);
+        lValues.push_back(it.value());
+      } else if (row == j) {
+        uDiagonal[static_cast<size_t>(j)] = it.value();
+      } else {
+        uRows.push_back(row);
+        uValues.push_back(it.value());
+      }
+    }
+    for (UpperIterator it(upper, j); it; ++it) {
+      uRows.push_back(static_cast<int>(it.index()));
+      uValues.push_back(it.value());
+    }
+    lStart.push_back(static_cast<int>(lRows.size()));
+    uStart.push_back(static_cast<int>(uRows.size()));
+  }
+
+  const auto& rows = lu.rowsPermutation().indices();
+  const auto& cols = lu.colsPermutation().indices();
+  rowPerm.assign(rows.data(), rows.data() + rows.size());
+  colPerm.assign(cols.data(), cols.data() + cols.size());
+}
+}  // namespace audio_plugin
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+
+namespace audio_plugin {
+// A fixed ring for one producer thread and one consumer thread. push and pop are wait-free (no locks,
+//   no retries, no allocation), so the audio thread may use either end. Holds up to capacity - 1 items.
+template <typename T, size_t capacity>
+class SpscQueue {
+public:
+  // Producer. False when full
+  bool push(const T& item) {
+    const size_t tail = tailIndex.load(std::memory_order_relaxed);
+    const size_t next = (tail + 1) % capacity;
+    if (next == headIndex.load(std::memory_order_acquire))
+      return false;
+    items[tail] = item;
+    tailIndex.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer. False when empty
+  bool pop(T& item) {
+    const size_t head = headIndex.load(std::memory_order_relaxed);
+    if (head == tailIndex.load(std::memory_order_acquire))
+      return false;
+    item = items[head];
+    headIndex.store((head + 1) % capacity, std::memory_order_release);
+    return true;
+  }
+
+  // Only while neither end is in use
+  void clear() {
+    headIndex.store(0, std::memory_order_relaxed);
+    tailIndex.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  T items[capacity] = {};
+  alignas(64) std::atomic<size_t> headIndex{0};  // next to pop, written by the consumer
+  alignas(64) std::atomic<size_t> tailIndex{0};  // next to push, written by the producer
+};
+}  // namespace audio_plugin
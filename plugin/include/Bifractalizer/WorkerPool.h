@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace audio_plugin {
+// prewarming, a playing instance, the one being edited, audio handed over with a deadline, audio the audio
+//   thread is waiting for (only the realtime workers take it: a normal worker may be niced or preempted)
+enum class WorkPriority { background, normal, high, realtime, realtimeOnly };
+constexpr int numWorkPriorities = 5;
+
+// A bounded pool of worker threads for the whole process (see sharedWorkerPool), so a session full of
+//   instances doesn't start a thread per core for each of them.
+// Queued work runs highest priority first. Work posted from a worker (parallelFor chunks) goes to that
+//   worker's own queue, idle workers steal from there.
+// On top of those a few realtime workers take realtime work only, so it never waits behind a factorization.
+//   Realtime work goes to any free worker, realtimeOnly work waits for a realtime one.
+class WorkerPool {
+public:
+  struct Options {
+    int numThreads = 0;    // 0: one less than the cores, 1..8
+    int niceness = 0;      // Linux: setpriority() of the workers, 0 leaves it alone
+    int fifoPriority = 0;  // Linux: > 0 runs the workers SCHED_FIFO at that priority (if allowed)
+    int realtimeThreads = 1;       // realtime workers, not counted in numThreads
+    int realtimeFifoPriority = 0;  // Linux: as fifoPriority, for the realtime workers
+  };
+
+  // Work its owner submits again and again, e.g. "rebuild for the latest request". Submitting never
+  //   allocates or locks, so the audio thread may do it. A job runs on one thread at a time, and
+  //   submitting it while it's still queued doesn't queue it twice: it runs once, for the latest request.
+  class Job {
+  public:
+    explicit Job(std::function<void()> task) : work(std::move(task)) {}
+    Job(const Job&) = delete;
+    Job& operator=(const Job&) = delete;
+
+  private:
+    friend class WorkerPool;
+    std::function<void()> work;
+    std::atomic<uint64_t> submitted{0};       // submissions so far
+    std::atomic<uint64_t> cancelledUpTo{0};   // submissions cancelled
+    std::atomic<int> priority{static_cast<int>(WorkPriority::normal)};
+    std::atomic<bool> queued{false};          // in the inbox or a queue
+    bool running = false, runAgain = false;   // under the pool's mutex
+    std::shared_ptr<Job> keepAlive;           // one-off jobs: the pool's reference until they ran
+    Job* next = nullptr;                      // in the inbox
+  };
+
+  WorkerPool();
+  explicit WorkerPool(const Options& options);
+  ~WorkerPool();  // queued work is dropped, running work finishes
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  int numThreads() const { return static_cast<int>(threads.size()); }
+  int numRealtimeThreads() const { return static_cast<int>(threads.size()) - firstRealtimeWorker; }
+
+  // Lock- and allocation-free
+  void submit(Job& job, WorkPriority priority);
+  // Lock- and allocation-free: a queued job won't run, a running one sees cancellationRequested()
+  void cancel(Job& job);
+  // Cancels job and waits until it's neither queued nor running (never from job itself),
+  //   its owner may destroy it then
+  void retract(Job& job);
+  // One-off work, the handle may be used to cancel it
+  std::shared_ptr<Job> post(std::function<void()> work, WorkPriority priority);
+
+  // On a worker: the job it runs was cancelled or submitted again since it started, so whatever
+  //   it's doing is out of date. Long jobs check it between their steps
+  static bool cancellationRequested();
+
+  // task(0) .. task(count - 1), spread over the workers. The caller takes chunks too, so it
+  //   finishes even when every worker is busy with something long
+  void parallelFor(int count, const std::function<void(int)>& task);
+
+private:
+  void runWorker(int index, const Options& options);
+  void run(Job* job, uint64_t ticket);
+  void drainInboxLocked();
+  Job* pickLocked(int worker, uint64_t& ticket);
+  void wake(WorkPriority priority);
+
+  // what the calling thread is
+  static thread_local WorkerPool* workerOf;
+  static thread_local int workerIndex;
+  static thread_local Job* runningJob;
+  static thread_local uint64_t runningTicket;  // the submission the running job serves
+
+  std::mutex mutex;
+  std::condition_variable jobFinished;  // for retract
+  std::deque<Job*> queues[numWorkPriorities];
+  std::vector<std::deque<Job*>> local;  // per worker, the owner takes from the back, thieves from the front
+  bool stopping = false;
+  std::atomic<Job*> inbox{nullptr};  // submitted, not yet queued (a stack, only ever emptied as a whole)
+  std::atomic<uint32_t> wakeups{0};  // workers sleep on it
+  std::atomic<uint32_t> realtimeWakeups{0};  // realtime workers sleep on this one
+  int firstRealtimeWorker = 0;  // the realtime workers are the last ones
+  std::vector<std::thread> threads;
+};
+
+// The pool all instances share. BIFRACTALIZER_WORKER_THREADS, BIFRACTALIZER_WORKER_NICE,
+//   BIFRACTALIZER_WORKER_FIFO, BIFRACTALIZER_REALTIME_THREADS and BIFRACTALIZER_REALTIME_FIFO override the
+//   Options defaults
+WorkerPool& sharedWorkerPool();
+}  // namespace audio_plugin
@@ -0,0 +1,206 @@
+#include "Bifractalizer/BifractalizerCore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Bifractalizer/BlockWork.h"
+#include "Bifractalizer/DefractalizerBackends.h"
+#include "Bifractalizer/DefractalizerCache.h"
+#include "Bifractalizer/DefractalizerDiskCache.h"
+
+
+namespace audio_plugin {
+struct PreparedOperator::Engine {
+    std::shared_ptr<const DefractalizerBackend> solverBackend;
+    std::shared_ptr<const DefractalizerProblem> plans;
+    BlockWork::Setup setup;  // everything but the workspace and the scratch
+};
+
+struct PreparedOperator::Workspace::State {
+    int channels = 0;
+    std::vector<float> scratch;               // 3 N
+    std::vector<float> planarIn, planarOut;   // a block of every channel, for interleaved data
+    DefractalizerWorkspace solver;
+    BlockWork work;
+    double worstResidual = 0.0;
+};
+
+PreparedOperator::Workspace::Workspace(std::unique_ptr<State> workspaceState) : state(std::move(workspaceState)) {}
+PreparedOperator::Workspace::Workspace(Workspace&&) noexcept = default;
+PreparedOperator::Workspace& PreparedOperator::Workspace::operator=(Workspace&&) noexcept = default;
+PreparedOperator::Workspace::~Workspace() = default;
+
+int PreparedOperator::Workspace::numChannels() const {
+    return state ? state->channels : 0;
+}
+
+double PreparedOperator::Workspace::residual() const {
+    return state ? state->worstResidual : 0.0;
+}
+
+
+PreparedOperator::PreparedOperator() = default;
+PreparedOperator::~PreparedOperator() = default;
+
+const DefractalizerBackend* PreparedOperator::backend() const {
+    return engine->solverBackend.get();
+}
+
+
+std::shared_ptr<const PreparedOperator> PreparedOperator::prepare(const OperatorSettings& requested,
+                                                                  KernelLevel kernelLevel) {
+    if (requested.N < 2 || requested.beta < 2 || !(requested.alpha >= 0.0f && requested.alpha < 1.0f)
+        || requested.quality < 0 || requested.quality > 2
+        || requested.solver < 0 || requested.solver > static_cast<int>(DefractalizerKind::numKinds))
+        return nullptr;
+
+    // on the plugin's 0.01 steps, what the operators are cached by: the plans, the solver and the series
+    //   evaluators all see the same \alpha
+    OperatorSettings settings = requested;
+    const int alphaStep = static_cast<int>(std::lround(requested.alpha * 100.0f));
+    settings.alpha = static_cast<float>(alphaStep) / 100.0f;
+    if (alphaStep >= 100)
+        return nullptr;
+
+    auto op = std::shared_ptr<PreparedOperator>(new PreparedOperator());
+    op->operatorSettings = settings;
+    auto engine = std::make_unique<Engine>();
+    const DefractalizerKey key{settings.N, settings.beta, alphaStep, settings.quality, settings.solver};
+
+    // the processor's coefficients (see updateCoeffs)
+    const float tolerance = qualityTolerance(settings.quality);
+    BlockWork::Setup& setup = engine->setup;
+    setup.N = settings.N;
+    setup.beta = settings.beta;
+    setup.alpha = settings.alpha;
+    setup.numTerms = seriesTermCount(settings.beta, settings.alpha, tolerance);
+    setup.closedFormSteps = closedFormRefinements(settings.alpha, setup.numTerms, std::max(tolerance, 1e-7f));
+    setup.kernelLevel = kernelLevel;
+
+    if (!settings.defractalize) {
+        // only the plans: an operator of these settings that's around already has them
+        if (auto cached = sharedDefractalizerCache().find(key))
+            engine->plans = std::shared_ptr<const DefractalizerProblem>(cached, &cached->problem());
+        else
+            engine->plans = makeDefractalizerProblem(key, settings.alpha, kernelLevel);
+        setup.plans = engine->plans.get();
+        if (settings.infiniteSeries)
+            setup.engine = BlockWork::Engine::fractalizeInfinite;
+        else if (chooseFractalEngine(engine->plans->plan, engine->plans->numTerms) == FractalEngine::gather)
+            setup.engine = BlockWork::Engine::fractalizeGather;
+        else
+            setup.engine = BlockWork::Engine::fractalizeDoubling;
+    } else if (settings.infiniteSeries) {
+        setup.engine = BlockWork::Engine::defractalizeInfinite;
+    } else {
+        // the plugin's Auto accuracy target and, like the plugin, timed on one thread (process() solves there),
+        //   so Auto picks what the plugin would
+        engine->solverBackend = acquireDefractalizerOperator(key, settings.alpha, kernelLevel, {}, 1e-3f);
+        if (!engine->solverBackend)
+            return nullptr;
+        engine->plans = std::shared_ptr<const DefractalizerProblem>(engine->solverBackend,
+                                                                    &engine->solverBackend->problem());
+        setup.engine = BlockWork::Engine::defractalizeBackend;
+        setup.plans = engine->plans.get();
+        setup.backend = engine->solverBackend.get();
+        setup.refinementSteps = std::clamp(settings.refinementSteps, 0, 2);
+        // like a bounce: every block on its own, as many iterations as the iterative solver takes (its cap)
+        setup.coldStart = true;
+    }
+    op->engine = std::move(engine);
+    return op;
+}
+
+
+PreparedOperator::Workspace PreparedOperator::makeWorkspace(int numChannels) const {
+    auto state = std::make_unique<Workspace::State>();
+    state->channels = std::max(numChannels, 0);
+    const size_t N = static_cast<size_t>(operatorSettings.N);
+    state->scratch.assign(3 * N, 0.0f);
+    state->planarIn.assign(static_cast<size_t>(state->channels) * N, 0.0f);
+    state->planarOut.assign(static_cast<size_t>(state->channels) * N, 0.0f);
+    if (engine->solverBackend)
+        engine->solverBackend->prepareWorkspace(state->solver, state->channels);
+    return Workspace(std::move(state));
+}
+
+
+int PreparedOperator::process(std::span<const float> in, std::span<float> out, SampleLayout layout,
+                              Workspace& workspace) const {
+    if (!workspace.state)
+        return 0;  // moved from
+    workspace.state->worstResidual = 0.0;
+    const int channels = workspace.state->channels;
+    if (channels <= 0 || in.size() != out.size() || in.size() % static_cast<size_t>(channels) != 0)
+        return 0;
+    const size_t numFrames = in.size() / static_cast<size_t>(channels);
+    if (numFrames > static_cast<size_t>(std::numeric_limits<int>::max()))
+        return 0;
+    workspace.state->worstResidual = processBlocks(in.data(), out.data(), static_cast<int>(numFrames), layout,
+                                                   *workspace.state);
+    return static_cast<int>(numFrames) / operatorSettings.N * operatorSettings.N;
+}
+
+
+int PreparedOperator::processBatch(std::span<const std::span<const float>> ins, std::span<const std::span<float>> outs,
+                                   SampleLayout layout, Workspace& workspace) const {
+    double worst = 0.0;
+    int frames = 0;
+    for (size_t i = 0; i < std::min(ins.size(), outs.size()); ++i) {
+        frames += process(ins[i], outs[i], layout, workspace);
+        const double residual = workspace.residual();
+        worst = std::isnan(worst) || std::isnan(residual) ? std::numeric_limits<double>::quiet_NaN()
+                                                          : std::max(worst, residual);
+    }
+    if (workspace.state)
+        workspace.state->worstResidual = worst;
+    return frames;
+}
+
+
+double PreparedOperator::processBlocks(const float* in, float* out, int numFrames, SampleLayout layout,
+                                       Workspace::State& workspace) const {
+    const int N = operatorSettings.N;
+    const int channels = workspace.channels;
+    const bool interleaved = layout == SampleLayout::interleaved;
+    BlockWork::Setup blockSetup = engine->setup;
+    blockSetup.scratch = workspace.scratch.data();
+    blockSetup.workspace = &workspace.solver;
+
+    double worst = 0.0;
+    for (int frame = 0; frame + N <= numFrames; frame += N) {
+        if (interleaved)
+            for (int i = 0; i < N; ++i)
+                for (int ch = 0; ch < channels; ++ch)
+                    workspace.planarIn[static_cast<size_t>(ch * N + i)] = in[static_cast<size_t>((frame + i) * channels + ch)];
+
+        // the engines take up to BlockWork::maxChannels channels at a time
+        for (int first = 0; first < channels; first += BlockWork::maxChannels) {
+            const int count = std::min(BlockWork::maxChannels, channels - first);
+            const float* blockIn[BlockWork::maxChannels] = {};
+            float* blockOut[BlockWork::maxChannels] = {};
+            for (int c = 0; c < count; ++c) {
+                const size_t at = interleaved ? static_cast<size_t>((first + c) * N)
+                                              : static_cast<size_t>(first + c) * static_cast<size_t>(numFrames)
+                                                    + static_cast<size_t>(frame);
+                blockIn[c] = interleaved ? workspace.planarIn.data() + at : in + at;
+                blockOut[c] = interleaved ? workspace.planarOut.data() + at : out + at;
+            }
+            blockSetup.firstChannel = first;
+            workspace.work.start(blockSetup, blockIn, blockOut, count);
+            workspace.work.runUntil(workspace.work.units());
+            const double residual = workspace.work.residual();
+            worst = std::isnan(worst) || std::isnan(residual) ? std::numeric_limits<double>::quiet_NaN()
+                                                              : std::max(worst, residual);
+        }
+
+        if (interleaved)
+            for (int i = 0; i < N; ++i)
+                for (int ch = 0; ch < channels; ++ch)
+                    out[static_cast<size_t>((frame + i) * channels + ch)] = workspace.planarOut[static_cast<size_t>(ch * N + i)];
+    }
+    return worst;
+}
+}  // namespace audio_plugin
@@ -0,0 +1,201 @@
+#include "Bifractalizer/BlockDefractalizer.h"
+
+#include <algorithm>
+
+
+namespace audio_plugin {
+bool BlockDefractalizer::prepare(const GatherPlan& plan, const OrbitPlan& orbits, int maxChunks) {
+    N = plan.N;
+    components.clear();
+    chunkStart.assign(1, 0);
+    footprint = 0;
+    totalCost = 0.0;
+    if (N <= 0 || orbits.N != N)
+        return false;
+
+    // component of every index: its cycle, transient indices inherit it from M i
+    const size_t n = static_cast<size_t>(N);
+    const uint64_t n64 = static_cast<uint64_t>(N);
+    const uint64_t b = static_cast<uint64_t>(orbits.beta) % n64;
+    const size_t numCycles = orbits.cycleStart.size() - 1;
+    std::vector<uint32_t> componentOf(n);
+    for (size_t c = 0; c < numCycles; ++c)
+        for (uint32_t k = orbits.cycleStart[c]; k < orbits.cycleStart[c + 1]; ++k)
+            componentOf[orbits.cycleNodes[k]] = static_cast<uint32_t>(c);
+    for (const uint32_t i : orbits.transient)
+        componentOf[i] = componentOf[(i * b) % n64];
+
+    components.resize(numCycles);
+    for (uint32_t i = 0; i < n; ++i)
+        components[componentOf[i]].nodes.push_back(i);
+
+    std::vector<int> local(n);
+    std::vector<Eigen::Triplet<float>> triplets;
+    for (auto& comp : components) {
+        const int size = static_cast<int>(comp.nodes.size());
+        for (int k = 0; k < size; ++k)
+            local[comp.nodes[static_cast<size_t>(k)]] = k;
+
+        if (size <= denseLimit) {
+            Eigen::MatrixXf block = Eigen::MatrixXf::Zero(size, size);
+            for (int k = 0; k < size; ++k) {
+                const size_t row = comp.nodes[static_cast<size_t>(k)];
+                for (uint32_t e = plan.rowStart[row]; e < plan.rowStart[row + 1]; ++e)
+                    block(k, local[plan.index(e)]) += plan.weights[e];
+            }
+            const Eigen::PartialPivLU<Eigen::MatrixXf> dense(block);
+            comp.denseLU.assign(dense.matrixLU().data(), dense.matrixLU().data() + dense.matrixLU().size());
+            const auto& permutation = dense.permutationP().indices();
+            comp.densePermutation.assign(permutation.data(), permutation.data() + permutation.size());
+        } else {
+            triplets.clear();
+            for (int k = 0; k < size; ++k) {
+                const size_t row = comp.nodes[static_cast<size_t>(k)];
+                for (uint32_t e = plan.rowStart[row]; e < plan.rowStart[row + 1]; ++e)
+                    triplets.emplace_back(k, local[plan.index(e)], plan.weights[e]);
+            }
+            Eigen::SparseMatrix<float> block(size, size);
+            block.setFromTriplets(triplets.begin(), triplets.end());
+            block.makeCompressed();
+            Eigen::SparseLU<Eigen::SparseMatrix<float>> lu;
+            lu.analyzePattern(block);
+            lu.factorize(block);
+            if (lu.info() != Eigen::Success)
+                return false;
+            comp.sparse.extract(lu);
+        }
+    }
+
+    finishPrepare(maxChunks);
+    return true;
+}
+
+void BlockDefractalizer::finishPrepare(int maxChunks) {
+    chunkStart.assign(1, 0);
+    footprint = 0;
+    totalCost = 0.0;
+    for (auto& comp : components) {
+        const size_t size = comp.nodes.size();
+        if (comp.sparse.n > 0) {
+            comp.cost = static_cast<double>(comp.sparse.nonZeros());
+            footprint += comp.sparse.memoryFootprint();
+        } else {
+            comp.cost = static_cast<double>(size) * static_cast<double>(size);
+            footprint += sizeof(float) * comp.denseLU.size() + sizeof(int) * comp.densePermutation.size();
+        }
+        footprint += sizeof(uint32_t) * size;
+    }
+
+    // biggest components first so the chunks come out balanced
+    std::sort(components.begin(), components.end(),
+              [](const Component& a, const Component& c) { return a.cost > c.cost; });
+    size_t offset = 0;
+    for (auto& comp : components) {
+        totalCost += comp.cost;
+        comp.scratchOffset = offset;
+        offset += comp.nodes.size();
+    }
+    const int chunks = std::clamp(maxChunks, 1, std::max(1, numComponents()));
+    double acc = 0.0;
+    for (int c = 0; c < numComponents(); ++c) {
+        acc += components[static_cast<size_t>(c)].cost;
+        const int filled = static_cast<int>(chunkStart.size());
+        if (filled < chunks && acc >= totalCost * filled / chunks && c + 1 < numComponents())
+            chunkStart.push_back(c + 1);
+    }
+    chunkStart.push_back(numComponents());
+}
+
+std::vector<uint8_t> BlockDefractalizer::serialize() const {
+    std::vector<uint8_t> data;
+    putArray(data, std::vector<int>{N, numComponents()});
+    for (const auto& comp : components) {
+        putArray(data, comp.nodes);
+        putArray(data, comp.denseLU);
+        putArray(data, comp.densePermutation);
+        putArray(data, comp.sparse.n > 0 ? comp.sparse.serialize() : std::vector<uint8_t>());
+    }
+    return data;
+}
+
+bool BlockDefractalizer::deserialize(const uint8_t* data, size_t size, int n, int maxChunks) {
+    const uint8_t* end = data + size;
+    N = n;
+    components.clear();
+    std::vector<int> counts;
+    bool valid = n > 0 && getArray(data, end, counts) && counts.size() == 2 && counts[0] == n &&
+                 counts[1] > 0 && counts[1] <= n;
+    if (valid)
+        components.resize(static_cast<size_t>(counts[1]));
+
+    // every index in exactly one component, every component factorized the way prepare() does it
+    std::vector<uint8_t> seen(valid ? static_cast<size_t>(n) : 0, 0), sparseState;
+    size_t covered = 0;
+    for (auto& comp : components) {
+        valid = getArray(data, end, comp.nodes) && getArray(data, end, comp.denseLU) &&
+                getArray(data, end, comp.densePermutation) && getArray(data, end, sparseState);
+        const size_t count = comp.nodes.size();
+        for (size_t k = 0; valid && k < count; ++k) {
+            const uint32_t node = comp.nodes[k];
+            valid = node < static_cast<uint32_t>(n) && !seen[node];
+            if (valid)
+                seen[node] = 1;
+        }
+        covered += count;
+        if (valid && count <= static_cast<size_t>(denseLimit)) {
+            valid = count > 0 && sparseState.empty() && comp.denseLU.size() == count * count &&
+                    comp.densePermutation.size() == count;
+            for (const int p : comp.densePermutation)
+                valid = valid && p >= 0 && static_cast<size_t>(p) < count;
+        } else if (valid) {
+            valid = comp.denseLU.empty() && comp.densePermutation.empty() &&
+                    comp.sparse.deserialize(sparseState.data(), sparseState.size()) &&
+                    static_cast<size_t>(comp.sparse.n) == count;
+        }
+        if (!valid)
+            break;
+    }
+    if (!valid || data != end || covered != static_cast<size_t>(n)) {
+        components.clear();
+        chunkStart.assign(1, 0);
+        footprint = 0;
+        totalCost = 0.0;
+        return false;
+    }
+    finishPrepare(maxChunks);
+    return true;
+}
+
+void BlockDefractalizer::solveComponents(const float* f, float* g, float* scratch, int begin, int end) const {
+    for (int c = begin; c < end; ++c) {
+        const Component& comp = components[static_cast<size_t>(c)];
+        const Eigen::Index size = static_cast<Eigen::Index>(comp.nodes.size());
+        Eigen::Map<Eigen::VectorXf> rhs(scratch + comp.scratchOffset, size);
+        Eigen::Map<Eigen::VectorXf> x(scratch + N + comp.scratchOffset, size);
+        for (Eigen::Index k = 0; k < size; ++k)
+            rhs(k) = f[comp.nodes[static_cast<size_t>(k)]];
+        if (comp.sparse.n > 0) {
+            comp.sparse.solve(rhs.data(), rhs.data(), x.data());
+            x = rhs;
+        } else {
+            // P A = L U:  x = U^{-1} L^{-1} P rhs
+            for (Eigen::Index k = 0; k < size; ++k)
+                x(comp.densePermutation[static_cast<size_t>(k)]) = rhs(k);
+            const Eigen::Map<const Eigen::MatrixXf> LU(comp.denseLU.data(), size, size);
+            LU.triangularView<Eigen::UnitLower>().solveInPlace(x);
+            LU.triangularView<Eigen::Upper>().solveInPlace(x);
+        }
+        for (Eigen::Index k = 0; k < size; ++k)
+            g[comp.nodes[static_cast<size_t>(k)]] = x(k);
+    }
+}
+
+void BlockDefractalizer::solveChunk(const float* f, float* g, float* scratch, int chunk) const {
+    solveComponents(f, g, scratch, chunkStart[static_cast<size_t>(chunk)],
+                    chunkStart[static_cast<size_t>(chunk) + 1]);
+}
+
+void BlockDefractalizer::solve(const float* f, float* g, float* scratch) const {
+    solveComponents(f, g, scratch, 0, numComponents());
+}
+}  // namespace audio_plugin
@@ -0,0 +1,112 @@
+#include "Bifractalizer/BlockWork.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+namespace audio_plugin {
+void BlockWork::start(const Setup& setup, const float* const* input, float* const* output, int channels) {
+    work = setup;
+    numChannels = std::min(channels, maxChannels);
+    std::copy(input, input + numChannels, in);
+    std::copy(output, output + numChannels, out);
+
+    const int N = work.N;
+    int lanes = numChannels;
+    switch (work.engine) {
+        case Engine::copy:
+        case Engine::defractalizeInfinite:
+            unitsPerLane = N;
+            break;
+        case Engine::fractalizeInfinite:
+            unitsPerLane = fractalizeInfiniteUnits(work.plans->orbits);
+            break;
+        case Engine::fractalizeDoubling:
+            unitsPerLane = fractalizeDoublingUnits(N, work.numTerms);
+            break;
+        case Engine::fractalizeGather:
+            unitsPerLane = N;
+            lanes = (numChannels + 1) / 2;  // the kernels do channel pairs
+            break;
+        case Engine::defractalizeClosedForm:
+            unitsPerLane = defractalizeClosedFormUnits(N, work.closedFormSteps);
+            break;
+        case Engine::defractalizeBackend:
+            unitsPerLane = 1;
+            break;
+    }
+    totalUnits = unitsPerLane * lanes;
+    done = 0;
+    worstResidual = 0.0;
+}
+
+
+int BlockWork::runUntil(int unit) {
+    int target = std::min(unit, totalUnits);
+    if (work.engine == Engine::fractalizeGather && target % unitsPerLane != 0) {
+        // SIMD kernels write whole slices
+        constexpr int W = SlicedGatherPlan::sliceWidth;
+        const int laneStart = target - target % unitsPerLane;
+        target = laneStart + std::min((target - laneStart + W - 1) / W * W, unitsPerLane);
+    }
+
+    const int before = done;
+    while (done < target) {
+        const int lane = done / unitsPerLane;
+        const int laneStart = lane * unitsPerLane;
+        const int end = std::min(target - laneStart, unitsPerLane);
+        runPiece(lane, done - laneStart, end);
+        done = laneStart + end;
+    }
+    return done - before;
+}
+
+
+void BlockWork::runPiece(int lane, int begin, int end) {
+    const int N = work.N;
+    const float* g = in[lane];
+    float* f = out[lane];
+    switch (work.engine) {
+        case Engine::copy:
+            std::memcpy(f + begin, g + begin, sizeof(float) * static_cast<size_t>(end - begin));
+            break;
+        case Engine::fractalizeInfinite:
+            fractalizeInfinitePiece(work.plans->orbits, work.alpha, g, f, carry, begin, end);
+            break;
+        case Engine::fractalizeDoubling:
+            fractalizeDoublingPiece(g, f, work.scratch, N, work.beta, work.alpha, work.numTerms, begin, end);
+            break;
+        case Engine::fractalizeGather:
+            applyFractalKernelRows(work.plans->plan, work.plans->sliced, in + 2 * lane, out + 2 * lane,
+                                   std::min(2, numChannels - 2 * lane), work.kernelLevel, begin, end);
+            break;
+        case Engine::defractalizeInfinite:
+            defractalizeInfinitePiece(N, work.beta, work.alpha, g, f, begin, end);
+            break;
+        case Engine::defractalizeClosedForm:
+            defractalizeClosedFormPiece(g, f, work.scratch, N, work.beta, work.alpha, work.numTerms,
+                                        work.closedFormSteps, begin, end);
+            break;
+        case Engine::defractalizeBackend: {
+            // the cap from the iteration cost measured so far, by the thread that does the iterations
+            if (work.iterationBudget > 0.0)
+                work.workspace->maxIterations = work.workspace->iterative.iterationsForBudget(work.iterationBudget, 2, 64);
+            if (work.coldStart)
+                work.workspace->iterative.forget(work.firstChannel + lane);
+            const double r = solveRefined(*work.backend, g, f, work.firstChannel + lane, *work.workspace,
+                                          work.refinementSteps);
+            if (std::isfinite(r)) {
+                worstResidual = std::max(worstResidual, r);
+            } else {
+                // a blown-up solve (never expected, A is well conditioned for \alpha < 1) gets the closed form
+                defractalizeClosedForm(g, f, work.scratch, N, work.beta, work.alpha, work.numTerms,
+                                       work.closedFormSteps);
+                worstResidual = std::numeric_limits<double>::quiet_NaN();
+            }
+            break;
+        }
+    }
+}
+}  // namespace audio_plugin
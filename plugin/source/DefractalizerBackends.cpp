@@ -0,0 +1,441 @@
+#include "Bifractalizer/DefractalizerBackends.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include <Eigen/Dense>
+#include <Eigen/SparseLU>
+
+#include "Bifractalizer/BlockDefractalizer.h"
+#include "Bifractalizer/SparseLUFactors.h"
+#include "Bifractalizer/WorkerPool.h"
+
+
+namespace audio_plugin {
+float qualityTolerance(int quality) {
+    const float tolerances[] = {1e-3f, 1e-7f, 0.0f};
+    return tolerances[std::clamp(quality, 0, 2)];
+}
+
+
+std::shared_ptr<const DefractalizerProblem> makeDefractalizerProblem(int N, int beta, float alpha, int numTerms,
+                                                                     float tolerance, KernelLevel kernelLevel,
+                                                                     int maxThreads) {
+    auto problem = std::make_shared<DefractalizerProblem>();
+    problem->N = N;
+    problem->beta = beta;
+    problem->alpha = alpha;
+    problem->numTerms = numTerms;
+    problem->tolerance = tolerance;
+    problem->closedFormSteps = closedFormRefinements(alpha, numTerms, tolerance);
+    problem->maxThreads = maxThreads;
+    problem->kernelLevel = kernelLevel;
+
+    std::vector<float> termWeights(static_cast<size_t>(std::max(numTerms, 1)));
+    termWeights[0] = 1.0f;
+    for (size_t n = 1; n < termWeights.size(); ++n)
+        termWeights[n] = termWeights[n - 1] * alpha;
+    buildGatherPlan(problem->plan, N, beta, termWeights);
+    buildSlicedGatherPlan(problem->sliced, problem->plan);
+    buildOrbitPlan(problem->orbits, N, beta);
+    return problem;
+}
+
+
+size_t DefractalizerProblem::memoryFootprint() const {
+    return sizeof(uint32_t) * (plan.rowStart.size() + plan.indices32.size() + sliced.sliceStart.size()
+                               + orbits.cycleNodes.size() + orbits.cycleStart.size() + orbits.transient.size())
+         + sizeof(uint16_t) * (plan.indices16.size() + sliced.indices.size())
+         + sizeof(float) * (plan.weights.size() + sliced.weights.size());
+}
+
+
+const char* defractalizerKindName(DefractalizerKind kind) {
+    switch (kind) {
+        case DefractalizerKind::closedForm:      return "Closed form";
+        case DefractalizerKind::sparseLU:        return "Sparse LU";
+        case DefractalizerKind::blockLU:         return "Block LU";
+        case DefractalizerKind::iterative:       return "Iterative";
+        case DefractalizerKind::sparseLUAMD:     return "Sparse LU (AMD)";
+        case DefractalizerKind::sparseLUNatural: return "Sparse LU (natural)";
+        case DefractalizerKind::denseLU:         return "Dense LU";
+        case DefractalizerKind::numKinds:        break;
+    }
+    return "?";
+}
+
+
+void findDefractalizerMatrix(Eigen::SparseMatrix<float>& A, const GatherPlan& plan) {
+    const int N = plan.N;
+    std::vector<Eigen::Triplet<float>> triplets;
+    triplets.reserve(plan.nonZeros());
+    for (int i = 0; i < N; ++i) {
+        const size_t row = static_cast<size_t>(i);
+        for (uint32_t k = plan.rowStart[row]; k < plan.rowStart[row + 1]; ++k)
+            triplets.emplace_back(i, static_cast<int>(plan.index(k)), plan.weights[k]);
+    }
+
+    A.resize(N, N);
+    A.setFromTriplets(triplets.begin(), triplets.end());
+    A.makeCompressed();
+}
+
+
+void DefractalizerBackend::prepareWorkspace(DefractalizerWorkspace& workspace, int numChannels) const {
+    (void)numChannels;
+    const size_t n = static_cast<size_t>(problemPtr->N);
+    workspace.scratch.resize(2 * n);
+    workspace.residual.resize(n);
+    workspace.correction.resize(n);
+}
+
+
+// r = f - A g with every row summed in double, returns ||r||^2
+static double residualInDouble(const GatherPlan& plan, const float* f, const float* g, float* r) {
+    double rNorm2 = 0.0;
+    for (int i = 0; i < plan.N; ++i) {
+        const size_t row = static_cast<size_t>(i);
+        double acc = static_cast<double>(f[i]);
+        for (uint32_t k = plan.rowStart[row]; k < plan.rowStart[row + 1]; ++k)
+            acc -= static_cast<double>(plan.weights[k]) * static_cast<double>(g[plan.index(k)]);
+        r[i] = static_cast<float>(acc);
+        rNorm2 += acc * acc;
+    }
+    return rNorm2;
+}
+
+
+double solveRefined(const DefractalizerBackend& backend, const float* f, float* g, int channel,
+                    DefractalizerWorkspace& workspace, int refinementSteps) {
+    const DefractalizerProblem& p = backend.problem();
+    backend.solve(f, g, channel, workspace);
+    if (!backend.refinable())
+        refinementSteps = 0;
+
+    float* r = workspace.residual.data();
+    float* d = workspace.correction.data();
+    double rNorm2 = residualInDouble(p.plan, f, g, r);
+    for (int step = 0; step < refinementSteps; ++step) {
+        backend.solve(r, d, channel, workspace);
+        for (int i = 0; i < p.N; ++i)
+            g[i] += d[i];
+        rNorm2 = residualInDouble(p.plan, f, g, r);
+    }
+
+    double fNorm2 = 0.0;
+    for (int i = 0; i < p.N; ++i)
+        fNorm2 += static_cast<double>(f[i]) * static_cast<double>(f[i]);
+    return fNorm2 > 0.0 ? std::sqrt(rNorm2 / fNorm2) : 0.0;
+}
+
+
+namespace {
+class ClosedFormBackend final : public DefractalizerBackend {
+public:
+    DefractalizerKind kind() const override { return DefractalizerKind::closedForm; }
+    bool cheapToPrepare() const override { return true; }
+
+    bool prepare(std::shared_ptr<const DefractalizerProblem> problem) override {
+        problemPtr = std::move(problem);
+        return true;
+    }
+
+    void solve(const float* f, float* g, int, DefractalizerWorkspace& workspace) const override {
+        const DefractalizerProblem& p = *problemPtr;
+        defractalizeClosedForm(f, g, workspace.scratch.data(), p.N, p.beta, p.alpha, p.numTerms, p.closedFormSteps);
+    }
+
+    size_t memoryFootprint() const override { return 0; }
+    double estimatedCost() const override {
+        // (I - \alpha P) and every refinement step are one gather + one FMA per sample
+        return 2.0 * problemPtr->N * (problemPtr->closedFormSteps + 2);
+    }
+};
+
+
+class IterativeBackend final : public DefractalizerBackend {
+public:
+    DefractalizerKind kind() const override { return DefractalizerKind::iterative; }
+    bool cheapToPrepare() const override { return true; }
+    bool refinable() const override { return false; }  // it already iterates to p.tolerance
+    bool keepsStateBetweenSolves() const override { return true; }  // the warm starts
+
+    bool prepare(std::shared_ptr<const DefractalizerProblem> problem) override {
+        problemPtr = std::move(problem);
+        return true;
+    }
+
+    void prepareWorkspace(DefractalizerWorkspace& workspace, int numChannels) const override {
+        DefractalizerBackend::prepareWorkspace(workspace, numChannels);
+        workspace.iterative.prepare(problemPtr->N, numChannels);
+    }
+
+    void solve(const float* f, float* g, int channel, DefractalizerWorkspace& workspace) const override {
+        const DefractalizerProblem& p = *problemPtr;
+        workspace.iterative.solve(p.plan, p.sliced, p.kernelLevel, p.beta, p.alpha, f, g, channel,
+                                  p.tolerance, workspace.maxIterations);
+    }
+
+    size_t memoryFootprint() const override { return 0; }
+    double estimatedCost() const override {
+        // A x + the preconditioner per iteration, about as many iterations as the closed form has steps
+        const DefractalizerProblem& p = *problemPtr;
+        return 2.0 * static_cast<double>(p.plan.nonZeros() + 2 * static_cast<size_t>(p.N)) * (p.closedFormSteps + 1);
+    }
+};
+
+
+template <typename Ordering, DefractalizerKind Kind>
+class SparseLUBackend final : public DefractalizerBackend {
+public:
+    DefractalizerKind kind() const override { return Kind; }
+
+    bool prepare(std::shared_ptr<const DefractalizerProblem> problem) override {
+        problemPtr = std::move(problem);
+        Eigen::SparseMatrix<float> A;
+        findDefractalizerMatrix(A, problemPtr->plan);
+        Eigen::SparseLU<Eigen::SparseMatrix<float>, Ordering> lu;
+        lu.analyzePattern(A);
+        lu.factorize(A);
+        if (lu.info() != Eigen::Success)
+            return false;
+        factors.extract(lu);
+        return true;
+    }
+
+    std::vector<uint8_t> saveState() const override { return factors.serialize(); }
+
+    bool prepareFromState(std::shared_ptr<const DefractalizerProblem> problem, const uint8_t* state, size_t size) override {
+        if (!factors.deserialize(state, size) || factors.n != problem->N)
+            return prepare(std::move(problem));
+        problemPtr = std::move(problem);
+        return true;
+    }
+
+    void solve(const float* f, float* g, int, DefractalizerWorkspace& workspace) const override {
+        factors.solve(f, g, workspace.scratch.data());
+    }
+
+    size_t memoryFootprint() const override { return factors.memoryFootprint(); }
+    double estimatedCost() const override { return 2.0 * static_cast<double>(factors.nonZeros()); }
+
+private:
+    SparseLUFactors factors;
+};
+
+
+class BlockLUBackend final : public DefractalizerBackend {
+public:
+    DefractalizerKind kind() const override { return DefractalizerKind::blockLU; }
+
+    bool prepare(std::shared_ptr<const DefractalizerProblem> problem) override {
+        problemPtr = std::move(problem);
+        return blocks.prepare(problemPtr->plan, problemPtr->orbits, problemPtr->maxThreads);
+    }
+
+    std::vector<uint8_t> saveState() const override { return blocks.serialize(); }
+
+    bool prepareFromState(std::shared_ptr<const DefractalizerProblem> problem, const uint8_t* state, size_t size) override {
+        // the chunks are split again for the threads of this machine
+        if (!blocks.deserialize(state, size, problem->N, problem->maxThreads))
+            return prepare(std::move(problem));
+        problemPtr = std::move(problem);
+        return true;
+    }
+
+    void solve(const float* f, float* g, int, DefractalizerWorkspace& workspace) const override {
+        float* scratch = workspace.scratch.data();
+        if (workspace.parallelFor && blocks.numChunks() > 1) {
+            // the task captures one pointer, small enough for std::function not to allocate (the audio thread)
+            const struct {
+                const BlockDefractalizer& blocks;
+                const float* f;
+                float* g;
+                float* scratch;
+            } solve{blocks, f, g, scratch};
+            workspace.parallelFor(blocks.numChunks(), [&solve](int chunk) {
+                solve.blocks.solveChunk(solve.f, solve.g, solve.scratch, chunk);
+            });
+        } else {
+            blocks.solve(f, g, scratch);
+        }
+    }
+
+    size_t memoryFootprint() const override { return blocks.memoryFootprint(); }
+    double estimatedCost() const override { return 2.0 * blocks.cost(); }
+
+private:
+    BlockDefractalizer blocks;
+};
+
+
+// The factorization is kept as plain arrays (LU packed in one matrix + row permutation), so it can be
+//   stored and loaded as is
+class DenseLUBackend final : public DefractalizerBackend {
+public:
+    DefractalizerKind kind() const override { return DefractalizerKind::denseLU; }
+
+    bool prepare(std::shared_ptr<const DefractalizerProblem> problem) override {
+        problemPtr = std::move(problem);
+        const GatherPlan& plan = problemPtr->plan;
+        Eigen::MatrixXf A = Eigen::MatrixXf::Zero(plan.N, plan.N);
+        for (int i = 0; i < plan.N; ++i) {
+            const size_t row = static_cast<size_t>(i);
+            for (uint32_t k = plan.rowStart[row]; k < plan.rowStart[row + 1]; ++k)
+                A(i, static_cast<Eigen::Index>(plan.index(k))) += plan.weights[k];
+        }
+        const Eigen::PartialPivLU<Eigen::MatrixXf> factorization(A);
+        const auto& packed = factorization.matrixLU();
+        lu.assign(packed.data(), packed.data() + packed.size());
+        const auto& indices = factorization.permutationP().indices();
+        permutation.assign(indices.data(), indices.data() + indices.size());
+        return true;  // A = I + strictly smaller terms, never singular for \alpha < 1
+    }
+
+    std::vector<uint8_t> saveState() const override {
+        std::vector<uint8_t> state(sizeof(float) * lu.size() + sizeof(int) * permutation.size());
+        std::memcpy(state.data(), lu.data(), sizeof(float) * lu.size());
+        std::memcpy(state.data() + sizeof(float) * lu.size(), permutation.data(), sizeof(int) * permutation.size());
+        return state;
+    }
+
+    bool prepareFromState(std::shared_ptr<const DefractalizerProblem> problem, const uint8_t* state, size_t size) override {
+        const size_t n = static_cast<size_t>(problem->N);
+        if (size != sizeof(float) * n * n + sizeof(int) * n)
+            return prepare(std::move(problem));
+        problemPtr = std::move(problem);
+        lu.resize(n * n);
+        permutation.resize(n);
+        std::memcpy(lu.data(), state, sizeof(float) * lu.size());
+        std::memcpy(permutation.data(), state + sizeof(float) * lu.size(), sizeof(int) * n);
+        for (const int p : permutation)
+            if (p < 0 || static_cast<size_t>(p) >= n)
+                return false;
+        return true;
+    }
+
+    void solve(const float* f, float* g, int, DefractalizerWorkspace&) const override {
+        // P A = L U:  g = U^{-1} L^{-1} P f
+        const Eigen::Index N = problemPtr->N;
+        for (size_t i = 0; i < permutation.size(); ++i)
+            g[static_cast<size_t>(permutation[i])] = f[i];
+        const Eigen::Map<const Eigen::MatrixXf> LU(lu.data(), N, N);
+        Eigen::Map<Eigen::VectorXf> x(g, N);
+        LU.triangularView<Eigen::UnitLower>().solveInPlace(x);
+        LU.triangularView<Eigen::Upper>().solveInPlace(x);
+    }
+
+    size_t memoryFootprint() const override {
+        return sizeof(float) * lu.size() + sizeof(int) * permutation.size();
+    }
+    double estimatedCost() const override { return 2.0 * problemPtr->N * static_cast<double>(problemPtr->N); }
+
+private:
+    std::vector<float> lu;  // column-major N x N, unit L below the diagonal, U on and above
+    std::vector<int> permutation;
+};
+}  // namespace
+
+
+std::unique_ptr<DefractalizerBackend> makeDefractalizerBackend(DefractalizerKind kind) {
+    switch (kind) {
+        case DefractalizerKind::closedForm:
+            return std::make_unique<ClosedFormBackend>();
+        case DefractalizerKind::sparseLU:
+            return std::make_unique<SparseLUBackend<Eigen::COLAMDOrdering<int>, DefractalizerKind::sparseLU>>();
+        case DefractalizerKind::blockLU:
+            return std::make_unique<BlockLUBackend>();
+        case DefractalizerKind::iterative:
+            return std::make_unique<IterativeBackend>();
+        case DefractalizerKind::sparseLUAMD:
+            return std::make_unique<SparseLUBackend<Eigen::AMDOrdering<int>, DefractalizerKind::sparseLUAMD>>();
+        case DefractalizerKind::sparseLUNatural:
+            return std::make_unique<SparseLUBackend<Eigen::NaturalOrdering<int>, DefractalizerKind::sparseLUNatural>>();
+        case DefractalizerKind::denseLU:
+            return std::make_unique<DenseLUBackend>();
+        case DefractalizerKind::numKinds:
+            break;
+    }
+    return nullptr;
+}
+
+
+std::unique_ptr<DefractalizerBackend> selectDefractalizerBackend(
+    std::shared_ptr<const DefractalizerProblem> problem, float accuracyTarget,
+    const ParallelFor& parallelFor, std::vector<BackendTiming>* report) {
+    constexpr int numSignals = 3;
+    const int N = problem->N;
+    const size_t n = static_cast<size_t>(N);
+
+    // fixed seed: the same problem always sees the same signals
+    std::mt19937 gen(12345);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<std::vector<float>> g(numSignals, std::vector<float>(n)), f(numSignals, std::vector<float>(n));
+    std::vector<double> gNorm2(numSignals, 0.0);
+    for (int s = 0; s < numSignals; ++s) {
+        const size_t si = static_cast<size_t>(s);
+        for (auto& sample : g[si]) {
+            sample = dist(gen);
+            gNorm2[si] += static_cast<double>(sample) * static_cast<double>(sample);
+        }
+        applyGatherPlan(problem->plan, g[si].data(), f[si].data());
+    }
+    std::vector<float> back(n);
+
+    if (report != nullptr)
+        report->clear();
+    std::unique_ptr<DefractalizerBackend> best, fallback;
+    double bestSeconds = 0.0;
+    for (int k = 0; k < static_cast<int>(DefractalizerKind::numKinds); ++k) {
+        const auto kind = static_cast<DefractalizerKind>(k);
+        if (kind == DefractalizerKind::denseLU && N > denseLUMaxN)
+            continue;
+        // every backend is a factorization and a few solves: a cancelled build (its instance is closing, say)
+        //   doesn't sit through the rest
+        if (WorkerPool::cancellationRequested())
+            return nullptr;
+
+        BackendTiming timing{kind};
+        auto backend = makeDefractalizerBackend(kind);
+        timing.prepared = backend->prepare(problem);
+        if (timing.prepared) {
+            DefractalizerWorkspace workspace;
+            workspace.parallelFor = parallelFor;
+            backend->prepareWorkspace(workspace, 1);
+
+            // the first round checks the accuracy and warms the caches up, the second one is timed
+            for (int s = 0; s < numSignals; ++s) {
+                const size_t si = static_cast<size_t>(s);
+                backend->solve(f[si].data(), back.data(), 0, workspace);
+                double err2 = 0.0;
+                for (size_t i = 0; i < n; ++i) {
+                    const double d = static_cast<double>(back[i]) - static_cast<double>(g[si][i]);
+                    err2 += d * d;
+                }
+                const float error = static_cast<float>(std::sqrt(err2 / std::max(gNorm2[si], 1e-30)));
+                timing.relativeError = std::max(timing.relativeError, std::isfinite(error) ? error : 1e30f);
+            }
+            const auto start = std::chrono::steady_clock::now();
+            for (int s = 0; s < numSignals; ++s)
+                backend->solve(f[static_cast<size_t>(s)].data(), back.data(), 0, workspace);
+            timing.secondsPerSolve = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+                                     / numSignals;
+            timing.memoryFootprint = backend->memoryFootprint();
+            timing.estimatedCost = backend->estimatedCost();
+
+            if (timing.relativeError <= accuracyTarget && (!best || timing.secondsPerSolve < bestSeconds)) {
+                best = std::move(backend);
+                bestSeconds = timing.secondsPerSolve;
+            } else if (kind == DefractalizerKind::closedForm) {
+                fallback = std::move(backend);
+            }
+        }
+        if (report != nullptr)
+            report->push_back(timing);
+    }
+    return best ? std::move(best) : std::move(fallback);
+}
+}  // namespace audio_plugin
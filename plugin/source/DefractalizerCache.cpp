@@ -0,0 +1,153 @@
+#include "Bifractalizer/DefractalizerCache.h"
+
+#include <algorithm>
+#include <thread>
+
+
+namespace audio_plugin {
+std::shared_ptr<const DefractalizerBackend> DefractalizerCache::find(const DefractalizerKey& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return findLocked(key);
+}
+
+
+std::shared_ptr<const DefractalizerBackend> DefractalizerCache::findLocked(const DefractalizerKey& key) {
+    const auto it = index.find(key);
+    if (it == index.end())
+        return nullptr;
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->backend;
+}
+
+
+bool DefractalizerCache::contains(const DefractalizerKey& key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return index.count(key) != 0;
+}
+
+
+std::shared_ptr<const DefractalizerBackend> DefractalizerCache::insert(
+    const DefractalizerKey& key, std::shared_ptr<const DefractalizerBackend> backend) {
+    const size_t bytes = backend->memoryFootprint() + backend->problem().memoryFootprint();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (auto cached = findLocked(key))
+        return cached;  // someone may already use it, so it must stay the one
+    entries.push_front({key, backend, bytes});
+    index[key] = entries.begin();
+    used += bytes;
+    evict();
+    return backend;
+}
+
+
+void DefractalizerCache::setMemoryCap(size_t memoryCap) {
+    std::lock_guard<std::mutex> lock(mutex);
+    cap = memoryCap;
+    evict();
+}
+
+
+size_t DefractalizerCache::memoryUsed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
+
+
+size_t DefractalizerCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+
+void DefractalizerCache::evict() {
+    // from the least recently used on, skipping operators in use. use_count() == 1 is reliable here:
+    //   nobody else holds the operator and the only way to get it again is through this (locked) cache.
+    // The newest entry always stays, even if it alone is over the cap.
+    auto it = entries.end();
+    while (used > cap && it != entries.begin()) {
+        --it;
+        if (it == entries.begin())
+            break;
+        if (it->backend.use_count() > 1)
+            continue;
+        used -= it->bytes;
+        index.erase(it->key);
+        it = entries.erase(it);
+    }
+}
+
+
+std::shared_ptr<const DefractalizerProblem> makeDefractalizerProblem(const DefractalizerKey& key, float alpha,
+                                                                     KernelLevel kernelLevel) {
+    const float tolerance = qualityTolerance(key.quality);
+    const int numTerms = seriesTermCount(key.beta, alpha, tolerance);
+    // splitting the solve between threads only pays off for long blocks
+    const int maxThreads = key.N >= 2048 ? static_cast<int>(std::thread::hardware_concurrency()) : 1;
+    // Exact keeps all the terms, but nothing is more exact than float precision
+    return makeDefractalizerProblem(key.N, key.beta, alpha, numTerms, std::max(tolerance, 1e-7f),
+                                    kernelLevel, maxThreads);
+}
+
+
+std::shared_ptr<DefractalizerBackend> buildDefractalizerOperator(const DefractalizerKey& key, float alpha,
+                                                                 KernelLevel kernelLevel, const ParallelFor& parallelFor,
+                                                                 float accuracyTarget, int knownKind,
+                                                                 std::shared_ptr<const DefractalizerProblem> problem) {
+    if (!problem)
+        problem = makeDefractalizerProblem(key, alpha, kernelLevel);
+
+    const int numKinds = static_cast<int>(DefractalizerKind::numKinds);
+    const bool autoSolver = key.solver == numKinds;
+    const int kind = autoSolver ? knownKind : key.solver;
+    std::shared_ptr<DefractalizerBackend> backend;
+    if (kind >= 0 && kind < numKinds) {
+        backend = makeDefractalizerBackend(static_cast<DefractalizerKind>(kind));
+        if (!backend->prepare(problem))
+            backend.reset();
+    }
+    if (!backend && autoSolver)
+        backend = selectDefractalizerBackend(problem, accuracyTarget, parallelFor);
+    return backend;
+}
+
+
+DefractalizerCache& sharedDefractalizerCache() {
+    static DefractalizerCache cache(size_t{256} << 20);
+    return cache;
+}
+
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~- handing operators to the audio thread -~-~-~-~-~-~-~-~-~-~-~-~-~-
+DefractalizerHandover::~DefractalizerHandover() {
+    delete published.exchange(nullptr);
+    reclaim();
+}
+
+
+void DefractalizerHandover::publish(std::unique_ptr<PublishedDefractalizer> op) {
+    delete published.exchange(op.release(), std::memory_order_acq_rel);
+}
+
+
+PublishedDefractalizer* DefractalizerHandover::take() {
+    return published.exchange(nullptr, std::memory_order_acquire);
+}
+
+
+void DefractalizerHandover::retire(PublishedDefractalizer* op) {
+    // no ABA: the only pop takes the whole stack at once
+    op->next = retired.load(std::memory_order_relaxed);
+    while (!retired.compare_exchange_weak(op->next, op, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+
+void DefractalizerHandover::reclaim() {
+    PublishedDefractalizer* op = retired.exchange(nullptr, std::memory_order_acquire);
+    while (op != nullptr) {
+        PublishedDefractalizer* next = op->next;
+        delete op;
+        op = next;
+    }
+}
+}  // namespace audio_plugin
@@ -0,0 +1,532 @@
+#include "Bifractalizer/DefractalizerDiskCache.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <thread>
+
+#include "Bifractalizer/WorkerPool.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace audio_plugin {
+namespace {
+constexpr char fileMagic[8] = {'B', 'F', 'R', 'C', 'T', 'O', 'P', '\0'};
+constexpr size_t sectionAlignment = 64;
+
+enum Section : uint32_t {
+    rowStartSection = 0,
+    indices16Section,
+    indices32Section,
+    weightsSection,
+    sliceStartSection,
+    slicedIndicesSection,
+    slicedWeightsSection,
+    cycleNodesSection,
+    cycleStartSection,
+    transientSection,
+    engineStateSection,
+    numSections
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;  // sizeof(FileHeader), catches layout changes without a version bump
+    uint64_t fileBytes;
+    uint64_t checksum;     // FNV-1a of [headerBytes, fileBytes)
+    int32_t N, beta, alphaStep, quality, solver;
+    int32_t kind;          // the backend that was stored (for Auto - the one that won)
+    int32_t numTerms, closedFormSteps, maxRowLength, compactIndices;
+    float alpha, tolerance;
+    uint32_t numSectionEntries;
+    uint32_t reserved;
+};
+
+struct SectionEntry {
+    uint32_t id;
+    uint32_t elementBytes;
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+uint64_t fnv1a(const uint8_t* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+void appendSection(std::vector<uint8_t>& file, std::vector<SectionEntry>& table, uint32_t id, const std::vector<T>& values) {
+    file.resize((file.size() + sectionAlignment - 1) / sectionAlignment * sectionAlignment, 0);
+    const size_t bytes = sizeof(T) * values.size();
+    table.push_back({id, static_cast<uint32_t>(sizeof(T)), file.size(), bytes});
+    file.resize(file.size() + bytes);
+    if (bytes != 0)
+        std::memcpy(file.data() + table.back().offset, values.data(), bytes);
+}
+
+template <typename T>
+bool readSection(const uint8_t* file, size_t fileBytes, const SectionEntry& entry, std::vector<T>& values) {
+    if (entry.elementBytes != sizeof(T) || entry.bytes % sizeof(T) != 0 ||
+        entry.offset > fileBytes || entry.bytes > fileBytes - entry.offset)
+        return false;
+    values.resize(entry.bytes / sizeof(T));
+    if (entry.bytes != 0)
+        std::memcpy(values.data(), file + entry.offset, static_cast<size_t>(entry.bytes));
+    return true;
+}
+
+// Everything the kernels index with stays below N, and the plans are laid out as the builders lay them out
+bool plansFit(const DefractalizerProblem& problem) {
+    const GatherPlan& plan = problem.plan;
+    const SlicedGatherPlan& sliced = problem.sliced;
+    const OrbitPlan& orbits = problem.orbits;
+    const size_t N = static_cast<size_t>(problem.N);
+    if (problem.N <= 0 || problem.numTerms < 1 || problem.closedFormSteps < 0 || plan.maxRowLength < 0 ||
+        (plan.compactIndices && N > 65536))
+        return false;
+
+    if (plan.rowStart.size() != N + 1 || plan.rowStart[0] != 0 || plan.rowStart.back() != plan.nonZeros() ||
+        (plan.compactIndices ? plan.indices16.size() : plan.indices32.size()) != plan.nonZeros())
+        return false;
+    for (size_t row = 0; row < N; ++row)
+        if (plan.rowStart[row + 1] < plan.rowStart[row] ||
+            plan.rowStart[row + 1] - plan.rowStart[row] > static_cast<uint32_t>(plan.maxRowLength))
+            return false;
+    for (size_t k = 0; k < plan.nonZeros(); ++k)
+        if (plan.index(k) >= N)
+            return false;
+
+    if (sliced.valid()) {
+        constexpr uint32_t W = SlicedGatherPlan::sliceWidth;
+        if (!plan.compactIndices || sliced.sliceStart.size() != (N + W - 1) / W + 1 || sliced.sliceStart[0] != 0 ||
+            sliced.sliceStart.back() != sliced.indices.size() || sliced.weights.size() != sliced.indices.size())
+            return false;
+        for (size_t s = 0; s + 1 < sliced.sliceStart.size(); ++s)
+            if (sliced.sliceStart[s + 1] < sliced.sliceStart[s] ||
+                (sliced.sliceStart[s + 1] - sliced.sliceStart[s]) % W != 0)
+                return false;
+        for (const uint16_t index : sliced.indices)
+            if (index >= N)
+                return false;
+    }
+
+    // every sample once: on a cycle or on the way to one
+    if (orbits.cycleStart.empty() || orbits.cycleStart[0] != 0 ||
+        orbits.cycleStart.back() != orbits.cycleNodes.size() || orbits.cycleNodes.size() + orbits.transient.size() != N)
+        return false;
+    for (size_t c = 0; c + 1 < orbits.cycleStart.size(); ++c)
+        if (orbits.cycleStart[c + 1] < orbits.cycleStart[c])
+            return false;
+    std::vector<bool> seen(N, false);
+    for (const std::vector<uint32_t>* nodes : {&orbits.cycleNodes, &orbits.transient})
+        for (const uint32_t node : *nodes) {
+            if (node >= N || seen[node])
+                return false;
+            seen[node] = true;
+        }
+    return true;
+}
+
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& path) {
+#if defined(_WIN32)
+        // the wide API: cache directories under a user name outside the ANSI code page must work too
+        file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+            return;
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+            return;
+        const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view != nullptr) {
+            bytes = static_cast<const uint8_t*>(view);
+            size = static_cast<size_t>(fileSize.QuadPart);
+        }
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                bytes = static_cast<const uint8_t*>(view);
+                size = static_cast<size_t>(info.st_size);
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#if defined(_WIN32)
+        if (bytes != nullptr)
+            UnmapViewOfFile(bytes);
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (bytes != nullptr)
+            munmap(const_cast<uint8_t*>(bytes), size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return bytes; }
+    size_t fileSize() const { return size; }
+
+private:
+    const uint8_t* bytes = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// A file of this version for key, none of it damaged
+bool validFile(const MappedFile& mapped, const DefractalizerKey& key, FileHeader& header) {
+    const uint8_t* file = mapped.data();
+    const size_t fileBytes = mapped.fileSize();
+    if (file == nullptr || fileBytes < sizeof(FileHeader))
+        return false;
+
+    std::memcpy(&header, file, sizeof(FileHeader));
+    const size_t tableBytes = sizeof(SectionEntry) * numSections;
+    if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 ||
+        header.version != DefractalizerDiskCache::formatVersion || header.headerBytes != sizeof(FileHeader) || header.fileBytes != fileBytes ||
+        header.numSectionEntries != numSections || fileBytes < sizeof(FileHeader) + tableBytes)
+        return false;
+    if (header.N != key.N || header.beta != key.beta || header.alphaStep != key.alphaStep ||
+        header.quality != key.quality || header.solver != key.solver ||
+        header.kind < 0 || header.kind >= static_cast<int32_t>(DefractalizerKind::numKinds))
+        return false;
+    return fnv1a(file + sizeof(FileHeader), fileBytes - sizeof(FileHeader)) == header.checksum;
+}
+}  // namespace
+
+
+void DefractalizerDiskCache::setDirectory(const std::filesystem::path& directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    dir = directory;
+}
+
+
+std::filesystem::path DefractalizerDiskCache::directory() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dir;
+}
+
+
+std::filesystem::path DefractalizerDiskCache::pathFor(const DefractalizerKey& key) const {
+    const std::string name = "N" + std::to_string(key.N) + "_b" + std::to_string(key.beta)
+                           + "_a" + std::to_string(key.alphaStep) + "_q" + std::to_string(key.quality)
+                           + "_s" + std::to_string(key.solver) + ".bfop";
+    return directory() / name;
+}
+
+
+std::shared_ptr<DefractalizerBackend> DefractalizerDiskCache::load(const DefractalizerKey& key,
+                                                                   KernelLevel kernelLevel) const {
+    if (!enabled())
+        return nullptr;
+    const MappedFile mapped(pathFor(key));
+    FileHeader header;
+    if (!validFile(mapped, key, header))
+        return nullptr;
+    const uint8_t* file = mapped.data();
+    const size_t fileBytes = mapped.fileSize();
+
+    SectionEntry table[numSections];
+    std::memcpy(table, file + sizeof(FileHeader), sizeof(SectionEntry) * numSections);
+    for (uint32_t s = 0; s < numSections; ++s)
+        if (table[s].id != s)
+            return nullptr;
+
+    auto problem = std::make_shared<DefractalizerProblem>();
+    problem->N = header.N;
+    problem->beta = header.beta;
+    problem->alpha = header.alpha;
+    problem->numTerms = header.numTerms;
+    problem->tolerance = header.tolerance;
+    problem->closedFormSteps = header.closedFormSteps;
+    problem->maxThreads = header.N >= 2048 ? static_cast<int>(std::thread::hardware_concurrency()) : 1;
+    problem->kernelLevel = kernelLevel;
+
+    GatherPlan& plan = problem->plan;
+    plan.N = header.N;
+    plan.maxRowLength = header.maxRowLength;
+    plan.compactIndices = header.compactIndices != 0;
+    SlicedGatherPlan& sliced = problem->sliced;
+    OrbitPlan& orbits = problem->orbits;
+    orbits.N = header.N;
+    orbits.beta = header.beta;
+    std::vector<uint8_t> state;
+    const bool sectionsRead =
+        readSection(file, fileBytes, table[rowStartSection], plan.rowStart) &&
+        readSection(file, fileBytes, table[indices16Section], plan.indices16) &&
+        readSection(file, fileBytes, table[indices32Section], plan.indices32) &&
+        readSection(file, fileBytes, table[weightsSection], plan.weights) &&
+        readSection(file, fileBytes, table[sliceStartSection], sliced.sliceStart) &&
+        readSection(file, fileBytes, table[slicedIndicesSection], sliced.indices) &&
+        readSection(file, fileBytes, table[slicedWeightsSection], sliced.weights) &&
+        readSection(file, fileBytes, table[cycleNodesSection], orbits.cycleNodes) &&
+        readSection(file, fileBytes, table[cycleStartSection], orbits.cycleStart) &&
+        readSection(file, fileBytes, table[transientSection], orbits.transient) &&
+        readSection(file, fileBytes, table[engineStateSection], state);
+    sliced.N = sliced.sliceStart.empty() ? 0 : header.N;
+    if (!sectionsRead || !plansFit(*problem))
+        return nullptr;
+
+    auto backend = makeDefractalizerBackend(static_cast<DefractalizerKind>(header.kind));
+    if (!backend->prepareFromState(std::move(problem), state.data(), state.size()))
+        return nullptr;
+    return backend;
+}
+
+
+bool DefractalizerDiskCache::contains(const DefractalizerKey& key) const {
+    if (!enabled())
+        return false;
+    FileHeader header;
+    return validFile(MappedFile(pathFor(key)), key, header);
+}
+
+
+bool DefractalizerDiskCache::save(const DefractalizerKey& key, const DefractalizerBackend& backend) const {
+    if (!enabled())
+        return false;
+    const DefractalizerProblem& problem = backend.problem();
+
+    FileHeader header{};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = formatVersion;
+    header.headerBytes = sizeof(FileHeader);
+    header.N = key.N;
+    header.beta = key.beta;
+    header.alphaStep = key.alphaStep;
+    header.quality = key.quality;
+    header.solver = key.solver;
+    header.kind = static_cast<int32_t>(backend.kind());
+    header.numTerms = problem.numTerms;
+    header.closedFormSteps = problem.closedFormSteps;
+    header.maxRowLength = problem.plan.maxRowLength;
+    header.compactIndices = problem.plan.compactIndices ? 1 : 0;
+    header.alpha = problem.alpha;
+    header.tolerance = problem.tolerance;
+    header.numSectionEntries = numSections;
+
+    std::vector<uint8_t> file(sizeof(FileHeader) + sizeof(SectionEntry) * numSections, 0);
+    std::vector<SectionEntry> table;
+    appendSection(file, table, rowStartSection, problem.plan.rowStart);
+    appendSection(file, table, indices16Section, problem.plan.indices16);
+    appendSection(file, table, indices32Section, problem.plan.indices32);
+    appendSection(file, table, weightsSection, problem.plan.weights);
+    appendSection(file, table, sliceStartSection, problem.sliced.sliceStart);
+    appendSection(file, table, slicedIndicesSection, problem.sliced.indices);
+    appendSection(file, table, slicedWeightsSection, problem.sliced.weights);
+    appendSection(file, table, cycleNodesSection, problem.orbits.cycleNodes);
+    appendSection(file, table, cycleStartSection, problem.orbits.cycleStart);
+    appendSection(file, table, transientSection, problem.orbits.transient);
+    appendSection(file, table, engineStateSection, backend.saveState());
+    std::memcpy(file.data() + sizeof(FileHeader), table.data(), sizeof(SectionEntry) * table.size());
+
+    header.fileBytes = file.size();
+    header.checksum = fnv1a(file.data() + sizeof(FileHeader), file.size() - sizeof(FileHeader));
+    std::memcpy(file.data(), &header, sizeof(FileHeader));
+
+    std::error_code error;
+    const std::filesystem::path path = pathFor(key);
+    std::filesystem::create_directories(path.parent_path(), error);
+    // unique per thread, so concurrent writers of the same key don't share a temporary
+    std::filesystem::path temporary = path;
+    temporary += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    bool written = false;
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+        out.close();
+        written = static_cast<bool>(out);
+    }
+    if (!written) {
+        std::filesystem::remove(temporary, error);  // a full disk mustn't fill up with halves
+        return false;
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+
+DefractalizerDiskCache& sharedDiskCache() {
+    static DefractalizerDiskCache cache;
+    static const bool fromEnvironment = [] {
+#if defined(_WIN32)
+        const wchar_t* directory = _wgetenv(L"BIFRACTALIZER_OPERATOR_CACHE");
+#else
+        const char* directory = std::getenv("BIFRACTALIZER_OPERATOR_CACHE");
+#endif
+        if (directory != nullptr)
+            cache.setDirectory(directory);
+        return directory != nullptr;
+    }();
+    (void)fromEnvironment;
+    return cache;
+}
+
+
+namespace {
+// A build somebody is running right now: whoever wants the same key waits for its plans and then its operator
+//   instead of factorizing them again
+struct InFlightBuild {
+    std::promise<std::shared_ptr<const DefractalizerProblem>> problemPromise;
+    std::promise<std::shared_ptr<const DefractalizerBackend>> backendPromise;
+    std::shared_future<std::shared_ptr<const DefractalizerProblem>> problem = problemPromise.get_future().share();
+    std::shared_future<std::shared_ptr<const DefractalizerBackend>> backend = backendPromise.get_future().share();
+    bool stopped = false;  // by the builder's problemReady, set before backend: the waiters try again
+};
+
+std::mutex inFlightMutex;
+std::map<DefractalizerKey, std::shared_ptr<InFlightBuild>> inFlightBuilds;
+
+// Fulfils whatever the build didn't get to and takes it off the list, however the builder leaves
+struct InFlightBuildScope {
+    const DefractalizerKey& key;
+    InFlightBuild& build;
+    bool problemSet = false;
+    std::shared_ptr<const DefractalizerBackend> backend;
+
+    ~InFlightBuildScope() {
+        if (!problemSet)
+            build.problemPromise.set_value(nullptr);
+        build.backendPromise.set_value(std::move(backend));
+        std::lock_guard<std::mutex> lock(inFlightMutex);
+        inFlightBuilds.erase(key);
+    }
+};
+
+// false if the job this runs on was cancelled meanwhile
+template <typename T>
+bool waitUnlessCancelled(const std::shared_future<T>& future) {
+    while (future.wait_for(std::chrono::milliseconds(5)) != std::future_status::ready)
+        if (WorkerPool::cancellationRequested())
+            return false;
+    return true;
+}
+}  // namespace
+
+
+std::shared_ptr<const DefractalizerBackend> acquireDefractalizerOperator(const DefractalizerKey& key, float alpha,
+                                                                         KernelLevel kernelLevel,
+                                                                         const ParallelFor& parallelFor,
+                                                                         float accuracyTarget, int knownKind,
+                                                                         const ProblemReady& problemReady) {
+    for (;;) {
+        if (auto cached = sharedDefractalizerCache().find(key))
+            return cached;
+
+        std::shared_ptr<InFlightBuild> build;
+        bool building = false;
+        {
+            std::lock_guard<std::mutex> lock(inFlightMutex);
+            auto& entry = inFlightBuilds[key];
+            building = entry == nullptr;
+            if (building)
+                entry = std::make_shared<InFlightBuild>();
+            build = entry;
+        }
+        if (!building) {
+            // somebody else builds it (40 instances loading one session): their plans, then their operator
+            if (!waitUnlessCancelled(build->problem))
+                return nullptr;
+            const auto problem = build->problem.get();  // nullptr if it came from the disk
+            if (problem && problemReady && !problemReady(problem))
+                return nullptr;
+            if (!waitUnlessCancelled(build->backend))
+                return nullptr;
+            if (build->backend.get() || !build->stopped)
+                return build->backend.get();
+            continue;  // that build was made pointless, this one may not be
+        }
+
+        InFlightBuildScope scope{key, *build};
+        // the build before this one may have finished between the lookup and taking its place
+        if ((scope.backend = sharedDefractalizerCache().find(key)))
+            return scope.backend;
+
+        // a prepared operator on disk is as good as a cached one, it even remembers what Auto picked
+        std::shared_ptr<DefractalizerBackend> backend = sharedDiskCache().load(key, kernelLevel);
+        if (!backend) {
+            auto problem = makeDefractalizerProblem(key, alpha, kernelLevel);
+            build->problemPromise.set_value(problem);
+            scope.problemSet = true;
+            if (problemReady && !problemReady(problem)) {
+                build->stopped = true;
+                return nullptr;
+            }
+            backend = buildDefractalizerOperator(key, alpha, kernelLevel, parallelFor, accuracyTarget, knownKind,
+                                                 std::move(problem));
+            if (!backend)
+                return nullptr;
+            sharedDiskCache().save(key, *backend);
+        }
+        scope.backend = sharedDefractalizerCache().insert(key, std::move(backend));
+        return scope.backend;
+    }
+}
+
+
+int populateDiskCache(const DefractalizerDiskCache& cache, const DiskCacheGrid& grid, KernelLevel kernelLevel,
+                      float accuracyTarget,
+                      const std::function<void(const DefractalizerKey&, bool written)>& progress) {
+    int written = 0;
+    for (const int N : grid.Ns)
+        for (const int beta : grid.betas)
+            for (const int alphaStep : grid.alphaSteps)
+                for (const int quality : grid.qualities)
+                    for (const int solver : grid.solvers) {
+                        const DefractalizerKey key{N, beta, alphaStep, quality, solver};
+                        bool saved = false;
+                        if (!cache.contains(key)) {
+                            const float alpha = static_cast<float>(alphaStep) / 100.0f;
+                            const auto backend = buildDefractalizerOperator(key, alpha, kernelLevel, {}, accuracyTarget);
+                            saved = backend && cache.save(key, *backend);
+                        }
+                        written += saved ? 1 : 0;
+                        if (progress)
+                            progress(key, saved);
+                    }
+    return written;
+}
+}  // namespace audio_plugin
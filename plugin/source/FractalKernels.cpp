@@ -0,0 +1,288 @@
+#include "Bifractalizer/FractalKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BIFRACTALIZER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define BIFRACTALIZER_X86 0
+#endif
+
+#if BIFRACTALIZER_X86 && (defined(__GNUC__) || defined(__clang__))
+#define BIFRACTALIZER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BIFRACTALIZER_TARGET(isa)
+#endif
+
+// NOTE: this file is compiled with -ffp-contract=off (see plugin/CMakeLists.txt):
+//   mul + add must not be fused, otherwise kernels stop being bit-identical to the scalar path
+
+
+namespace audio_plugin {
+static KernelLevel queryKernelLevel() {
+#if !BIFRACTALIZER_X86
+    return KernelLevel::scalar;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!sse41)
+        return KernelLevel::scalar;
+    if (!osxsave || maxLeaf < 7)
+        return KernelLevel::sse41;
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    const bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    const bool avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+    if (avx512)
+        return KernelLevel::avx512;
+    return avx2 ? KernelLevel::avx2 : KernelLevel::sse41;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return KernelLevel::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return KernelLevel::avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return KernelLevel::sse41;
+    return KernelLevel::scalar;
+#endif
+}
+
+KernelLevel detectKernelLevel() {
+    static const KernelLevel level = queryKernelLevel();
+    return level;
+}
+
+const char* kernelLevelName(KernelLevel level) {
+    switch (level) {
+        case KernelLevel::scalar: return "scalar";
+        case KernelLevel::sse41:  return "SSE4.1";
+        case KernelLevel::avx2:   return "AVX2";
+        case KernelLevel::avx512: return "AVX-512";
+    }
+    return "unknown";
+}
+
+
+void buildSlicedGatherPlan(SlicedGatherPlan& sliced, const GatherPlan& plan) {
+    constexpr int W = SlicedGatherPlan::sliceWidth;
+    sliced.N = 0;
+    sliced.sliceStart.clear();
+    sliced.indices.clear();
+    sliced.weights.clear();
+    if (!plan.compactIndices || plan.N <= 0)
+        return;
+
+    const int numSlices = (plan.N + W - 1) / W;
+    sliced.N = plan.N;
+    sliced.sliceStart.resize(static_cast<size_t>(numSlices) + 1);
+    sliced.sliceStart[0] = 0;
+    for (int s = 0; s < numSlices; ++s) {
+        uint32_t slots = 0;
+        for (int r = s * W; r < std::min(plan.N, (s + 1) * W); ++r) {
+            const size_t row = static_cast<size_t>(r);
+            slots = std::max(slots, plan.rowStart[row + 1] - plan.rowStart[row]);
+        }
+        sliced.sliceStart[static_cast<size_t>(s) + 1] = sliced.sliceStart[static_cast<size_t>(s)] + slots * W;
+    }
+
+    sliced.indices.assign(sliced.sliceStart.back(), 0);
+    sliced.weights.assign(sliced.sliceStart.back(), 0.0f);
+    for (int r = 0; r < plan.N; ++r) {
+        const size_t row = static_cast<size_t>(r);
+        const size_t base = sliced.sliceStart[row / W] + row % W;
+        for (uint32_t k = plan.rowStart[row]; k < plan.rowStart[row + 1]; ++k) {
+            const size_t slot = k - plan.rowStart[row];
+            sliced.indices[base + slot * W] = plan.indices16[k];
+            sliced.weights[base + slot * W] = plan.weights[k];
+        }
+    }
+}
+
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~- kernels -~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-~-
+// Each kernel computes one or two channels (Stereo) that share the index stream.
+
+template <bool Stereo, typename Index>
+static void scalarKernel(const uint32_t* rowStart, const Index* indices, const float* weights,
+                         int rowBegin, int rowEnd, const float* g0, const float* g1, float* f0, float* f1) {
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        float sum0 = 0.0f, sum1 = 0.0f;
+        for (uint32_t k = rowStart[i]; k < rowStart[i + 1]; ++k) {
+            const float w = weights[k];
+            const Index j = indices[k];
+            sum0 += w * g0[j];
+            if constexpr (Stereo)
+                sum1 += w * g1[j];
+        }
+        f0[i] = sum0;
+        if constexpr (Stereo)
+            f1[i] = sum1;
+    }
+}
+
+// Stores a full slice or, for the last partial one, only the rows that exist
+static inline void storeSlice(float* dst, const float* lanes, int count) {
+    std::memcpy(dst, lanes, sizeof(float) * static_cast<size_t>(count));
+}
+
+#if BIFRACTALIZER_X86
+template <bool Stereo>
+BIFRACTALIZER_TARGET("sse4.1")
+static void sse41Kernel(const SlicedGatherPlan& p, int sliceBegin, int sliceEnd,
+                        const float* g0, const float* g1, float* f0, float* f1) {
+    constexpr int W = SlicedGatherPlan::sliceWidth;
+    alignas(16) float lanes0[W], lanes1[W];
+    for (int s = sliceBegin; s < sliceEnd; ++s) {
+        const uint32_t begin = p.sliceStart[static_cast<size_t>(s)], end = p.sliceStart[static_cast<size_t>(s) + 1];
+        __m128 acc0[W / 4], acc1[W / 4];
+        for (int v = 0; v < W / 4; ++v)
+            acc0[v] = acc1[v] = _mm_setzero_ps();
+        for (uint32_t k = begin; k < end; k += W) {
+            const uint16_t* idx = p.indices.data() + k;
+            const float* w = p.weights.data() + k;
+            for (int v = 0; v < W / 4; ++v) {
+                const __m128i i4 = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(idx + 4 * v)));
+                const int j0 = _mm_cvtsi128_si32(i4), j1 = _mm_extract_epi32(i4, 1),
+                          j2 = _mm_extract_epi32(i4, 2), j3 = _mm_extract_epi32(i4, 3);
+                const __m128 w4 = _mm_loadu_ps(w + 4 * v);
+                acc0[v] = _mm_add_ps(acc0[v], _mm_mul_ps(w4, _mm_setr_ps(g0[j0], g0[j1], g0[j2], g0[j3])));
+                if constexpr (Stereo)
+                    acc1[v] = _mm_add_ps(acc1[v], _mm_mul_ps(w4, _mm_setr_ps(g1[j0], g1[j1], g1[j2], g1[j3])));
+            }
+        }
+        for (int v = 0; v < W / 4; ++v) {
+            _mm_store_ps(lanes0 + 4 * v, acc0[v]);
+            if constexpr (Stereo)
+                _mm_store_ps(lanes1 + 4 * v, acc1[v]);
+        }
+        const int count = std::min(W, p.N - s * W);
+        storeSlice(f0 + s * W, lanes0, count);
+        if constexpr (Stereo)
+            storeSlice(f1 + s * W, lanes1, count);
+    }
+}
+
+template <bool Stereo>
+BIFRACTALIZER_TARGET("avx2")
+static void avx2Kernel(const SlicedGatherPlan& p, int sliceBegin, int sliceEnd,
+                       const float* g0, const float* g1, float* f0, float* f1) {
+    constexpr int W = SlicedGatherPlan::sliceWidth;
+    alignas(32) float lanes0[W], lanes1[W];
+    for (int s = sliceBegin; s < sliceEnd; ++s) {
+        const uint32_t begin = p.sliceStart[static_cast<size_t>(s)], end = p.sliceStart[static_cast<size_t>(s) + 1];
+        __m256 accLo0 = _mm256_setzero_ps(), accHi0 = _mm256_setzero_ps();
+        __m256 accLo1 = _mm256_setzero_ps(), accHi1 = _mm256_setzero_ps();
+        for (uint32_t k = begin; k < end; k += W) {
+            const __m256i i16 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p.indices.data() + k));
+            const __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(i16));
+            const __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(i16, 1));
+            const __m256 wLo = _mm256_loadu_ps(p.weights.data() + k);
+            const __m256 wHi = _mm256_loadu_ps(p.weights.data() + k + 8);
+            accLo0 = _mm256_add_ps(accLo0, _mm256_mul_ps(wLo, _mm256_i32gather_ps(g0, lo, 4)));
+            accHi0 = _mm256_add_ps(accHi0, _mm256_mul_ps(wHi, _mm256_i32gather_ps(g0, hi, 4)));
+            if constexpr (Stereo) {
+                accLo1 = _mm256_add_ps(accLo1, _mm256_mul_ps(wLo, _mm256_i32gather_ps(g1, lo, 4)));
+                accHi1 = _mm256_add_ps(accHi1, _mm256_mul_ps(wHi, _mm256_i32gather_ps(g1, hi, 4)));
+            }
+        }
+        const int count = std::min(W, p.N - s * W);
+        if (count == W) {
+            _mm256_storeu_ps(f0 + s * W, accLo0);
+            _mm256_storeu_ps(f0 + s * W + 8, accHi0);
+            if constexpr (Stereo) {
+                _mm256_storeu_ps(f1 + s * W, accLo1);
+                _mm256_storeu_ps(f1 + s * W + 8, accHi1);
+            }
+        } else {
+            _mm256_store_ps(lanes0, accLo0);
+            _mm256_store_ps(lanes0 + 8, accHi0);
+            storeSlice(f0 + s * W, lanes0, count);
+            if constexpr (Stereo) {
+                _mm256_store_ps(lanes1, accLo1);
+                _mm256_store_ps(lanes1 + 8, accHi1);
+                storeSlice(f1 + s * W, lanes1, count);
+            }
+        }
+    }
+}
+
+template <bool Stereo>
+BIFRACTALIZER_TARGET("avx512f")
+static void avx512Kernel(const SlicedGatherPlan& p, int sliceBegin, int sliceEnd,
+                         const float* g0, const float* g1, float* f0, float* f1) {
+    constexpr int W = SlicedGatherPlan::sliceWidth;
+    for (int s = sliceBegin; s < sliceEnd; ++s) {
+        const uint32_t begin = p.sliceStart[static_cast<size_t>(s)], end = p.sliceStart[static_cast<size_t>(s) + 1];
+        __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+        for (uint32_t k = begin; k < end; k += W) {
+            const __m512i idx = _mm512_cvtepu16_epi32(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p.indices.data() + k)));
+            const __m512 w = _mm512_loadu_ps(p.weights.data() + k);
+            acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(w, _mm512_i32gather_ps(idx, g0, 4)));
+            if constexpr (Stereo)
+                acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(w, _mm512_i32gather_ps(idx, g1, 4)));
+        }
+        const int count = std::min(W, p.N - s * W);
+        const __mmask16 mask = static_cast<__mmask16>((1u << count) - 1u);
+        _mm512_mask_storeu_ps(f0 + s * W, mask, acc0);
+        if constexpr (Stereo)
+            _mm512_mask_storeu_ps(f1 + s * W, mask, acc1);
+    }
+}
+#endif
+
+
+template <bool Stereo>
+static void runKernel(const GatherPlan& plan, const SlicedGatherPlan& sliced, KernelLevel level,
+                      int rowBegin, int rowEnd, const float* g0, const float* g1, float* f0, float* f1) {
+#if BIFRACTALIZER_X86
+    if (sliced.valid()) {
+        constexpr int W = SlicedGatherPlan::sliceWidth;
+        const int sliceBegin = rowBegin / W, sliceEnd = (rowEnd + W - 1) / W;
+        switch (level) {
+            case KernelLevel::avx512: avx512Kernel<Stereo>(sliced, sliceBegin, sliceEnd, g0, g1, f0, f1); return;
+            case KernelLevel::avx2:   avx2Kernel<Stereo>(sliced, sliceBegin, sliceEnd, g0, g1, f0, f1); return;
+            case KernelLevel::sse41:  sse41Kernel<Stereo>(sliced, sliceBegin, sliceEnd, g0, g1, f0, f1); return;
+            case KernelLevel::scalar: break;
+        }
+    }
+#else
+    (void) sliced;
+    (void) level;
+#endif
+    if (plan.compactIndices)
+        scalarKernel<Stereo>(plan.rowStart.data(), plan.indices16.data(), plan.weights.data(), rowBegin, rowEnd,
+                             g0, g1, f0, f1);
+    else
+        scalarKernel<Stereo>(plan.rowStart.data(), plan.indices32.data(), plan.weights.data(), rowBegin, rowEnd,
+                             g0, g1, f0, f1);
+}
+
+
+void applyFractalKernelRows(const GatherPlan& plan, const SlicedGatherPlan& sliced,
+                            const float* const* g, float* const* f, int numChannels,
+                            KernelLevel level, int rowBegin, int rowEnd) {
+    level = std::min(level, detectKernelLevel());
+    int ch = 0;
+    for (; ch + 1 < numChannels; ch += 2)
+        runKernel<true>(plan, sliced, level, rowBegin, rowEnd, g[ch], g[ch + 1], f[ch], f[ch + 1]);
+    if (ch < numChannels)
+        runKernel<false>(plan, sliced, level, rowBegin, rowEnd, g[ch], nullptr, f[ch], nullptr);
+}
+
+void applyFractalKernel(const GatherPlan& plan, const SlicedGatherPlan& sliced,
+                        const float* const* g, float* const* f, int numChannels,
+                        KernelLevel level) {
+    applyFractalKernelRows(plan, sliced, g, f, numChannels, level, 0, plan.N);
+}
+}  // namespace audio_plugin
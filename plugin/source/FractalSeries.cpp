@@ -0,0 +1,287 @@
+#include "Bifractalizer/FractalSeries.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+
+namespace audio_plugin {
+int seriesTermCount(int beta, float alpha, float tolerance) {
+    const int termsForBeta = static_cast<int>(std::ceil(std::log(1000001.0) / std::log(static_cast<double>(beta))));
+    if (tolerance <= 0.0f || alpha >= 1.0f)
+        return termsForBeta;
+    if (alpha <= 0.0f)
+        return 1;
+    // first n with \alpha^n < tolerance
+    const double termsForAlpha = std::ceil(std::log(static_cast<double>(tolerance)) / std::log(static_cast<double>(alpha)));
+    return std::clamp(static_cast<int>(termsForAlpha), 1, termsForBeta);
+}
+
+
+int doublingPasses(int numTerms) {
+    if (numTerms <= 1)
+        return 0;
+    const unsigned K = static_cast<unsigned>(numTerms);
+    const int doublings = static_cast<int>(std::bit_width(K)) - 1;
+    return doublings + std::popcount(K) - 1;
+}
+
+
+// dst(i) = a(i) + w * b(step*i mod N) for i in [begin, end)
+static void gatherPass(float* dst, const float* a, const float* b, float w, uint32_t step, int N, int begin, int end) {
+    const uint32_t n = static_cast<uint32_t>(N);
+    uint32_t j = static_cast<uint32_t>(static_cast<uint64_t>(step) * static_cast<uint64_t>(begin) % n);
+    for (int i = begin; i < end; ++i) {
+        dst[i] = a[i] + w * b[j];
+        j += step;
+        if (j >= n)
+            j -= n;
+    }
+}
+
+// Pass k of a pieced evaluator covers units [k N, (k+1) N): runs its part of [begin, end)
+template <typename Run>
+static void runPassPiece(int pass, int N, int begin, int end, Run&& run) {
+    const int from = std::max(begin - pass * N, 0), to = std::min(end - pass * N, N);
+    if (from < to)
+        run(from, to);
+}
+
+// One full-buffer pass of the doubling evaluator: dst = a + w b∘M^step, b == nullptr - a copy of a,
+//   a == nullptr too - zeros
+struct DoublingPass {
+    float* dst;
+    const float* a;
+    const float* b;
+    float w;
+    uint32_t step;
+};
+
+// Calls visit(pass) for the passes of fractalizeDoubling in order
+template <typename Visit>
+static void visitDoublingPasses(const float* g, float* f, float* scratch,
+                                int N, int beta, float alpha, int numTerms, Visit&& visit) {
+    if (numTerms <= 1) {
+        visit(DoublingPass{f, numTerms == 1 ? g : nullptr, nullptr, 0.0f, 0});
+        return;
+    }
+
+    const uint64_t n64 = static_cast<uint64_t>(N);
+    float* S = scratch;                           // S_{2^j}
+    float* T = scratch + N;                       // ping-pong target
+    float* R = scratch + 2 * static_cast<size_t>(N);  // sum of the bits of K below j
+    bool haveR = false;
+    visit(DoublingPass{S, g, nullptr, 0.0f, 0});
+
+    uint32_t step = static_cast<uint32_t>(static_cast<uint64_t>(beta) % n64);  // M^{2^j}
+    float alphaPow = alpha;                                                   // \alpha^{2^j}
+    unsigned K = static_cast<unsigned>(numTerms);
+    while (K != 0) {
+        if (K & 1u) {
+            if (!haveR) {
+                visit(DoublingPass{R, S, nullptr, 0.0f, 0});
+                haveR = true;
+            } else {
+                // S_{2^j + m} = S_{2^j} + \alpha^{2^j} S_m∘M^{2^j}
+                visit(DoublingPass{T, S, R, alphaPow, step});
+                std::swap(R, T);
+            }
+        }
+        K >>= 1;
+        if (K != 0) {
+            visit(DoublingPass{T, S, S, alphaPow, step});
+            std::swap(S, T);
+            alphaPow *= alphaPow;
+            step = static_cast<uint32_t>((static_cast<uint64_t>(step) * step) % n64);
+        }
+    }
+    visit(DoublingPass{f, R, nullptr, 0.0f, 0});
+}
+
+int fractalizeDoublingUnits(int N, int numTerms) {
+    // the copies in (S = g, R = S) and out (f = R) are passes too
+    return N * (numTerms <= 1 ? 1 : doublingPasses(numTerms) + 3);
+}
+
+void fractalizeDoublingPiece(const float* g, float* f, float* scratch,
+                             int N, int beta, float alpha, int numTerms, int begin, int end) {
+    int pass = 0;
+    visitDoublingPasses(g, f, scratch, N, beta, alpha, numTerms, [&](const DoublingPass& p) {
+        runPassPiece(pass++, N, begin, end, [&](int from, int to) {
+            const size_t bytes = sizeof(float) * static_cast<size_t>(to - from);
+            if (p.b != nullptr)
+                gatherPass(p.dst, p.a, p.b, p.w, p.step, N, from, to);
+            else if (p.a != nullptr)
+                std::memcpy(p.dst + from, p.a + from, bytes);
+            else
+                std::memset(p.dst + from, 0, bytes);
+        });
+    });
+}
+
+void fractalizeDoubling(const float* g, float* f, float* scratch,
+                        int N, int beta, float alpha, int numTerms) {
+    fractalizeDoublingPiece(g, f, scratch, N, beta, alpha, numTerms, 0, fractalizeDoublingUnits(N, numTerms));
+}
+
+
+void buildOrbitPlan(OrbitPlan& plan, int N, int beta) {
+    const size_t n = static_cast<size_t>(N);
+    const uint64_t n64 = static_cast<uint64_t>(N);
+    const uint64_t b = static_cast<uint64_t>(beta) % n64;
+    auto next = [&](uint32_t i) { return static_cast<uint32_t>((i * b) % n64); };
+
+    plan.N = N;
+    plan.beta = beta;
+    plan.cycleNodes.clear();
+    plan.cycleStart.assign(1, 0);
+    plan.transient.clear();
+
+    // walk every unvisited index until a known one: if the walk closed on itself it found a new cycle
+    enum : uint8_t { unvisited, onPath, done };
+    std::vector<uint8_t> state(n, unvisited);
+    std::vector<uint32_t> depth(n, 0);
+    std::vector<uint32_t> path;
+    for (uint32_t start = 0; start < n; ++start) {
+        if (state[start] != unvisited)
+            continue;
+        path.clear();
+        uint32_t i = start;
+        while (state[i] == unvisited) {
+            state[i] = onPath;
+            path.push_back(i);
+            i = next(i);
+        }
+        size_t tail = path.size();
+        if (state[i] == onPath) {
+            tail = static_cast<size_t>(std::find(path.begin(), path.end(), i) - path.begin());
+            for (size_t k = tail; k < path.size(); ++k) {
+                plan.cycleNodes.push_back(path[k]);
+                depth[path[k]] = 0;
+                state[path[k]] = done;
+            }
+            plan.cycleStart.push_back(static_cast<uint32_t>(plan.cycleNodes.size()));
+        }
+        for (size_t k = tail; k-- > 0;) {
+            depth[path[k]] = depth[next(path[k])] + 1;
+            state[path[k]] = done;
+            plan.transient.push_back(path[k]);
+        }
+    }
+    std::stable_sort(plan.transient.begin(), plan.transient.end(),
+                     [&](uint32_t a, uint32_t c) { return depth[a] < depth[c]; });
+}
+
+int fractalizeInfiniteUnits(const OrbitPlan& plan) {
+    return plan.N + static_cast<int>(plan.cycleNodes.size());
+}
+
+void fractalizeInfinitePiece(const OrbitPlan& plan, float alpha, const float* g, float* f,
+                             InfiniteSeriesCarry& carry, int begin, int end) {
+    // units: a cycle of length L starting at cycleNodes[s] has [2 s, 2 s + 2 L) - L to sum it up,
+    //   L to go back through it - then one per transient
+    const size_t numCycles = plan.cycleStart.size() - 1;
+    const int cycleUnits = 2 * static_cast<int>(plan.cycleStart[numCycles]);
+    if (begin < cycleUnits) {
+        size_t c = static_cast<size_t>(std::upper_bound(plan.cycleStart.begin(), plan.cycleStart.end(),
+                                                        static_cast<uint32_t>(begin / 2)) - plan.cycleStart.begin()) - 1;
+        for (int u = begin; u < std::min(end, cycleUnits); ++c) {
+            const uint32_t* cycle = plan.cycleNodes.data() + plan.cycleStart[c];
+            const int L = static_cast<int>(plan.cycleStart[c + 1] - plan.cycleStart[c]);
+            const int first = 2 * static_cast<int>(plan.cycleStart[c]);
+            const int last = std::min(end, first + 2 * L);
+            for (; u < std::min(last, first + L); ++u) {
+                const int k = u - first;
+                if (k == 0) {
+                    carry.sum = 0.0f;
+                    carry.alphaPow = 1.0f;
+                }
+                carry.sum += carry.alphaPow * g[cycle[k]];
+                carry.alphaPow *= alpha;
+            }
+            for (; u < last; ++u) {
+                const int k = L - (u - first - L);  // L (the first node), then L-1 down to 1
+                if (k == L)
+                    f[cycle[0]] = carry.sum / (1.0f - carry.alphaPow);
+                else
+                    f[cycle[k]] = g[cycle[k]] + alpha * f[cycle[(k + 1) % L]];
+            }
+        }
+    }
+
+    const uint64_t n64 = static_cast<uint64_t>(plan.N);
+    const uint64_t b = static_cast<uint64_t>(plan.beta) % n64;
+    const int from = std::max(begin, cycleUnits) - cycleUnits, to = std::max(end, cycleUnits) - cycleUnits;
+    for (int k = from; k < to; ++k) {
+        const uint32_t i = plan.transient[static_cast<size_t>(k)];
+        f[i] = g[i] + alpha * f[(i * b) % n64];
+    }
+}
+
+void fractalizeInfinite(const OrbitPlan& plan, float alpha, const float* g, float* f) {
+    InfiniteSeriesCarry carry;
+    fractalizeInfinitePiece(plan, alpha, g, f, carry, 0, fractalizeInfiniteUnits(plan));
+}
+
+void defractalizeInfinitePiece(int N, int beta, float alpha, const float* f, float* g, int begin, int end) {
+    gatherPass(g, f, f, -alpha, static_cast<uint32_t>(static_cast<uint64_t>(beta) % static_cast<uint64_t>(N)),
+               N, begin, end);
+}
+
+void defractalizeInfinite(int N, int beta, float alpha, const float* f, float* g) {
+    defractalizeInfinitePiece(N, beta, alpha, f, g, 0, N);
+}
+
+
+int closedFormRefinements(float alpha, int numTerms, float tolerance) {
+    const double tailLog = static_cast<double>(numTerms) * std::log(static_cast<double>(alpha));  // log(\alpha^K)
+    if (alpha <= 0.0f || tailLog < std::log(static_cast<double>(tolerance)))
+        return 0;
+    return static_cast<int>(std::ceil(std::log(static_cast<double>(tolerance)) / tailLog)) - 1;
+}
+
+int defractalizeClosedFormUnits(int N, int refinements) {
+    return N * (refinements + 1);
+}
+
+void defractalizeClosedFormPiece(const float* f, float* g, float* scratch,
+                                 int N, int beta, float alpha, int numTerms, int refinements, int begin, int end) {
+    const uint64_t n64 = static_cast<uint64_t>(N);
+    const uint64_t b = static_cast<uint64_t>(beta) % n64;
+
+    // \alpha^K and M^K
+    float tailWeight = 1.0f;
+    uint64_t tailStep = 1 % n64;
+    for (int n = 0; n < numTerms; ++n) {
+        tailWeight *= alpha;
+        tailStep = (tailStep * b) % n64;
+    }
+
+    // refinement step s reads the previous step's h (f for the first one), the last pass reads the last h
+    float* buffers[2] = {scratch, scratch + N};
+    for (int step = 0; step < refinements; ++step) {
+        const float* h = step == 0 ? f : buffers[(step - 1) & 1];
+        runPassPiece(step, N, begin, end, [&](int from, int to) {
+            gatherPass(buffers[step & 1], f, h, tailWeight, static_cast<uint32_t>(tailStep), N, from, to);
+        });
+    }
+    const float* h = refinements == 0 ? f : buffers[(refinements - 1) & 1];
+    runPassPiece(refinements, N, begin, end, [&](int from, int to) {
+        gatherPass(g, h, h, -alpha, static_cast<uint32_t>(b), N, from, to);
+    });
+}
+
+void defractalizeClosedForm(const float* f, float* g, float* scratch,
+                            int N, int beta, float alpha, int numTerms, int refinements) {
+    defractalizeClosedFormPiece(f, g, scratch, N, beta, alpha, numTerms, refinements,
+                                0, defractalizeClosedFormUnits(N, refinements));
+}
+
+
+FractalEngine chooseFractalEngine(const GatherPlan& plan, int numTerms) {
+    const size_t doublingCost = static_cast<size_t>(doublingPasses(numTerms)) * static_cast<size_t>(plan.N);
+    return doublingCost < plan.nonZeros() ? FractalEngine::doubling : FractalEngine::gather;
+}
+}  // namespace audio_plugin
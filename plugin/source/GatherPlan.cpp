@@ -0,0 +1,77 @@
+#include "Bifractalizer/GatherPlan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+
+namespace audio_plugin {
+void buildGatherPlan(GatherPlan& plan, int N, int beta, const std::vector<float>& termWeights) {
+    const size_t numTerms = termWeights.size();
+    const uint64_t n64 = static_cast<uint64_t>(N);
+    const uint64_t betaModN = static_cast<uint64_t>(beta) % n64;
+
+    plan.N = N;
+    plan.maxRowLength = 0;
+    plan.compactIndices = N <= 65536;
+    plan.rowStart.assign(static_cast<size_t>(N) + 1, 0);
+    plan.indices16.clear();
+    plan.indices32.clear();
+    plan.weights.clear();
+    if (plan.compactIndices)
+        plan.indices16.reserve(static_cast<size_t>(N) * numTerms);
+    else
+        plan.indices32.reserve(static_cast<size_t>(N) * numTerms);
+    plan.weights.reserve(static_cast<size_t>(N) * numTerms);
+
+    std::vector<std::pair<uint32_t, float>> row(numTerms);
+    for (int i = 0; i < N; ++i) {
+        // (\beta^n i) mod N without ever leaving integers
+        uint64_t j = static_cast<uint64_t>(i);
+        for (size_t n = 0; n < numTerms; ++n) {
+            row[n] = {static_cast<uint32_t>(j), termWeights[n]};
+            j = (j * betaModN) % n64;
+        }
+        std::sort(row.begin(), row.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        int rowLength = 0;
+        for (size_t n = 0; n < numTerms;) {
+            const uint32_t idx = row[n].first;
+            float w = 0.0f;
+            for (; n < numTerms && row[n].first == idx; ++n)
+                w += row[n].second;
+            if (std::abs(w) < std::numeric_limits<float>::min())  // alpha == 0
+                continue;
+            if (plan.compactIndices)
+                plan.indices16.push_back(static_cast<uint16_t>(idx));
+            else
+                plan.indices32.push_back(idx);
+            plan.weights.push_back(w);
+            ++rowLength;
+        }
+        plan.rowStart[static_cast<size_t>(i) + 1] = static_cast<uint32_t>(plan.weights.size());
+        plan.maxRowLength = std::max(plan.maxRowLength, rowLength);
+    }
+}
+
+
+template <typename Index>
+static void gather(const uint32_t* rowStart, const Index* indices, const float* weights,
+                   int N, const float* g, float* f) {
+    for (int i = 0; i < N; ++i) {
+        float sum = 0.0f;
+        for (uint32_t k = rowStart[i]; k < rowStart[i + 1]; ++k)
+            sum += weights[k] * g[indices[k]];
+        f[i] = sum;
+    }
+}
+
+void applyGatherPlan(const GatherPlan& plan, const float* g, float* f) {
+    if (plan.compactIndices)
+        gather(plan.rowStart.data(), plan.indices16.data(), plan.weights.data(), plan.N, g, f);
+    else
+        gather(plan.rowStart.data(), plan.indices32.data(), plan.weights.data(), plan.N, g, f);
+}
+}  // namespace audio_plugin
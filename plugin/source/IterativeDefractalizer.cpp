@@ -0,0 +1,89 @@
+#include "Bifractalizer/IterativeDefractalizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+
+namespace audio_plugin {
+void IterativeDefractalizer::prepare(int newN, int numChannels) {
+    if (newN == N && static_cast<int>(previous.size()) == numChannels)
+        return;
+    N = newN;
+    const size_t n = static_cast<size_t>(N);
+    previous.assign(static_cast<size_t>(numChannels), std::vector<float>(n, 0.0f));
+    Ax.assign(n, 0.0f);
+    residual.assign(n, 0.0f);
+}
+
+void IterativeDefractalizer::forget(int channel) {
+    if (channel >= 0 && channel < static_cast<int>(previous.size()))
+        std::fill(previous[static_cast<size_t>(channel)].begin(), previous[static_cast<size_t>(channel)].end(), 0.0f);
+}
+
+
+int IterativeDefractalizer::solve(const GatherPlan& plan, const SlicedGatherPlan& sliced, KernelLevel kernelLevel,
+                                  int beta, float alpha, const float* f, float* g, int channel,
+                                  float tolerance, int maxIterations) {
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t n64 = static_cast<uint64_t>(N);
+    const uint64_t b = static_cast<uint64_t>(beta) % n64;
+    float* x = previous[static_cast<size_t>(channel)].data();
+    const float* xs[] = {x};
+    float* Axs[] = {Ax.data()};
+
+    double fNorm2 = 0.0;
+    for (int i = 0; i < N; ++i)
+        fNorm2 += static_cast<double>(f[i]) * static_cast<double>(f[i]);
+    // a residual measured in float doesn't get much below 1e-7 of ||f||, whatever the iterations
+    const double reachable = std::max(static_cast<double>(tolerance), static_cast<double>(residualFloor));
+    const double target2 = reachable * reachable * fNorm2;
+    const double noise2 = 1e4 * static_cast<double>(residualFloor) * static_cast<double>(residualFloor) * fNorm2;
+
+    int iterations = 0;
+    double rNorm2 = 0.0, previousNorm2 = 0.0;
+    for (;;) {
+        applyFractalKernel(plan, sliced, xs, Axs, 1, kernelLevel);
+        rNorm2 = 0.0;
+        for (int i = 0; i < N; ++i) {
+            const float r = f[i] - Ax[static_cast<size_t>(i)];
+            residual[static_cast<size_t>(i)] = r;
+            rNorm2 += static_cast<double>(r) * static_cast<double>(r);
+        }
+        if (rNorm2 <= target2 || iterations == maxIterations)
+            break;
+        // stuck in the rounding noise (high \alpha): more iterations would only burn the budget. Far above it
+        //   a slow start (\alpha near 1) isn't stuck
+        if (iterations > 0 && rNorm2 <= noise2 && rNorm2 >= 0.98 * previousNorm2)
+            break;
+        previousNorm2 = rNorm2;
+
+        // x += r - \alpha r∘M
+        uint64_t j = 0;
+        for (int i = 0; i < N; ++i) {
+            x[i] += residual[static_cast<size_t>(i)] - alpha * residual[j];
+            j += b;
+            if (j >= n64)
+                j -= n64;
+        }
+        ++iterations;
+    }
+    std::memcpy(g, x, sizeof(float) * static_cast<size_t>(N));
+    lastResidual = fNorm2 > 0.0 ? static_cast<float>(std::sqrt(rNorm2 / fNorm2)) : 0.0f;
+
+    // one residual evaluation + one update ~ one iteration
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double perIteration = elapsed / (iterations + 1);
+    secondsPerIteration = secondsPerIteration > 0.0 ? 0.9 * secondsPerIteration + 0.1 * perIteration
+                                                    : perIteration;
+    return iterations;
+}
+
+int IterativeDefractalizer::iterationsForBudget(double budgetSeconds, int minIterations, int maxIterations) const {
+    if (secondsPerIteration <= 0.0)
+        return maxIterations;
+    const double fits = budgetSeconds / secondsPerIteration - 1.0;  // minus the final residual check
+    return std::clamp(static_cast<int>(fits), minIterations, maxIterations);
+}
+}  // namespace audio_plugin
@@ -0,0 +1,278 @@
+#include "Bifractalizer/OfflineRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+
+namespace audio_plugin {
+namespace {
+std::unique_ptr<AudioPluginAudioProcessor> preparedInstance(const ProcessorFactory& makeProcessor,
+                                                            const OfflineRenderOptions& options) {
+    auto instance = makeProcessor();
+    instance->setNonRealtime(true);
+    instance->setPlayConfigDetails(options.numChannels, options.numChannels, options.sampleRate,
+                                   options.hostBlockSize);
+    instance->prepareToPlay(options.sampleRate, options.hostBlockSize);
+    return instance;
+}
+
+
+// A block of silence, which offline waits for the instance's operator (in the cache from then on)
+void waitForOperator(AudioPluginAudioProcessor& instance, int numChannels, int hostBlockSize) {
+    juce::AudioBuffer<float> silence(numChannels, hostBlockSize);
+    juce::MidiBuffer midiBuffer;
+    for (int fed = 0; fed < instance.getBlockSize(); fed += hostBlockSize) {
+        silence.clear();
+        instance.processBlock(silence, midiBuffer);
+    }
+}
+
+
+// Output samples [start, end) into output, from an instance fed with the input from feedStart on
+//   (its first callback firstCallback samples long)
+void renderSegment(AudioPluginAudioProcessor& instance, const OfflineRenderOptions& options, int64_t feedStart,
+                   int firstCallback, int64_t start, int64_t end, const SampleReader& read,
+                   juce::AudioBuffer<float>& output) {
+    const int64_t latency = instance.getLatencySamples();
+    juce::AudioBuffer<float> block(options.numChannels, options.hostBlockSize);
+    juce::MidiBuffer midiBuffer;
+    const int64_t feedEnd = end + latency;
+    for (int64_t pos = feedStart; pos < feedEnd;) {
+        const int size = static_cast<int>(std::min<int64_t>(pos == feedStart ? firstCallback : options.hostBlockSize,
+                                                            feedEnd - pos));
+        block.setSize(options.numChannels, size, false, false, true);
+        read(block.getArrayOfWritePointers(), pos, size);
+        instance.processBlock(block, midiBuffer);
+
+        // the callback gave output samples [pos - latency, pos - latency + size)
+        const int64_t from = std::max(pos - latency, start);
+        const int64_t to = std::min(pos - latency + size, end);
+        if (to > from)
+            for (int ch = 0; ch < options.numChannels; ++ch)
+                output.copyFrom(ch, static_cast<int>(from - start), block, ch, static_cast<int>(from - (pos - latency)),
+                                static_cast<int>(to - from));
+        pos += size;
+    }
+}
+}  // namespace
+
+
+OfflineRenderStats renderOffline(const ProcessorFactory& makeProcessor, const OfflineRenderOptions& options,
+                                 const SampleReader& read, const SampleWriter& write) {
+    const auto started = std::chrono::steady_clock::now();
+    OfflineRenderStats stats;
+    if (options.numSamples <= 0 || options.numChannels <= 0 || options.hostBlockSize <= 0)
+        return stats;
+
+    // one instance finds the block grid and waits for the operator, the others then find it in the cache
+    int N = 0, offset = 0;
+    {
+        auto probe = preparedInstance(makeProcessor, options);
+        N = probe->getBlockSize();
+        offset = probe->getBlockOffset();
+        waitForOperator(*probe, options.numChannels, options.hostBlockSize);
+        stats.missedOperators += probe->getMissedOperators();
+    }
+
+    // segment k > 0 starts on the block boundary k length + N - offset, its instance is fed from k length
+    //   (a multiple of N: the instance's blocks are the file's) and its first block is dropped
+    const int64_t blocksPerSegment = std::clamp<int64_t>((options.segmentSamples + N / 2) / N, 1, (1 << 26) / N + 1);
+    const int64_t length = blocksPerSegment * N;
+    auto segmentStart = [&](int64_t k) {
+        return k == 0 ? 0 : std::min(k * length + N - offset, options.numSamples);
+    };
+    int64_t count = 1;
+    while (segmentStart(count) < options.numSamples)
+        ++count;
+
+    int threads = options.numThreads > 0 ? options.numThreads : static_cast<int>(std::thread::hardware_concurrency());
+    threads = static_cast<int>(std::clamp<int64_t>(threads, 1, count));
+    const int64_t window = 2 * threads;  // segments rendered but not written yet, at most
+
+    struct Segment {
+        juce::AudioBuffer<float> output;
+        bool done = false;
+    };
+    std::vector<Segment> segments(static_cast<size_t>(count));
+    std::mutex mutex;
+    std::condition_variable changed;
+    int64_t next = 0, written = 0;
+
+    auto worker = [&] {
+        for (;;) {
+            int64_t k = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return next >= count || next < written + window; });
+                if (next >= count)
+                    return;
+                k = next++;
+            }
+            const int64_t start = segmentStart(k), end = segmentStart(k + 1);
+            juce::AudioBuffer<float> output(options.numChannels, static_cast<int>(end - start));
+            int missed = 0;
+            {
+                auto instance = preparedInstance(makeProcessor, options);
+                // past k > 0's first callback the gain has settled, and that callback only brings dropped output
+                renderSegment(*instance, options, k == 0 ? 0 : k * length,
+                              k == 0 ? options.hostBlockSize : std::min(options.hostBlockSize, N),
+                              start, end, read, output);
+                missed = instance->getMissedOperators();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.missedOperators += missed;
+                segments[static_cast<size_t>(k)].output = std::move(output);
+                segments[static_cast<size_t>(k)].done = true;
+            }
+            changed.notify_all();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t)
+        pool.emplace_back(worker);
+
+    for (int64_t k = 0; k < count; ++k) {
+        juce::AudioBuffer<float> output;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return segments[static_cast<size_t>(k)].done; });
+            output = std::move(segments[static_cast<size_t>(k)].output);
+            segments[static_cast<size_t>(k)].output = juce::AudioBuffer<float>();
+        }
+        write(output.getArrayOfReadPointers(), segmentStart(k), output.getNumSamples());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++written;
+        }
+        changed.notify_all();
+    }
+    for (std::thread& thread : pool)
+        thread.join();
+
+    stats.segments = static_cast<int>(count);
+    stats.threads = threads;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return stats;
+}
+
+
+OfflineBatchStats renderBatch(const std::vector<OfflineBatchJob>& jobs, int hostBlockSize, int numThreads) {
+    using Clock = std::chrono::steady_clock;
+    const auto started = Clock::now();
+    auto secondsSince = [](Clock::time_point from) {
+        return std::chrono::duration<double>(Clock::now() - from).count();
+    };
+    OfflineBatchStats stats;
+    stats.files = static_cast<int>(jobs.size());
+    if (jobs.empty() || hostBlockSize <= 0)
+        return stats;
+
+    // what the operator depends on (offline the quality is always Exact and the refinement steps 2)
+    using OperatorKey = std::tuple<int, float, int, bool, bool, int>;
+    auto operatorOf = [](const OfflineBatchJob& job) {
+        const OperatorSettings& settings = job.operatorSettings;
+        return OperatorKey(settings.N, settings.alpha, settings.beta, settings.defractalize, settings.infiniteSeries,
+                           settings.solver);
+    };
+    std::map<OperatorKey, int> groupOf;
+    std::vector<std::pair<int, size_t>> order;  // (group, job), a group's jobs one after another
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        const int group = groupOf.emplace(operatorOf(jobs[j]), static_cast<int>(groupOf.size())).first->second;
+        order.emplace_back(group, j);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    stats.operators = static_cast<int>(groupOf.size());
+    std::vector<std::once_flag> built(groupOf.size());
+
+    int threads = numThreads > 0 ? numThreads : static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::clamp(threads, 1, static_cast<int>(jobs.size()));
+    stats.threads = threads;
+
+    std::atomic<size_t> next{0};
+    std::mutex statsMutex;
+    auto worker = [&] {
+        OfflineBatchStats mine;
+        for (size_t i = next.fetch_add(1); i < order.size(); i = next.fetch_add(1)) {
+            const auto [group, j] = order[i];
+            const OfflineBatchJob& job = jobs[j];
+
+            auto stage = Clock::now();
+            juce::AudioBuffer<float> clip;
+            const bool loaded = job.load(clip) && clip.getNumChannels() > 0;
+            mine.loadSeconds += secondsSince(stage);
+            if (!loaded) {
+                ++mine.failed;
+                continue;
+            }
+
+            // the group's first job builds the operator, the others wait here for it
+            stage = Clock::now();
+            std::call_once(built[static_cast<size_t>(group)], [&] {
+                OfflineRenderOptions probeOptions;
+                probeOptions.sampleRate = job.sampleRate;
+                probeOptions.numChannels = clip.getNumChannels();
+                probeOptions.hostBlockSize = hostBlockSize;
+                auto probe = preparedInstance(job.makeProcessor, probeOptions);
+                waitForOperator(*probe, probeOptions.numChannels, hostBlockSize);
+                mine.missedOperators += probe->getMissedOperators();
+            });
+            mine.operatorSeconds += secondsSince(stage);
+
+            stage = Clock::now();
+            OfflineRenderOptions options;
+            options.sampleRate = job.sampleRate;
+            options.numChannels = clip.getNumChannels();
+            options.numSamples = clip.getNumSamples();
+            options.hostBlockSize = hostBlockSize;
+            auto instance = preparedInstance(job.makeProcessor, options);
+            mine.prepareSeconds += secondsSince(stage);
+
+            stage = Clock::now();
+            juce::AudioBuffer<float> output(options.numChannels, clip.getNumSamples());
+            const SampleReader read = [&clip](float* const* channels, int64_t start, int count) {
+                for (int ch = 0; ch < clip.getNumChannels(); ++ch)
+                    for (int s = 0; s < count; ++s)
+                        channels[ch][s] = start + s < clip.getNumSamples()
+                            ? clip.getSample(ch, static_cast<int>(start + s)) : 0.0f;
+            };
+            renderSegment(*instance, options, 0, hostBlockSize, 0, options.numSamples, read, output);
+            mine.missedOperators += instance->getMissedOperators();
+            instance.reset();
+            mine.renderSeconds += secondsSince(stage);
+
+            stage = Clock::now();
+            if (!job.save(output))
+                ++mine.failed;
+            mine.saveSeconds += secondsSince(stage);
+            mine.audioSeconds += static_cast<double>(clip.getNumSamples()) / job.sampleRate;
+        }
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.failed += mine.failed;
+        stats.missedOperators += mine.missedOperators;
+        stats.audioSeconds += mine.audioSeconds;
+        stats.loadSeconds += mine.loadSeconds;
+        stats.operatorSeconds += mine.operatorSeconds;
+        stats.prepareSeconds += mine.prepareSeconds;
+        stats.renderSeconds += mine.renderSeconds;
+        stats.saveSeconds += mine.saveSeconds;
+    };
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t)
+        pool.emplace_back(worker);
+    for (std::thread& thread : pool)
+        thread.join();
+
+    stats.seconds = secondsSince(started);
+    return stats;
+}
+}  // namespace audio_plugin
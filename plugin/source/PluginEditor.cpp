@@ -18,6 +18,7 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor(
         processorRef.getAPVTS(), "alpha", alphaSlider)),
       betaAttachment(new juce::AudioProcessorValueTreeState::SliderAttachment(
         processorRef.getAPVTS(), "beta", betaSlider))   {
+  processorRef.setEditorOpen(true);
 
   backgroundImage = juce::ImageCache::getFromMemory(
       BinaryData::background_jpg,          // Resource name (auto-generated)
@@ -78,6 +79,7 @@ void AudioPluginAudioProcessorEditor::setupKnob(juce::Slider& slider, float min,
 }
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor() {
+  processorRef.setEditorOpen(false);
   freqSlider.setLookAndFeel(nullptr);
   phaseSlider.setLookAndFeel(nullptr);
   gainSlider.setLookAndFeel(nullptr);
@@ -1,7 +1,8 @@
 #include "Bifractalizer/PluginProcessor.h"
 #include "Bifractalizer/PluginEditor.h"
-#include "bifractalizer.cpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 
 #include <juce_audio_basics/juce_audio_basics.h>
@@ -17,11 +18,25 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
 #endif
               .withOutput("Output", juce::AudioChannelSet::stereo(), true)
 #endif
-      ), apvts(*this, nullptr, "Parameters", createParameters()),
-      defrSolver() {
+      ), apvts(*this, nullptr, "Parameters", createParameters()) {
+  for (auto& helper : batchHelpers)
+    helper = std::make_unique<WorkerPool::Job>([this] { runBatchBlocks(); });
+  for (auto& helper : solveHelpers)
+    helper = std::make_unique<WorkerPool::Job>([this] { runSolveChunks(); });
 }
 
-AudioPluginAudioProcessor::~AudioPluginAudioProcessor() {}
+AudioPluginAudioProcessor::~AudioPluginAudioProcessor() {
+  // nothing of this instance may run on the pool once it's gone
+  workerPool.retract(offloadJob);
+  for (auto& helper : batchHelpers)
+    workerPool.retract(*helper);
+  for (auto& helper : solveHelpers)
+    workerPool.retract(*helper);
+  workerPool.retract(prewarmJob);
+  workerPool.retract(defrBuildJob);
+  if (liveDefractalizer != nullptr)
+    defrHandover.retire(liveDefractalizer);  // freed by defrHandover
+}
 
 juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::createParameters() {
   juce::AudioProcessorValueTreeState::ParameterLayout params;
@@ -29,7 +44,7 @@ juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::c
   params.add(std::make_unique<juce::AudioParameterFloat>(
       "frequency",
       "Frequency",
-      juce::NormalisableRange<float>(20.0f, 350.0f, 0.1f),
+      juce::NormalisableRange<float>(minFrequency, 350.0f, 0.1f),
       93.8f,
       juce::AudioParameterFloatAttributes().withLabel("frequency")
   ));
@@ -70,6 +85,52 @@ juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::c
       "Beta",
       2, 8, 2
   ));
+
+  params.add(std::make_unique<juce::AudioParameterChoice>(
+      "series",
+      "Series",
+      juce::StringArray {"Truncated", "Infinite"}, 
+      0
+  ));
+
+  // how many terms of the truncated series are evaluated: Draft drops terms with \alpha^n < 1e-3,
+  //   Normal - below 1e-7 (float precision), Exact keeps all of them
+  params.add(std::make_unique<juce::AudioParameterChoice>(
+      "quality",
+      "Quality",
+      juce::StringArray {"Draft", "Normal", "Exact"}, 
+      1
+  ));
+
+  // Closed form inverts the operator directly in O(N), Sparse LU factorizes the matrix in the background
+  //   (with COLAMD, AMD or no reordering), Block LU factorizes every orbit component separately,
+  //   Iterative refines the previous block's solution within a CPU budget, Dense LU factorizes it as a dense matrix.
+  //   Auto times them all for the current N, alpha, beta and quality and keeps the fastest accurate one
+  params.add(std::make_unique<juce::AudioParameterChoice>(
+      "solver",
+      "Solver",
+      juce::StringArray {"Closed form", "Sparse LU", "Block LU", "Iterative",
+                         "Sparse LU (AMD)", "Sparse LU (natural)", "Dense LU", "Auto"}, 
+      autoSolver
+  ));
+
+  // mixed-precision refinement of the defractalizer's float solve (residuals in double), 0-2 steps
+  params.add(std::make_unique<juce::AudioParameterChoice>(
+      "refinement",
+      "Refinement",
+      juce::StringArray {"Off", "1 step", "2 steps"}, 
+      0
+  ));
+
+  // Spreads the work on a block over the callbacks that bring the next block in, at one block more latency,
+  //   so no callback does a whole block at once when the host's buffers are much shorter than N. Or hands
+  //   it to a realtime worker, for one block more latency too: the callbacks only copy
+  params.add(std::make_unique<juce::AudioParameterChoice>(
+      "spread",
+      "Spread",
+      juce::StringArray {"Off", "Over next block", "On a worker"}, 
+      0
+  ));
   
   return params;
 }
@@ -151,79 +212,95 @@ int closestPowerOf2(int x) {
 void AudioPluginAudioProcessor::updateCoeffs() {
   const float alpha = static_cast<float>(*apvts.getRawParameterValue("alpha"));
   const int beta = static_cast<int>(*apvts.getRawParameterValue("beta"));
+  const int quality = getQuality();
 
-  if (beta != prevBeta) {
-    max_terms = static_cast<int>(ceil(log(1000001)/log(beta)));
-  }
+  max_terms = seriesTermCount(beta, alpha, qualityTolerance(quality));
+  // Exact keeps all the terms, but nothing is more exact than float precision
+  seriesTolerance = std::max(qualityTolerance(quality), 1e-7f);
+  closedFormSteps = closedFormRefinements(alpha, max_terms, seriesTolerance);
 
   prevAlpha = alpha;
   prevBeta = beta;
+  prevQuality = quality;
 
-  beta_pow_n.resize(max_terms), weights.resize(max_terms);
-  beta_pow_n[0] = 1.0f;
-  weights[0] = 1.0f;
-  for (int n = 1; n < max_terms; ++n) {
-      beta_pow_n[n] = beta_pow_n[n-1] * beta;
-      weights[n] = weights[n-1] * alpha;
-  }
-
-  actualDefrMatrix = false;
+  // enough terms of the infinite series for float precision, for when there's no orbit plan yet
+  infiniteTerms = alpha > 0.0f
+      ? std::max(1, static_cast<int>(std::ceil(std::log(1e-7) / std::log(static_cast<double>(alpha)))))
+      : 1;
 }
 
-void AudioPluginAudioProcessor::updateBuffers(int hostBlockSize) {
-  // I am not 100% sure that these are the minimal outBufPosWrite and outBufSize possible
-  //    but they work and and empirically I couldn't find a better option 
-  
+void AudioPluginAudioProcessor::updateBuffers() {
   inBufPos = getBlockOffset();
   prevBlockOffset = inBufPos;
+  spreadMode = static_cast<int>(apvts.getRawParameterValue("spread")->load());
+  blockWork.abandon();
+  abandonOffloadedBlocks();
 
+  // The last sample of a block is due the moment it comes in, so a latency of N - 1 works for any
+  //   host block sizes (and is the least that does), spreading adds a block. The output ring holds that plus
+  //   the biggest host block, in whole blocks: the engines write a block straight into it and it never wraps
   int blockSizeVal = getBlockSize();
-  int outBufSize = static_cast<int>(std::ceil(static_cast<double>(hostBlockSize) / 
-                    blockSizeVal) + (hostBlockSize % blockSizeVal == 0 ? 0 : 1)) * blockSizeVal + inBufPos;
+  int latencyVal = blockSizeVal - 1 + (spreadMode != 0 ? blockSizeVal : 0);
+  int outBufSize = (maxHostBlockSize + blockSizeVal - 1) / blockSizeVal * blockSizeVal + latencyVal + 1;
 
   int numChannels = getTotalNumInputChannels();
-  inputBuffer.setSize(numChannels, blockSizeVal);
+  // within what prepareToPlay allocated: no reallocation on the audio thread
+  inputBuffer.setSize(numChannels, blockSizeVal, false, false, true);
   inputBuffer.clear();
-  outputBuffer.setSize(numChannels, outBufSize);
+  pendingInput.setSize(numChannels, blockSizeVal, false, false, true);
+  outputBuffer.setSize(numChannels, outBufSize, false, false, true);
   outputBuffer.clear();
 
-  outBufPosRead = 0;
-  if (hostBlockSize % (outBufSize - inBufPos) == 0)
-    outBufPosWrite = outBufPosRead;
-  else
-    outBufPosWrite = (outBufPosRead + blockSizeVal) % outBufSize;
+  // input sample s is written at s + inBufPos and read latency samples later
+  outBufPosWrite = 0;
+  outBufPosRead = outBufSize - (latencyVal - inBufPos);
+  if (outBufPosRead == outBufSize)
+    outBufPosRead = 0;
 
-  int prevProcessingN = processingN;
   //processingN = closestPowerOf2(blockSizeVal); INTERPOLATION FORTH AND BACK = 💀 💀 💀
   processingN = blockSizeVal;
-  processInBuffer.setSize(numChannels, processingN);
-  processOutBuffer.setSize(numChannels, processingN);
 
-  prevHostBlockSize = hostBlockSize;
-
-  setLatencySamples(outBufPosWrite);
+  setLatencySamples(latencyVal);
   updateHostDisplay();
-
-  if (prevProcessingN != processingN) {
-    // -~-~-~-~-~-~-~-~-~-~-~-~-~ for </de>fractalizer -~-~-~-~-~-~-~-~-~-~-~-~-
-    xGrid = linspace(0, 1.0f, processingN, false);
-    // -~-~-~-~-~-~-~-~-~-~-~-~-~- for defractalizer -~-~-~-~-~-~-~-~-~-~-~-~-~-
-    actualDefrMatrix = false;
-  }
 }
 
 void AudioPluginAudioProcessor::prepareToPlay(double sampleRate,
                                               int samplesPerBlock) {
   // Use this method as the place to do any pre-playback
   // initialisation that you need..
-  juce::ignoreUnused(sampleRate);
+
+  // everything processBlock may need, so it never allocates: N is at most sampleRate / minFrequency
+  //   and the output ring at most the biggest host block + 3 N (see updateBuffers)
+  const int maxN = static_cast<int>(std::ceil(sampleRate / static_cast<double>(minFrequency)));
+  const int numChannels = getTotalNumInputChannels();
+  maxHostBlockSize = std::max(1, samplesPerBlock);
+  inputBuffer.setSize(numChannels, maxN);
+  pendingInput.setSize(numChannels, maxN);
+  outputBuffer.setSize(numChannels, maxHostBlockSize + 3 * maxN);
+  seriesScratch.resize(3 * static_cast<size_t>(maxN));  // doubling: 3*N, closed form: 2*N
+
+  // the worker is idle from here on, whatever it was handed is forgotten
+  workerPool.retract(offloadJob);
+  toWorker.clear();
+  fromWorker.clear();
+  for (OffloadedBlock& block : offloaded) {
+    block.input.setSize(numChannels, maxN);
+    block.output.setSize(numChannels, maxN);
+    block.inFlight = block.done = false;
+    block.abandoned.store(false);
+  }
+  blockDue = -1;
+  blocksInFlight = 0;
+  workerScratch.resize(3 * static_cast<size_t>(maxN));
+  batchScratch.resize(maxBatchBlocks * seriesScratch.size());
 
   outBufPosRead = 0;    // for audio repeatability
   outputBuffer.clear(); // for audio repeatability
   prevBlockOffset = -1; // so inBufPos will be changed
   processingN = -1;
   updateCoeffs();
-  updateBuffers(samplesPerBlock);
+  updateBuffers();
+  prewarmDefractalizers();
 }
 
 void AudioPluginAudioProcessor::releaseResources() {
@@ -231,8 +308,6 @@ void AudioPluginAudioProcessor::releaseResources() {
   // spare memory, etc.
   inputBuffer.clear();
   outputBuffer.clear();
-  processInBuffer.clear();
-  processOutBuffer.clear();
 }
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported(
@@ -260,7 +335,11 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported(
 }
 
 int AudioPluginAudioProcessor::getBlockSize() const {
-  return static_cast<int>(round(getSampleRate() / *apvts.getRawParameterValue("frequency")));
+  return blockSizeFor(getSampleRate(), apvts.getRawParameterValue("frequency")->load());
+}
+
+int AudioPluginAudioProcessor::blockSizeFor(double sampleRate, float frequency) {
+  return static_cast<int>(round(sampleRate / static_cast<double>(frequency)));
 }
 
 int AudioPluginAudioProcessor::getBlockOffset() const {
@@ -269,6 +348,11 @@ int AudioPluginAudioProcessor::getBlockOffset() const {
           static_cast<float>(*apvts.getRawParameterValue("blockOffset")))) % blockSizeVal;
 }
 
+int AudioPluginAudioProcessor::getQuality() const {
+  // a bounce takes as long as it takes
+  return isNonRealtime() ? 2 : static_cast<int>(*apvts.getRawParameterValue("quality"));
+}
+
 float AudioPluginAudioProcessor::getGain() const {
   return juce::Decibels::decibelsToGain(static_cast<float>(*apvts.getRawParameterValue("gain")));
 }
@@ -306,7 +390,8 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
   juce::ignoreUnused(midiMessages);
 
   if (prevAlpha != static_cast<float>(*apvts.getRawParameterValue("alpha")) ||
-      prevBeta != static_cast<int>(*apvts.getRawParameterValue("beta"))) {
+      prevBeta != static_cast<int>(*apvts.getRawParameterValue("beta")) ||
+      prevQuality != getQuality()) {
     updateCoeffs();
   }
 
@@ -315,61 +400,102 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
 
   int hostBlockSize = buffer.getNumSamples();
   int blockSizeVal = getBlockSize();
-  int outBufSize = static_cast<int>(std::ceil(static_cast<double>(hostBlockSize) / 
-                    blockSizeVal) + (hostBlockSize % blockSizeVal == 0 ? 0 : 1)) * blockSizeVal + getBlockOffset();
   int blockOffset = getBlockOffset();
+  const bool offline = isNonRealtime();
+  solvesOffline.store(offline, std::memory_order_relaxed);
+  if (offline)
+    finishPendingBlocks();
 
   int need2UpdateBuffersPrev = need2UpdateBuffers;
   if (need2UpdateBuffers != 0) {
     // WE HAVE ADDITIONAL LATENCY ON CHANGING SETTINGS (hostBlockSize SAMPLES)
     // FOR AVOIDING CLICKS
-    updateBuffers(hostBlockSize);
+    updateBuffers();
     need2UpdateBuffers = 0;
   }
 
+  // only the settings reconfigure: host blocks of any size go through the same rings
   if (blockSizeVal != inputBuffer.getNumSamples() || 
-      outBufSize != outputBuffer.getNumSamples() ||
       prevBlockOffset != blockOffset ||
-      prevHostBlockSize != hostBlockSize) {
+      spreadMode != static_cast<int>(apvts.getRawParameterValue("spread")->load())) {
     need2UpdateBuffers = 1 + need2UpdateBuffersPrev;
     // I AM 80% SURE THAT THIS IS THE MIN VALUE POSSIBLE FOR NO CLICKS
-    buffers2Update = static_cast<int>(ceil(blockSizeVal / hostBlockSize)) + 3;
+    buffers2Update = static_cast<int>(ceil(blockSizeVal / std::max(1, hostBlockSize))) + 3;
+  }
+  if (offline) {
+    // nobody listens to a bounce as it's made: no click to hide, so the new settings apply right away
+    if (need2UpdateBuffers != 0)
+      updateBuffers();
+    need2UpdateBuffers = 0;
+    buffers2Update = 0;
   }
 
   blockSizeVal = inputBuffer.getNumSamples();
-  outBufSize = outputBuffer.getNumSamples();
+  int outBufSize = outputBuffer.getNumSamples();
+  callbackShare = 0.0;
+  callbackSeconds = 0.0;
 
   int bufPos = 0;
   while (bufPos < hostBlockSize) {
-    int samplesToProcess = std::min(blockSizeVal - inBufPos, hostBlockSize - bufPos);
+    // a host going over the block size it announced is served in pieces the output ring has room for
+    const int segmentStart = bufPos;
+    const int segmentEnd = std::min(bufPos + maxHostBlockSize, hostBlockSize);
+    while (bufPos < segmentEnd) {
+      if (inBufPos == 0 && segmentEnd - bufPos >= blockSizeVal) {
+        // a whole block inside the host buffer (every block when the host block is N and the offset 0):
+        //   the engines read it right there
+        const juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), totalNumInputChannels,
+                                             bufPos, blockSizeVal);
+        if (spreadMode == 0 || offline)
+          batchBlock(block);
+        else
+          processCustomBlock(block);
+        outBufPosWrite = (outBufPosWrite + blockSizeVal) % outBufSize;
+        bufPos += blockSizeVal;
+        continue;
+      }
 
-    for (int channel = 0; channel < totalNumInputChannels; ++channel) {
-      const float* hostBufferPtr = buffer.getReadPointer(channel, bufPos);
-      float* inputBufferPtr = inputBuffer.getWritePointer(channel, inBufPos);
-      std::memcpy(inputBufferPtr, hostBufferPtr, sizeof(float) * samplesToProcess);
-    }
+      int samplesToProcess = std::min(blockSizeVal - inBufPos, segmentEnd - bufPos);
+
+      for (int channel = 0; channel < totalNumInputChannels; ++channel) {
+        const float* hostBufferPtr = buffer.getReadPointer(channel, bufPos);
+        float* inputBufferPtr = inputBuffer.getWritePointer(channel, inBufPos);
+        std::memcpy(inputBufferPtr, hostBufferPtr, sizeof(float) * samplesToProcess);
+      }
 
-    bufPos += samplesToProcess;
-    inBufPos += samplesToProcess;
-    if (inBufPos == blockSizeVal) {
-      processCustomBlock();
-      outBufPosWrite = (outBufPosWrite + blockSizeVal) % outBufSize;
-      inBufPos = 0;
+      bufPos += samplesToProcess;
+      inBufPos += samplesToProcess;
+      if (inBufPos == blockSizeVal) {
+        runBatch();  // blocks go in order
+        processCustomBlock(inputBuffer);
+        runBatch();  // offline it was batched, and the ring fills up again from here
+        outBufPosWrite = (outBufPosWrite + blockSizeVal) % outBufSize;
+        inBufPos = 0;
+      }
     }
-  }
+    runBatch();
+    // the pending block keeps pace with the one coming in: done by the time that one is complete
+    if (spreadMode == 1)
+      runBlockWork(static_cast<int>((static_cast<int64_t>(blockWork.units()) * inBufPos + blockSizeVal - 1)
+                                    / blockSizeVal));
 
-  for (int channel = 0; channel < totalNumInputChannels; ++channel) {
-    const float* outputBufferPtr = outputBuffer.getReadPointer(channel, outBufPosRead);
-    float* hostBufferPtr = buffer.getWritePointer(channel, 0);
-    int samplesToCopy = std::min(outBufSize - outBufPosRead, hostBlockSize);
-    std::memcpy(hostBufferPtr, outputBufferPtr, sizeof(float) * samplesToCopy);
-    if (samplesToCopy < hostBlockSize) {
-      const float* outputBufferPtr_ = outputBuffer.getReadPointer(channel, 0);
-      float* hostBufferPtr_ = buffer.getWritePointer(channel, samplesToCopy);
-      std::memcpy(hostBufferPtr_, outputBufferPtr_, sizeof(float) * (hostBlockSize - samplesToCopy));
+    const int segmentSize = segmentEnd - segmentStart;
+    for (int channel = 0; channel < totalNumInputChannels; ++channel) {
+      const float* outputBufferPtr = outputBuffer.getReadPointer(channel, outBufPosRead);
+      float* hostBufferPtr = buffer.getWritePointer(channel, segmentStart);
+      int samplesToCopy = std::min(outBufSize - outBufPosRead, segmentSize);
+      std::memcpy(hostBufferPtr, outputBufferPtr, sizeof(float) * samplesToCopy);
+      if (samplesToCopy < segmentSize) {
+        const float* outputBufferPtr_ = outputBuffer.getReadPointer(channel, 0);
+        float* hostBufferPtr_ = buffer.getWritePointer(channel, segmentStart + samplesToCopy);
+        std::memcpy(hostBufferPtr_, outputBufferPtr_, sizeof(float) * (segmentSize - samplesToCopy));
+      }
     }
+    outBufPosRead = (outBufPosRead + segmentSize) % outBufSize;
   }
-  outBufPosRead = (outBufPosRead + hostBlockSize) % outBufSize;
+
+  worstCallbackShare.store(std::max(worstCallbackShare.load(), static_cast<float>(callbackShare)));
+  worstCallbackSeconds.store(std::max(worstCallbackSeconds.load(), static_cast<float>(callbackSeconds)));
 
   // ===================================== APPLY GAIN (smooth) =====================================
   const float targetGain = getGain();
@@ -385,73 +511,523 @@ void AudioPluginAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
       buffer.applyGain(0.0f);
     buffers2Update -= 1;
   }
-  prevBuffer.makeCopyOf(buffer);
 }
 
-void AudioPluginAudioProcessor::prepareDefractalizer() {
-  findDefractalizerMatrix(defrMatrix, beta_pow_n, weights, processingN, max_terms);
+std::shared_ptr<const DefractalizerBackend> AudioPluginAudioProcessor::buildDefractalizer(
+    int N, int beta, float alpha, int quality, int solver, const ProblemCallback& problemReady) {
+  const int alphaStep = static_cast<int>(std::lround(alpha * 100.0f));
+  const DefractalizerKey cacheKey{N, beta, alphaStep, quality, solver};
+  if (auto cached = operatorCache.find(cacheKey))
+    return cached;
+
+  const auto autoKey = std::make_tuple(N, beta, alphaStep, seriesTermCount(beta, alpha, qualityTolerance(quality)));
+  int knownKind = -1;
+  if (solver == autoSolver) {
+    std::lock_guard<std::mutex> lock(autoSolverMutex);
+    const auto known = autoSolverChoices.find(autoKey);
+    knownKind = known != autoSolverChoices.end() ? known->second : -1;
+  }
+  // Auto times every backend on this thread alone: the operator goes to the shared caches, where the core
+  //   (PreparedOperator) solves on one thread and real time only has the realtime workers to spare, maybe
+  //   none. Chunked solves offline only come out faster than timed
+  auto backend = acquireDefractalizerOperator(
+      cacheKey, alpha, kernelLevel, {}, autoAccuracyTarget, knownKind,
+      [&problemReady](const std::shared_ptr<const DefractalizerProblem>& problem) {
+        // the plans take a moment too: a build a newer request made pointless stops here, before the solver
+        if (WorkerPool::cancellationRequested())
+          return false;
+        if (problemReady)
+          problemReady(problem);
+        return true;
+      });
+  if (backend && solver == autoSolver) {
+    std::lock_guard<std::mutex> lock(autoSolverMutex);
+    autoSolverChoices[autoKey] = static_cast<int>(backend->kind());
+  }
+  return backend;
+}
+
+namespace {
+// A request in one word, so the audio thread can replace it while a build is reading it:
+//   N (24 bits) | beta | alphaStep | quality | solver | channels (8 bits each)
+uint64_t packDefractalizerRequest(const DefractalizerKey& key, int numChannels) {
+  auto field = [](int value, int shift) { return static_cast<uint64_t>(value & 0xff) << shift; };
+  return static_cast<uint64_t>(key.N & 0xffffff) << 40 | field(key.beta, 32) | field(key.alphaStep, 24)
+       | field(key.quality, 16) | field(key.solver, 8) | field(numChannels, 0);
+}
+
+DefractalizerKey unpackDefractalizerRequest(uint64_t request, int& numChannels) {
+  auto field = [request](int shift) { return static_cast<int>((request >> shift) & 0xff); };
+  numChannels = field(0);
+  return {static_cast<int>(request >> 40), field(32), field(24), field(16), field(8)};
+}
+}  // namespace
+
+void AudioPluginAudioProcessor::requestDefractalizer(const DefractalizerKey& key) {
+  requestedDefrKey = key;
+  defrRequest.store(packDefractalizerRequest(key, getNumInputChannels()));
+  // a build for an older request that's still running gives up at its next step
+  const bool urgent = editorOpen.load() || isNonRealtime();  // the one being edited, or a bounce waiting for it
+  workerPool.submit(defrBuildJob, urgent ? WorkPriority::high : WorkPriority::normal);
+}
+
+void AudioPluginAudioProcessor::waitForDefractalizer(const DefractalizerKey& wanted, bool plansWillDo) {
+  // a build that never finishes (it can't be factorized, say) mustn't hang the bounce: after a while
+  //   whatever is live is used, like in real time, and the block is counted (see getMissedOperators)
+  const auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+  for (;;) {
+    if (PublishedDefractalizer* fresh = defrHandover.take()) {
+      if (liveDefractalizer != nullptr)
+        defrHandover.retire(liveDefractalizer);
+      liveDefractalizer = fresh;
+    }
+    const PublishedDefractalizer* live = liveDefractalizer;
+    if (live != nullptr && live->key == wanted && (plansWillDo || !live->interim))
+      return;
+    if (std::chrono::steady_clock::now() > giveUp) {
+      missedOperators.fetch_add(1);
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
 
-  solverReady.store(false);
-  threadPool.addJob([this] {
-    defrSolver.analyzePattern(defrMatrix);
-    defrSolver.factorize(defrMatrix);
-    solverReady.store(true);
+void AudioPluginAudioProcessor::runDefractalizerBuild() {
+  defrHandover.reclaim();
+  int numChannels = 0;
+  const DefractalizerKey key = unpackDefractalizerRequest(defrRequest.load(), numChannels);
+  if (key.N <= 0)
+    return;
+
+  // everything happens here, into fresh objects: the audio thread only takes them when they're ready
+  auto publish = [this, &key, numChannels](std::shared_ptr<const DefractalizerBackend> backend, bool interim) {
+    auto fresh = std::make_unique<PublishedDefractalizer>();
+    fresh->key = key;
+    fresh->interim = interim;
+    if (backend) {
+      fresh->fractalEngine = chooseFractalEngine(backend->problem().plan, backend->problem().numTerms);
+      backend->prepareWorkspace(fresh->workspace, numChannels);
+      // a solve split into chunks (Block LU at long blocks) runs them on all cores offline, on the realtime
+      //   workers in real time
+      fresh->workspace.parallelFor = [this](int count, const std::function<void(int)>& task) {
+        if (solvesOffline.load(std::memory_order_relaxed))
+          workerPool.parallelFor(count, task);
+        else
+          solveOnRealtimeWorkers(count, task);
+      };
+      // a solve that doesn't warm start from the block before may run next to another block's (a backend
+      //   with warm starts only offline, where every block starts cold). In real time the blocks side by side
+      //   already keep the realtime workers busy, their chunks go one after another
+      fresh->blockWorkspaces.resize(maxBatchBlocks);
+      for (DefractalizerWorkspace& workspace : fresh->blockWorkspaces) {
+        backend->prepareWorkspace(workspace, numChannels);
+        workspace.parallelFor = [this](int count, const std::function<void(int)>& task) {
+          if (solvesOffline.load(std::memory_order_relaxed))
+            workerPool.parallelFor(count, task);
+          else
+            for (int i = 0; i < count; ++i)
+              task(i);
+        };
+      }
+    }
+    fresh->backend = std::move(backend);
+    defrHandover.publish(std::move(fresh));
+  };
+  auto backend = buildDefractalizer(key.N, key.beta, static_cast<float>(key.alphaStep) / 100.0f, key.quality,
+                                    key.solver, [&](const std::shared_ptr<const DefractalizerProblem>& problem) {
+    // a factorization takes a while: until then the closed form on the new plans beats the old operator
+    if (key.solver == static_cast<int>(DefractalizerKind::closedForm))
+      return;
+    std::shared_ptr<DefractalizerBackend> interim = makeDefractalizerBackend(DefractalizerKind::closedForm);
+    if (interim->prepare(problem))
+      publish(std::move(interim), true);
   });
+  if (!WorkerPool::cancellationRequested())
+    publish(std::move(backend), false);
+}
 
-  //defrSolver.setMaxIterations(max_terms*2);
-  //defrSolver.compute(defrMatrix);
-  actualDefrMatrix = true;
+void AudioPluginAudioProcessor::prewarmDefractalizers() {
+  // offline nobody turns a knob, the blocks wait for the one operator they need (a batch of clips would
+  //   otherwise build every clip's neighbours)
+  if (isNonRealtime())
+    return;
+  // the current configuration first, then its neighbours on the alpha, beta and frequency knobs
+  const float alphaStep = 0.01f;
+  // the block size one frequency step away that differs from this one: near 20 Hz a 0.1 Hz step moves N
+  //   by a dozen, near 350 Hz several steps may leave it where it is (0: none left in that direction)
+  const float frequency = apvts.getRawParameterValue("frequency")->load();
+  auto neighbourN = [&](float direction) {
+    const auto range = apvts.getParameterRange("frequency");
+    for (int step = 1;; ++step) {
+      const float f = frequency + direction * static_cast<float>(step) * range.interval;
+      if (f < range.start - 0.5f * range.interval || f > range.end + 0.5f * range.interval)
+        break;
+      const double snapped = static_cast<double>(std::clamp(f, range.start, range.end));
+      const int N = static_cast<int>(std::round(getSampleRate() / snapped));
+      if (N != processingN)
+        return N;
+    }
+    return 0;
+  };
+  {
+    std::lock_guard<std::mutex> lock(prewarmMutex);
+    prewarmSolver = static_cast<int>(apvts.getRawParameterValue("solver")->load());
+    prewarmQuality = prevQuality;
+    prewarmConfigs = {
+        {processingN, prevBeta, prevAlpha},
+        {processingN, prevBeta, std::min(prevAlpha + alphaStep, 0.9f)},
+        {processingN, prevBeta, std::max(prevAlpha - alphaStep, 0.0f)},
+        {processingN, std::min(prevBeta + 1, 8), prevAlpha},
+        {processingN, std::max(prevBeta - 1, 2), prevAlpha},
+        {neighbourN(-1.0f), prevBeta, prevAlpha},
+        {neighbourN(1.0f), prevBeta, prevAlpha}};
+  }
+  // behind every instance's rebuilds, a prewarm still under way starts over with these
+  workerPool.submit(prewarmJob, WorkPriority::background);
 }
 
-void AudioPluginAudioProcessor::processCustomBlock() {
+void AudioPluginAudioProcessor::runPrewarm() {
+  std::unique_lock<std::mutex> lock(prewarmMutex);
+  const auto configs = prewarmConfigs;
+  const int solver = prewarmSolver, quality = prewarmQuality;
+  lock.unlock();
+  for (const auto& [N, beta, alpha] : configs) {
+    if (WorkerPool::cancellationRequested())
+      return;  // superseded by a newer prepareToPlay or the processor is going away
+    if (N > 0)
+      buildDefractalizer(N, beta, alpha, quality, solver);
+  }
+}
+
+void AudioPluginAudioProcessor::processCustomBlock(const juce::AudioBuffer<float>& in) {
+  if (isNonRealtime()) {
+    // offline a block is done right away whatever the spreading, its output only needs to be there in time
+    batchBlock(in);
+    return;
+  }
+  if (spreadMode == 2) {
+    offloadBlock(in);
+    return;
+  }
+  // the engines write straight into the output ring (blocks sit at multiples of N there, so never wrap)
+  const int numChannels = getNumInputChannels();
+  float* out[BlockWork::maxChannels] = {};
+  for (int ch = 0; ch < std::min(numChannels, BlockWork::maxChannels); ++ch)
+    out[ch] = outputBuffer.getWritePointer(ch, outBufPosWrite);
+  if (spreadMode == 1) {
+    // the block before is due now: whatever the callbacks since haven't done of it happens here
+    runBlockWork(blockWork.units());
+    for (int ch = 0; ch < numChannels; ++ch)
+      pendingInput.copyFrom(ch, 0, in, ch, 0, processingN);
+    startBlockWork(blockWork, pendingInput.getArrayOfReadPointers(), out, 0, numChannels, seriesScratch.data());
+  } else {
+    startBlockWork(blockWork, in.getArrayOfReadPointers(), out, 0, numChannels, seriesScratch.data());
+    runBlockWork(blockWork.units());
+  }
+}
+
+void AudioPluginAudioProcessor::startBlockWork(BlockWork& work, const float* const* in, float* const* out,
+                                               int firstChannel, int numChannels, float* scratch, int batchSlot) {
   // ======================================================================================================
   // ========================================== AUDIO PROCESSING ==========================================
   // ======================================================================================================
-  for (int ch = 0; ch < getNumInputChannels(); ++ch) {
-    processInBuffer.copyFrom(ch, 0, inputBuffer, ch, 0, processingN);
-  }
-  
+  // blocks still on the worker may be using the live operator and its workspace: the operator stays
+  //   as it is until they're back, and only the worker's own next block may use the workspace meanwhile.
+  //   Likewise the blocks of a batch all run on the operator the first one found
+  const bool operatorIdle = blocksInFlight == 0 && batchSize == 0;
+  const bool mayUseWorkspace = blocksInFlight == 0 || spreadMode == 2;
+
+  BlockWork::Setup setup;
+  setup.N = processingN;
+  setup.beta = prevBeta;
+  setup.alpha = prevAlpha;
+  setup.numTerms = max_terms;
+  setup.closedFormSteps = closedFormSteps;
+  setup.kernelLevel = kernelLevel;
+  setup.scratch = scratch;
+  setup.firstChannel = firstChannel;
+
   if (bypass) {
-    for (int ch = 0; ch < getNumInputChannels(); ++ch)
-      processOutBuffer.copyFrom(ch, 0, processInBuffer, ch, 0, processingN);
+    setup.engine = BlockWork::Engine::copy;
   } else {
+    const bool infiniteSeries = apvts.getRawParameterValue("series")->load() == 1;
+    const int solver = static_cast<int>(apvts.getRawParameterValue("solver")->load());
+    const DefractalizerKey wanted{processingN, prevBeta, static_cast<int>(std::lround(prevAlpha * 100.0f)),
+                                  prevQuality, solver};
+    if (!(wanted == requestedDefrKey))
+      requestDefractalizer(wanted);
+    // offline nothing goes out on a stand-in: the block waits for its operator (the fractalizer only
+    //   for the plans, the infinite series defractalizer for nothing)
+    const bool forward = static_cast<int>(apvts.getRawParameterValue("mode")->load()) == 0;
+    if (isNonRealtime() && operatorIdle && (forward || !infiniteSeries))
+      waitForDefractalizer(wanted, forward);
+    // nothing runs on the live operator here (a pending block is finished before the next one starts)
+    if (PublishedDefractalizer* fresh = operatorIdle ? defrHandover.take() : nullptr) {
+      if (liveDefractalizer != nullptr)
+        defrHandover.retire(liveDefractalizer);
+      liveDefractalizer = fresh;
+    }
+    const PublishedDefractalizer* live = liveDefractalizer;
+    const DefractalizerProblem* plans = live != nullptr && live->backend ? &live->backend->problem() : nullptr;
+    // the forward plans are used only if they are exactly for these settings, the solver doesn't matter
+    const bool orbitsFit = plans != nullptr && live->key.N == processingN && live->key.beta == wanted.beta;
+    const bool plansFit = orbitsFit && live->key.alphaStep == wanted.alphaStep && live->key.quality == wanted.quality;
+    setup.plans = plans;
+
     if (apvts.getRawParameterValue("mode")->load()==0) {
-      fractalize(xGrid, processInBuffer, processOutBuffer, beta_pow_n, weights, max_terms);
-    } else {
-      if (!actualDefrMatrix && solverReady) {
-        prepareDefractalizer();
-      }
-      if (solverReady) {
-        defractalize(processInBuffer, processOutBuffer, defrMatrix, defrSolver);
+      if (infiniteSeries && orbitsFit) {
+        setup.engine = BlockWork::Engine::fractalizeInfinite;
+      } else if (infiniteSeries) {
+        setup.engine = BlockWork::Engine::fractalizeDoubling;
+        setup.numTerms = infiniteTerms;
+      } else if (plansFit && live->fractalEngine == FractalEngine::gather) {
+        setup.engine = BlockWork::Engine::fractalizeGather;
       } else {
-        for (int ch = 0; ch < getNumInputChannels(); ++ch) {
-          processOutBuffer.copyFrom(ch, 0, processInBuffer, ch, 0, processingN);
-        }
+        setup.engine = BlockWork::Engine::fractalizeDoubling;
+      }
+    } else if (infiniteSeries) {
+      setup.engine = BlockWork::Engine::defractalizeInfinite;
+    } else if (plans != nullptr && live->key.N == processingN && mayUseWorkspace) {
+      // until the new operator is there the previous one keeps running, if it fits the block size
+      setup.engine = BlockWork::Engine::defractalizeBackend;
+      setup.backend = live->backend.get();
+      setup.workspace = &liveDefractalizer->workspace;
+      // a block of its own workspace may run next to the others: any block of a backend without warm
+      //   starts, offline (cold starts) any block at all
+      const bool independent = !live->backend->keepsStateBetweenSolves() || isNonRealtime();
+      if (independent && batchSlot >= 0 &&
+          static_cast<size_t>(batchSlot) < liveDefractalizer->blockWorkspaces.size())
+        setup.workspace = &liveDefractalizer->blockWorkspaces[static_cast<size_t>(batchSlot)];
+      setup.iterationBudget = static_cast<double>(iterativeCpuBudget) * processingN / getSampleRate()
+          / getNumInputChannels();
+      setup.refinementSteps = static_cast<int>(apvts.getRawParameterValue("refinement")->load());
+      if (isNonRealtime()) {
+        setup.iterationBudget = 1.0;  // as many iterations as the solver takes
+        setup.refinementSteps = 2;
+        setup.coldStart = true;  // so a render can be cut into pieces that come out the same
+      }
+      if (spreadMode == 1 && live->backend->kind() == DefractalizerKind::closedForm && setup.refinementSteps == 0) {
+        // the same solve, but in pieces rather than a channel at a time (its residual isn't measured then)
+        setup.engine = BlockWork::Engine::defractalizeClosedForm;
+        setup.alpha = plans->alpha;
+        setup.numTerms = plans->numTerms;
+        setup.closedFormSteps = plans->closedFormSteps;
       }
+    } else {
+      // the closed form needs no preparation, so it covers for the backend until it's ready
+      //   (or until the worker gives the workspace back)
+      setup.engine = BlockWork::Engine::defractalizeClosedForm;
     }
   }
+  work.start(setup, in, out, numChannels);
 
-  for (int ch = 0; ch < getNumInputChannels(); ++ch) {
-    inputBuffer.copyFrom(ch, 0, processOutBuffer, ch, 0, processingN);
-  }
   // ======================================================================================================
   // ======================================================================================================
   // ======================================================================================================
+}
 
-  int totalNumInputChannels = inputBuffer.getNumChannels();
-  int blockSizeVal = inputBuffer.getNumSamples();
-  int outBufSize = outputBuffer.getNumSamples();
+void AudioPluginAudioProcessor::runBlockWork(int unit) {
+  if (blockWork.finished())
+    return;
+  const auto start = std::chrono::steady_clock::now();
+  const int ran = blockWork.runUntil(unit);
+  callbackSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  callbackShare += static_cast<double>(ran) / blockWork.units();
+  if (blockWork.finished())
+    storeResidual(blockWork);
+}
+
+void AudioPluginAudioProcessor::storeResidual(const BlockWork& work) {
+  // a solve that blew up went through the closed form, its residual says nothing
+  if (work.setup().engine == BlockWork::Engine::defractalizeBackend && std::isfinite(work.residual()))
+    defrResidual.store(static_cast<float>(work.residual()));
+}
+
+void AudioPluginAudioProcessor::offloadBlock(const juce::AudioBuffer<float>& in) {
+  const int numChannels = getNumInputChannels();
+  collectOffloadedBlocks();
+  writeDueBlock();
+
+  int slot = 0;
+  while (slot < numOffloadedBlocks && (offloaded[slot].inFlight || offloaded[slot].done))
+    ++slot;
+  if (slot == numOffloadedBlocks) {
+    // the worker is that far behind: this one goes out dry right away
+    for (int ch = 0; ch < numChannels; ++ch)
+      outputBuffer.copyFrom(ch, outBufPosWrite, in, ch, 0, processingN);
+    missedDeadlines.fetch_add(1);
+    return;
+  }
+
+  OffloadedBlock& block = offloaded[slot];
+  for (int ch = 0; ch < numChannels; ++ch)
+    block.input.copyFrom(ch, 0, in, ch, 0, processingN);
+  startBlockWork(block.work, block.input.getArrayOfReadPointers(), block.output.getArrayOfWritePointers(),
+                 0, numChannels, workerScratch.data());
+  block.outBufPos = outBufPosWrite;
+  block.inFlight = true;
+  block.abandoned.store(false);
+  ++blocksInFlight;
+  toWorker.push(slot);  // never full, there are no more blocks than it holds
+  workerPool.submit(offloadJob, WorkPriority::realtime);
+  blockDue = slot;
+}
+
+void AudioPluginAudioProcessor::writeDueBlock() {
+  if (blockDue < 0)
+    return;
+  OffloadedBlock& due = offloaded[blockDue];
+  const juce::AudioBuffer<float>& result = due.done ? due.output : due.input;
+  for (int ch = 0; ch < getNumInputChannels(); ++ch)
+    outputBuffer.copyFrom(ch, due.outBufPos, result, ch, 0, processingN);
+  if (due.done) {
+    due.done = false;
+  } else {
+    due.abandoned.store(true);
+    missedDeadlines.fetch_add(1);
+  }
+  blockDue = -1;
+}
+
+void AudioPluginAudioProcessor::finishPendingBlocks() {
+  runBlockWork(blockWork.units());
+  // the worker's blocks are waited for rather than dropped
+  while (blocksInFlight > 0) {
+    collectOffloadedBlocks();
+    if (blocksInFlight > 0)
+      std::this_thread::yield();
+  }
+  writeDueBlock();
+}
+
+void AudioPluginAudioProcessor::collectOffloadedBlocks() {
+  int slot = 0;
+  while (fromWorker.pop(slot)) {
+    OffloadedBlock& block = offloaded[slot];
+    block.inFlight = false;
+    block.done = !block.abandoned.load();
+    --blocksInFlight;
+  }
+}
+
+void AudioPluginAudioProcessor::abandonOffloadedBlocks() {
+  collectOffloadedBlocks();
+  for (OffloadedBlock& block : offloaded) {
+    if (block.inFlight)
+      block.abandoned.store(true);
+    block.done = false;
+  }
+  blockDue = -1;
+}
+
+void AudioPluginAudioProcessor::batchBlock(const juce::AudioBuffer<float>& in) {
+  const int numChannels = std::min(getNumInputChannels(), BlockWork::maxChannels);
+  const float* const* input = in.getArrayOfReadPointers();
+  float* out[BlockWork::maxChannels] = {};
+  for (int ch = 0; ch < numChannels; ++ch)
+    out[ch] = outputBuffer.getWritePointer(ch, outBufPosWrite);
+
+  // offline every channel is a block of its own (the channels of a block never depend on each other),
+  //   so a bounce keeps the pool busy even when the host buffers hold no more than a block
+  const int channelsPerBlock = isNonRealtime() ? 1 : numChannels;
+  for (int ch = 0; ch < numChannels; ch += channelsPerBlock) {
+    float* scratch = batchScratch.data() + static_cast<size_t>(batchSize) * seriesScratch.size();
+    startBlockWork(batch[batchSize], input + ch, out + ch, ch, channelsPerBlock, scratch, batchSize);
+    if (++batchSize == maxBatchBlocks)
+      runBatch();
+  }
+}
+
+void AudioPluginAudioProcessor::runBatch() {
+  if (batchSize == 0)
+    return;
+  const auto start = std::chrono::steady_clock::now();
+  // every block has its own output, scratch and (for a backend) workspace, unless the backend warm
+  //   starts from the block before: then they go in order.
+  // In real time only the realtime workers help: a block a normal pool worker (maybe niced) had claimed
+  //   would keep the audio thread waiting for it
+  const bool offline = isNonRealtime();
+  bool sideBySide = batchSize > 1;
+  for (int b = 0; b < batchSize; ++b) {
+    const BlockWork::Setup& setup = batch[b].setup();
+    if (setup.engine == BlockWork::Engine::defractalizeBackend &&
+        ((setup.backend->keepsStateBetweenSolves() && !setup.coldStart) ||
+         setup.workspace == &liveDefractalizer->workspace))
+      sideBySide = false;
+  }
+
+  if (sideBySide) {
+    batchDone.store(0, std::memory_order_relaxed);
+    batchClaim.store(static_cast<uint32_t>(batchSize) << 16, std::memory_order_release);
+    const int helpers = std::min(batchSize - 1, offline ? workerPool.numThreads() : workerPool.numRealtimeThreads());
+    for (int h = 0; h < helpers; ++h)
+      workerPool.submit(*batchHelpers[h], offline ? WorkPriority::realtime : WorkPriority::realtimeOnly);
+    // the calling thread takes blocks too, so it's never left waiting for a busy pool to start
+    runBatchBlocks();
+    while (batchDone.load(std::memory_order_acquire) < batchSize)
+      std::this_thread::yield();
+  } else {
+    for (int b = 0; b < batchSize; ++b) {
+      batch[b].runUntil(batch[b].units());
+      storeResidual(batch[b]);
+    }
+  }
+
+  callbackSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  callbackShare += batchSize;
+  batchSize = 0;
+}
+
+void AudioPluginAudioProcessor::runBatchBlocks() {
+  // a helper that starts late finds nothing left, or (claims are compare-and-swapped on blocks and
+  //   next together) joins the batch that's running then
+  uint32_t claim = batchClaim.load(std::memory_order_acquire);
+  while ((claim & 0xffff) < (claim >> 16)) {
+    if (!batchClaim.compare_exchange_weak(claim, claim + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+      continue;
+    BlockWork& work = batch[claim & 0xffff];
+    work.runUntil(work.units());
+    storeResidual(work);
+    batchDone.fetch_add(1, std::memory_order_release);
+    claim = batchClaim.load(std::memory_order_acquire);
+  }
+}
+
+void AudioPluginAudioProcessor::solveOnRealtimeWorkers(int count, const std::function<void(int)>& task) {
+  // one solve at a time: the live operator's workspace has one user at a time (see blocksInFlight)
+  solveTask = &task;
+  solveDone.store(0, std::memory_order_relaxed);
+  solveClaim.store(static_cast<uint32_t>(count) << 16, std::memory_order_release);
+  const int helpers = std::min({count - 1, maxSolveHelpers, workerPool.numRealtimeThreads()});
+  for (int h = 0; h < helpers; ++h)
+    workerPool.submit(*solveHelpers[h], WorkPriority::realtimeOnly);
+  runSolveChunks();
+  while (solveDone.load(std::memory_order_acquire) < count)
+    std::this_thread::yield();
+}
 
-  for (int channel = 0; channel < totalNumInputChannels; ++channel) {
-    const float* inputBufferPtr = inputBuffer.getReadPointer(channel, 0);
-    float* outputBufferPtr = outputBuffer.getWritePointer(channel, outBufPosWrite);
-    int samplesToCopy = std::min(outBufSize - outBufPosWrite, blockSizeVal);
-    std::memcpy(outputBufferPtr, inputBufferPtr, sizeof(float) * samplesToCopy);
-    if (samplesToCopy < blockSizeVal) {
-      const float* inputBufferPtr_ = inputBuffer.getReadPointer(channel, samplesToCopy);
-      float* outputBufferPtr_ = outputBuffer.getWritePointer(channel, 0);
-      std::memcpy(outputBufferPtr_, inputBufferPtr_, sizeof(float) * (blockSizeVal - samplesToCopy));
+void AudioPluginAudioProcessor::runSolveChunks() {
+  // as runBatchBlocks: a late helper finds nothing left or joins the solve that's running then
+  uint32_t claim = solveClaim.load(std::memory_order_acquire);
+  while ((claim & 0xffff) < (claim >> 16)) {
+    if (!solveClaim.compare_exchange_weak(claim, claim + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+      continue;
+    (*solveTask)(static_cast<int>(claim & 0xffff));
+    solveDone.fetch_add(1, std::memory_order_release);
+    claim = solveClaim.load(std::memory_order_acquire);
+  }
+}
+
+void AudioPluginAudioProcessor::runOffloadedBlocks() {
+  int slot = 0;
+  while (toWorker.pop(slot)) {
+    OffloadedBlock& block = offloaded[slot];
+    // one that's already late isn't worth doing, the next one may still make it
+    if (!block.abandoned.load()) {
+      block.work.runUntil(block.work.units());
+      storeResidual(block.work);
     }
+    fromWorker.push(slot);
   }
 }
 
@@ -469,6 +1045,20 @@ void AudioPluginAudioProcessor::getStateInformation(
   // You could do that either as raw data, or use the XML or ValueTree classes
   // as intermediaries to make it easy to save and load complex data.
   auto state = apvts.copyState();
+  juce::ValueTree choices("AutoSolver");
+  {
+    std::lock_guard<std::mutex> lock(autoSolverMutex);
+    for (const auto& [key, kind] : autoSolverChoices) {
+      juce::ValueTree choice("Choice");
+      choice.setProperty("N", std::get<0>(key), nullptr);
+      choice.setProperty("beta", std::get<1>(key), nullptr);
+      choice.setProperty("alpha", std::get<2>(key), nullptr);
+      choice.setProperty("terms", std::get<3>(key), nullptr);
+      choice.setProperty("solver", kind, nullptr);
+      choices.appendChild(choice, nullptr);
+    }
+  }
+  state.appendChild(choices, nullptr);
   std::unique_ptr<juce::XmlElement> xml(state.createXml());
   copyXmlToBinary(*xml, destData);
 }
@@ -479,8 +1069,24 @@ void AudioPluginAudioProcessor::setStateInformation(const void* data,
   // block, whose contents will have been created by the getStateInformation()
   // call.
   std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
-  if (xmlState.get() != nullptr)
-      apvts.replaceState(juce::ValueTree::fromXml(*xmlState));
+  if (xmlState.get() != nullptr) {
+    auto state = juce::ValueTree::fromXml(*xmlState);
+    const auto choices = state.getChildWithName("AutoSolver");
+    {
+      std::lock_guard<std::mutex> lock(autoSolverMutex);
+      for (int i = 0; i < choices.getNumChildren(); ++i) {
+        const auto choice = choices.getChild(i);
+        const int kind = choice.getProperty("solver");
+        if (kind >= 0 && kind < autoSolver)
+          autoSolverChoices[std::make_tuple(static_cast<int>(choice.getProperty("N")),
+                                            static_cast<int>(choice.getProperty("beta")),
+                                            static_cast<int>(choice.getProperty("alpha")),
+                                            static_cast<int>(choice.getProperty("terms")))] = kind;
+      }
+    }
+    state.removeChild(choices, nullptr);
+    apvts.replaceState(state);
+  }
 }
 }  // namespace audio_plugin
 
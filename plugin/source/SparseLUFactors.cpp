@@ -0,0 +1,83 @@
+#include "Bifractalizer/SparseLUFactors.h"
+
+#include <cstring>
+
+
+namespace audio_plugin {
+void SparseLUFactors::solve(const float* b, float* out, float* work) const {
+    for (int i = 0; i < n; ++i)
+        work[rowPerm[static_cast<size_t>(i)]] = b[i];
+
+    // L y = P_r b, column by column
+    for (int j = 0; j < n; ++j) {
+        const float y = work[j];
+        for (int k = lStart[static_cast<size_t>(j)]; k < lStart[static_cast<size_t>(j) + 1]; ++k)
+            work[lRows[static_cast<size_t>(k)]] -= lValues[static_cast<size_t>(k)] * y;
+    }
+    // U x = y, backwards
+    for (int j = n - 1; j >= 0; --j) {
+        const float x = work[j] / uDiagonal[static_cast<size_t>(j)];
+        work[j] = x;
+        for (int k = uStart[static_cast<size_t>(j)]; k < uStart[static_cast<size_t>(j) + 1]; ++k)
+            work[uRows[static_cast<size_t>(k)]] -= uValues[static_cast<size_t>(k)] * x;
+    }
+
+    for (int k = 0; k < n; ++k)
+        out[k] = work[colPerm[static_cast<size_t>(k)]];
+}
+
+
+size_t SparseLUFactors::memoryFootprint() const {
+    return sizeof(int) * (rowPerm.size() + colPerm.size() + lStart.size() + lRows.size() + uStart.size() + uRows.size())
+         + sizeof(float) * nonZeros();
+}
+
+
+namespace {
+bool validColumns(const std::vector<int>& start, const std::vector<int>& rows, size_t n) {
+    if (start.size() != n + 1 || start.front() != 0 || static_cast<size_t>(start.back()) != rows.size())
+        return false;
+    for (size_t j = 0; j < n; ++j)
+        if (start[j] > start[j + 1])
+            return false;
+    for (const int row : rows)
+        if (row < 0 || static_cast<size_t>(row) >= n)
+            return false;
+    return true;
+}
+}  // namespace
+
+
+std::vector<uint8_t> SparseLUFactors::serialize() const {
+    std::vector<uint8_t> data;
+    putArray(data, rowPerm);
+    putArray(data, colPerm);
+    putArray(data, lStart);
+    putArray(data, lRows);
+    putArray(data, lValues);
+    putArray(data, uStart);
+    putArray(data, uRows);
+    putArray(data, uValues);
+    putArray(data, uDiagonal);
+    return data;
+}
+
+
+bool SparseLUFactors::deserialize(const uint8_t* data, size_t size) {
+    const uint8_t* end = data + size;
+    const bool read = getArray(data, end, rowPerm) && getArray(data, end, colPerm) && getArray(data, end, lStart) &&
+                      getArray(data, end, lRows) && getArray(data, end, lValues) && getArray(data, end, uStart) &&
+                      getArray(data, end, uRows) && getArray(data, end, uValues) && getArray(data, end, uDiagonal);
+    n = static_cast<int>(rowPerm.size());
+    const size_t count = rowPerm.size();
+    bool valid = read && data == end && colPerm.size() == count && uDiagonal.size() == count &&
+                 lRows.size() == lValues.size() && uRows.size() == uValues.size() &&
+                 validColumns(lStart, lRows, count) && validColumns(uStart, uRows, count);
+    for (size_t i = 0; valid && i < count; ++i)
+        valid = rowPerm[i] >= 0 && static_cast<size_t>(rowPerm[i]) < count &&
+                colPerm[i] >= 0 && static_cast<size_t>(colPerm[i]) < count;
+    if (!valid)
+        *this = SparseLUFactors();
+    return valid;
+}
+}  // namespace audio_plugin
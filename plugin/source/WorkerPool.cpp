@@ -0,0 +1,299 @@
+#include "Bifractalizer/WorkerPool.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace audio_plugin {
+thread_local WorkerPool* WorkerPool::workerOf = nullptr;
+thread_local int WorkerPool::workerIndex = -1;
+thread_local WorkerPool::Job* WorkerPool::runningJob = nullptr;
+thread_local uint64_t WorkerPool::runningTicket = 0;
+
+
+WorkerPool::WorkerPool() : WorkerPool(Options()) {}
+
+
+WorkerPool::WorkerPool(const Options& options) {
+    int count = options.numThreads;
+    if (count <= 0)
+        count = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, 8);
+    firstRealtimeWorker = count;
+    count += std::max(options.realtimeThreads, 0);
+    local.resize(static_cast<size_t>(count));
+    threads.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+        threads.emplace_back([this, i, options] { runWorker(i, options); });
+}
+
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    for (std::atomic<uint32_t>* counter : {&wakeups, &realtimeWakeups}) {
+        counter->fetch_add(1, std::memory_order_release);
+        counter->notify_all();
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // whatever is still queued never runs: one-off jobs go, the others belong to their owners
+    std::vector<std::shared_ptr<Job>> oneOffs;
+    std::lock_guard<std::mutex> lock(mutex);
+    drainInboxLocked();
+    auto drop = [&](std::deque<Job*>& queue) {
+        for (Job* job : queue) {
+            job->queued.store(false, std::memory_order_release);
+            if (job->keepAlive)
+                oneOffs.push_back(std::move(job->keepAlive));
+        }
+        queue.clear();
+    };
+    for (auto& queue : queues)
+        drop(queue);
+    for (auto& queue : local)
+        drop(queue);
+}
+
+
+void WorkerPool::wake(WorkPriority priority) {
+    if (priority >= WorkPriority::realtime) {
+        realtimeWakeups.fetch_add(1, std::memory_order_release);
+        realtimeWakeups.notify_one();
+    }
+    if (priority == WorkPriority::realtimeOnly)
+        return;
+    // realtime work too: should the realtime workers be busy, whoever's free first takes it
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+}
+
+
+void WorkerPool::submit(Job& job, WorkPriority priority) {
+    job.priority.store(static_cast<int>(priority), std::memory_order_relaxed);
+    job.submitted.fetch_add(1, std::memory_order_acq_rel);
+    if (job.queued.exchange(true, std::memory_order_acq_rel))
+        return;  // still waiting, it runs for this submission too
+    // no ABA: the only pop takes the whole stack at once
+    job.next = inbox.load(std::memory_order_relaxed);
+    while (!inbox.compare_exchange_weak(job.next, &job, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    wake(priority);
+}
+
+
+void WorkerPool::cancel(Job& job) {
+    job.cancelledUpTo.store(job.submitted.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+
+void WorkerPool::retract(Job& job) {
+    cancel(job);
+    std::unique_lock<std::mutex> lock(mutex);
+    drainInboxLocked();
+    auto drop = [&job](std::deque<Job*>& queue) { queue.erase(std::remove(queue.begin(), queue.end(), &job), queue.end()); };
+    for (auto& queue : queues)
+        drop(queue);
+    for (auto& queue : local)
+        drop(queue);
+    job.queued.store(false, std::memory_order_release);
+    jobFinished.wait(lock, [&job] { return !job.running; });
+    job.runAgain = false;
+}
+
+
+std::shared_ptr<WorkerPool::Job> WorkerPool::post(std::function<void()> work, WorkPriority priority) {
+    auto job = std::make_shared<Job>(std::move(work));
+    job->keepAlive = job;
+    job->priority.store(static_cast<int>(priority), std::memory_order_relaxed);
+    job->submitted.store(1, std::memory_order_relaxed);
+    job->queued.store(true, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (workerOf == this)
+            local[static_cast<size_t>(workerIndex)].push_back(job.get());
+        else
+            queues[static_cast<int>(priority)].push_back(job.get());
+    }
+    wake(priority);
+    return job;
+}
+
+
+bool WorkerPool::cancellationRequested() {
+    const Job* job = runningJob;
+    return job != nullptr && (job->cancelledUpTo.load(std::memory_order_acquire) >= runningTicket ||
+                              job->submitted.load(std::memory_order_acquire) != runningTicket);
+}
+
+
+void WorkerPool::parallelFor(int count, const std::function<void(int)>& task) {
+    struct Batch {
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+    };
+    auto batch = std::make_shared<Batch>();
+    // a helper only calls task for an index it claimed, and the caller waits for all of those,
+    //   so a helper that starts after the caller returned finds nothing left and never touches task
+    auto takeChunks = [batch, &task, count] {
+        for (int i = batch->next.fetch_add(1); i < count; i = batch->next.fetch_add(1)) {
+            task(i);
+            batch->done.fetch_add(1, std::memory_order_release);
+        }
+    };
+    const WorkPriority priority = runningJob != nullptr
+        ? static_cast<WorkPriority>(runningJob->priority.load(std::memory_order_relaxed)) : WorkPriority::normal;
+    const int helpers = std::min(count - 1, numThreads());
+    for (int h = 0; h < helpers; ++h)
+        post(takeChunks, priority);
+    takeChunks();
+    while (batch->done.load(std::memory_order_acquire) < count)
+        std::this_thread::yield();
+}
+
+
+void WorkerPool::drainInboxLocked() {
+    Job* job = inbox.exchange(nullptr, std::memory_order_acquire);
+    // the stack is newest first, queue them in the order they came
+    Job* oldestFirst = nullptr;
+    while (job != nullptr) {
+        Job* next = job->next;
+        job->next = oldestFirst;
+        oldestFirst = job;
+        job = next;
+    }
+    for (job = oldestFirst; job != nullptr; job = job->next)
+        queues[job->priority.load(std::memory_order_relaxed)].push_back(job);
+}
+
+
+WorkerPool::Job* WorkerPool::pickLocked(int worker, uint64_t& ticket) {
+    for (;;) {
+        Job* job = nullptr;
+        // own chunks first unless something more urgent is queued, then the queues, then steal
+        //   (a realtime worker: realtime work only, a normal one: never realtimeOnly work)
+        const bool realtime = worker >= firstRealtimeWorker;
+        const int realtimeOnly = static_cast<int>(WorkPriority::realtimeOnly);
+        const int lowest = realtime ? static_cast<int>(WorkPriority::realtime) : 0;
+        const int highest = realtime ? realtimeOnly : realtimeOnly - 1;
+        std::deque<Job*>& own = local[static_cast<size_t>(worker)];
+        const int ownPriority = own.empty() ? -1 : own.back()->priority.load(std::memory_order_relaxed);
+        for (int p = highest; p >= lowest && job == nullptr; --p) {
+            if (ownPriority >= p) {
+                job = own.back();
+                own.pop_back();
+            } else if (!queues[p].empty()) {
+                job = queues[p].front();
+                queues[p].pop_front();
+            }
+        }
+        for (size_t i = 0; job == nullptr && !realtime && i < local.size(); ++i) {
+            if (!local[i].empty() && local[i].front()->priority.load(std::memory_order_relaxed) < realtimeOnly) {
+                job = local[i].front();
+                local[i].pop_front();
+            }
+        }
+        if (job == nullptr)
+            return nullptr;
+
+        job->queued.store(false, std::memory_order_release);  // from here a submission queues it again
+        if (job->running) {
+            job->runAgain = true;  // one thread at a time: the one running it goes again
+            continue;
+        }
+        job->running = true;
+        ticket = job->submitted.load(std::memory_order_acquire);
+        return job;
+    }
+}
+
+
+void WorkerPool::run(Job* job, uint64_t ticket) {
+    std::shared_ptr<Job> oneOff;
+    for (;;) {
+        if (job->cancelledUpTo.load(std::memory_order_acquire) < ticket) {
+            runningJob = job;
+            runningTicket = ticket;
+            job->work();
+            runningJob = nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (job->runAgain && !stopping) {
+            job->runAgain = false;
+            ticket = job->submitted.load(std::memory_order_acquire);
+            continue;
+        }
+        job->runAgain = false;
+        job->running = false;
+        oneOff = std::move(job->keepAlive);
+        break;
+    }
+    // job may be gone from here on, unless it's a one-off (then it goes with oneOff, outside the lock)
+    jobFinished.notify_all();
+}
+
+
+void WorkerPool::runWorker(int index, const Options& options) {
+    workerOf = this;
+    workerIndex = index;
+    const bool realtime = index >= firstRealtimeWorker;
+    std::atomic<uint32_t>& sleepOn = realtime ? realtimeWakeups : wakeups;
+#if defined(__linux__)
+    if (options.niceness != 0 && !realtime)
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), options.niceness);
+    const int fifoPriority = realtime ? options.realtimeFifoPriority : options.fifoPriority;
+    if (fifoPriority > 0) {
+        sched_param param{};
+        param.sched_priority = std::min(fifoPriority, sched_get_priority_max(SCHED_FIFO));
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);  // without the rights it stays as it is
+    }
+#else
+    (void)options;
+#endif
+
+    for (;;) {
+        const uint32_t seen = sleepOn.load(std::memory_order_acquire);
+        Job* job = nullptr;
+        uint64_t ticket = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+                return;
+            drainInboxLocked();
+            job = pickLocked(index, ticket);
+        }
+        if (job != nullptr)
+            run(job, ticket);
+        else
+            sleepOn.wait(seen, std::memory_order_acquire);
+    }
+}
+
+
+WorkerPool& sharedWorkerPool() {
+    static WorkerPool pool([] {
+        WorkerPool::Options options;
+        auto fromEnvironment = [](const char* name, int& value) {
+            if (const char* text = std::getenv(name))
+                value = std::atoi(text);
+        };
+        fromEnvironment("BIFRACTALIZER_WORKER_THREADS", options.numThreads);
+        fromEnvironment("BIFRACTALIZER_WORKER_NICE", options.niceness);
+        fromEnvironment("BIFRACTALIZER_WORKER_FIFO", options.fifoPriority);
+        fromEnvironment("BIFRACTALIZER_REALTIME_THREADS", options.realtimeThreads);
+        fromEnvironment("BIFRACTALIZER_REALTIME_FIFO", options.realtimeFifoPriority);
+        return options;
+    }());
+    return pool;
+}
+}  // namespace audio_plugin
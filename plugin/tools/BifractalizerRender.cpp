@@ -0,0 +1,368 @@
+// Renders audio files through the plugin without a host, offline (Exact quality, every block waits for
+//   its operator) and on all cores, bit for bit what the plugin bounces (see OfflineRenderer.h).
+//
+//   BifractalizerRender <input> <output> [--state file] [--set id=value]... [--block 4096]
+//                       [--threads n] [--segment seconds] [--bits 16|24|32]
+//   BifractalizerRender --manifest <file> [--state file] [--set id=value]... [--block 4096]
+//                       [--threads n] [--bits 16|24|32]
+//
+// WAV and AIFF, mono or stereo. --state loads a plugin state saved by a host (getStateInformation),
+//   --set then changes parameters in the knobs' units: "frequency" in Hz, "gain" in dB, choices by index
+//   ("mode=1", "solver=7"). The output has the input's length, sample rate and (unless --bits) bit depth,
+//   with the latency compensated.
+// One file is cut into segments rendered side by side: the input is read from a memory mapping where the
+//   format allows, and only a few segments of the output (--segment, 5 s by default) are held at a time.
+// A manifest lists clips, one per line: <input> <output> [id=value]... (paths relative to the manifest,
+//   quoted if they have spaces, # starts a comment), the line's settings go over --state and --set.
+//   Every clip is rendered whole on a core of its own, clips with the same operator one after another
+//   so it's built once; throughput and the time of every stage are reported at the end.
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "Bifractalizer/OfflineRenderer.h"
+#include "Bifractalizer/PluginProcessor.h"
+
+using namespace audio_plugin;
+
+using Settings = std::vector<std::pair<juce::String, float>>;
+
+
+static int usage() {
+    std::cerr << "usage: BifractalizerRender <input> <output> [--state file] [--set id=value]... [--block samples]\n"
+                 "                           [--threads n] [--segment seconds] [--bits 16|24|32]\n"
+                 "       BifractalizerRender --manifest <file> [--state file] [--set id=value]... [--block samples]\n"
+                 "                           [--threads n] [--bits 16|24|32]\n";
+    return 2;
+}
+
+static int fail(const std::string& message) {
+    std::cerr << "BifractalizerRender: " << message << std::endl;
+    return 1;
+}
+
+static bool parseSetting(const juce::String& text, Settings& settings) {
+    const int equals = text.indexOfChar('=');
+    if (equals <= 0)
+        return false;
+    settings.emplace_back(text.substring(0, equals), text.substring(equals + 1).getFloatValue());
+    return true;
+}
+
+static bool applySettings(AudioPluginAudioProcessor& processor, const Settings& settings, std::string& error) {
+    for (const auto& [id, value] : settings) {
+        juce::RangedAudioParameter* parameter = processor.getAPVTS().getParameter(id);
+        if (parameter == nullptr) {
+            error = "no parameter " + id.toStdString();
+            return false;
+        }
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    }
+    return true;
+}
+
+// base (a saved state, may be empty) with settings applied, as a state every instance can load
+static bool stateWith(const juce::MemoryBlock& base, const Settings& settings, juce::MemoryBlock& state,
+                      std::string& error) {
+    AudioPluginAudioProcessor processor;
+    if (base.getSize() > 0)
+        processor.setStateInformation(base.getData(), static_cast<int>(base.getSize()));
+    if (!applySettings(processor, settings, error))
+        return false;
+    state.reset();
+    processor.getStateInformation(state);
+    return true;
+}
+
+// instances with state loaded and settings (checked already) applied on top
+static ProcessorFactory factoryFor(std::shared_ptr<const juce::MemoryBlock> state, Settings settings = {}) {
+    return [state, settings] {
+        auto instance = std::make_unique<AudioPluginAudioProcessor>();
+        instance->setStateInformation(state->getData(), static_cast<int>(state->getSize()));
+        std::string ignored;
+        applySettings(*instance, settings, ignored);
+        return instance;
+    };
+}
+
+static bool checkSettings(AudioPluginAudioProcessor& reference, const Settings& settings, std::string& error) {
+    for (const auto& setting : settings)
+        if (reference.getAPVTS().getParameter(setting.first) == nullptr) {
+            error = "no parameter " + setting.first.toStdString();
+            return false;
+        }
+    return true;
+}
+
+// What the operator of reference's state with settings (checked already) on top comes to at sampleRate, read
+//   off reference without changing it: a manifest line is grouped without an instance of its own
+static OperatorSettings operatorSettingsOf(AudioPluginAudioProcessor& reference, const Settings& settings,
+                                           double sampleRate) {
+    juce::AudioProcessorValueTreeState& params = reference.getAPVTS();
+    auto value = [&](const char* id) {
+        float result = params.getRawParameterValue(id)->load();
+        for (const auto& [setId, setValue] : settings)
+            if (setId == id) {
+                // snapped to the parameter's range, as setValueNotifyingHost does
+                juce::RangedAudioParameter* parameter = params.getParameter(setId);
+                result = parameter->convertFrom0to1(parameter->convertTo0to1(setValue));
+            }
+        return result;
+    };
+    OperatorSettings operatorSettings;
+    operatorSettings.N = AudioPluginAudioProcessor::blockSizeFor(sampleRate, value("frequency"));
+    operatorSettings.alpha = value("alpha");
+    operatorSettings.beta = static_cast<int>(value("beta"));
+    operatorSettings.defractalize = static_cast<int>(value("mode")) != 0;
+    operatorSettings.infiniteSeries = static_cast<int>(value("series")) == 1;
+    operatorSettings.solver = static_cast<int>(value("solver"));
+    return operatorSettings;
+}
+
+// bits 0: the input's bit depth if the output format has it, else 24
+static std::unique_ptr<juce::AudioFormatWriter> openWriter(juce::AudioFormatManager& formats, const juce::File& file,
+                                                           double sampleRate, int numChannels, int bits,
+                                                           int inputBits, std::string& error) {
+    juce::AudioFormat* format = formats.findFormatForFileExtension(file.getFileExtension());
+    if (format == nullptr) {
+        error = "unknown output format " + file.getFileExtension().toStdString() + " (.wav, .aiff)";
+        return nullptr;
+    }
+    if (bits == 0)
+        bits = format->getPossibleBitDepths().contains(inputBits) ? inputBits : 24;
+    file.deleteFile();
+    std::unique_ptr<juce::FileOutputStream> stream = file.createOutputStream();
+    if (stream == nullptr) {
+        error = "can't write " + file.getFullPathName().toStdString();
+        return nullptr;
+    }
+    std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(
+        stream.get(), sampleRate, static_cast<unsigned int>(numChannels), bits, {}, 0));
+    if (writer == nullptr) {
+        error = "can't write " + std::to_string(bits) + "-bit " + format->getFormatName().toStdString();
+        return nullptr;
+    }
+    juce::ignoreUnused(stream.release());  // the writer owns it now
+    return writer;
+}
+
+
+static int renderFile(const juce::File& inputFile, const juce::File& outputFile, const ProcessorFactory& makeProcessor,
+                      OfflineRenderOptions options, double segmentSeconds, int bits) {
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+    juce::AudioFormat* inputFormat = formats.findFormatForFileExtension(inputFile.getFileExtension());
+    // mapped, the file isn't copied into memory and every thread can read it at once
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped;
+    if (inputFormat != nullptr)
+        mapped.reset(inputFormat->createMemoryMappedReader(inputFile));
+    if (mapped != nullptr && !mapped->mapEntireFile())
+        mapped.reset();
+    std::unique_ptr<juce::AudioFormatReader> streamed;
+    if (mapped == nullptr)
+        streamed.reset(formats.createReaderFor(inputFile));
+    juce::AudioFormatReader* reader = mapped != nullptr ? mapped.get() : streamed.get();
+    if (reader == nullptr)
+        return fail("can't read " + inputFile.getFullPathName().toStdString());
+    if (reader->numChannels < 1 || reader->numChannels > 2)
+        return fail("only mono and stereo files, this one has " + std::to_string(reader->numChannels) + " channels");
+
+    options.sampleRate = reader->sampleRate;
+    options.numChannels = static_cast<int>(reader->numChannels);
+    options.numSamples = reader->lengthInSamples;
+    options.segmentSamples = static_cast<int64_t>(segmentSeconds * reader->sampleRate);
+
+    std::string error;
+    std::unique_ptr<juce::AudioFormatWriter> writer = openWriter(formats, outputFile, reader->sampleRate,
+        options.numChannels, bits, static_cast<int>(reader->bitsPerSample), error);
+    if (writer == nullptr)
+        return fail(error);
+
+    std::mutex readerMutex;  // a streamed reader has one position
+    bool written = true;
+    const OfflineRenderStats stats = renderOffline(
+        makeProcessor, options,
+        [&](float* const* channels, int64_t start, int count) {
+            // silence outside the file, the reader only sees its own samples
+            const int64_t from = std::clamp<int64_t>(start, 0, reader->lengthInSamples);
+            const int64_t to = std::clamp<int64_t>(start + count, 0, reader->lengthInSamples);
+            for (int ch = 0; ch < options.numChannels; ++ch)
+                std::fill(channels[ch], channels[ch] + count, 0.0f);
+            if (to <= from)
+                return;
+            float* at[2] = {};
+            for (int ch = 0; ch < options.numChannels; ++ch)
+                at[ch] = channels[ch] + (from - start);
+            std::unique_lock<std::mutex> lock(readerMutex, std::defer_lock);
+            if (mapped == nullptr)
+                lock.lock();
+            reader->read(at, options.numChannels, from, static_cast<int>(to - from));
+        },
+        [&](const float* const* channels, int64_t, int count) {
+            written = writer->writeFromFloatArrays(channels, options.numChannels, count) && written;
+        });
+    writer.reset();  // flushes and finishes the header
+    if (!written)
+        return fail("writing " + outputFile.getFullPathName().toStdString() + " failed");
+
+    const double audioSeconds = static_cast<double>(options.numSamples) / options.sampleRate;
+    std::cout << audioSeconds << " s of audio in " << stats.seconds << " s ("
+              << (stats.seconds > 0.0 ? audioSeconds / stats.seconds : 0.0) << "x real time), "
+              << stats.segments << " segments on " << stats.threads << " threads" << std::endl;
+    if (stats.missedOperators > 0)
+        return fail(std::to_string(stats.missedOperators) + " blocks went out without their operator, it took too long");
+    return 0;
+}
+
+
+static int renderManifest(const juce::File& manifestFile, std::shared_ptr<const juce::MemoryBlock> baseState,
+                          int hostBlockSize, int numThreads, int bits) {
+    juce::StringArray lines;
+    manifestFile.readLines(lines);
+    if (lines.isEmpty())
+        return fail("can't read " + manifestFile.getFullPathName().toStdString() + " (or it's empty)");
+
+    juce::AudioFormatManager formats;  // only read from here on, the jobs share it
+    formats.registerBasicFormats();
+    std::mutex logMutex;
+    auto report = [&logMutex](const std::string& message) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        std::cerr << "BifractalizerRender: " << message << std::endl;
+    };
+
+    // the lines' settings are checked against the base state, the instances apply them on their threads
+    AudioPluginAudioProcessor reference;
+    reference.setStateInformation(baseState->getData(), static_cast<int>(baseState->getSize()));
+
+    std::vector<OfflineBatchJob> jobs;
+    int unreadable = 0;
+    for (int l = 0; l < lines.size(); ++l) {
+        const juce::String line = lines[l].upToFirstOccurrenceOf("#", false, false).trim();
+        if (line.isEmpty())
+            continue;
+        juce::StringArray tokens;
+        tokens.addTokens(line, " \t", "\"");
+        tokens.removeEmptyStrings();
+        const std::string where = manifestFile.getFileName().toStdString() + ":" + std::to_string(l + 1) + ": ";
+        Settings settings;
+        bool parsed = tokens.size() >= 2;
+        for (int t = 2; t < tokens.size() && parsed; ++t)
+            parsed = parseSetting(tokens[t], settings);
+        if (!parsed)
+            return fail(where + "expected <input> <output> [id=value]...");
+
+        const juce::File input = manifestFile.getParentDirectory().getChildFile(tokens[0].unquoted());
+        const juce::File output = manifestFile.getParentDirectory().getChildFile(tokens[1].unquoted());
+        std::string error;
+        if (!checkSettings(reference, settings, error))
+            return fail(where + error);
+
+        // just the header for now, the clip is read when its turn comes
+        std::unique_ptr<juce::AudioFormatReader> header(formats.createReaderFor(input));
+        if (header == nullptr || header->numChannels < 1 || header->numChannels > 2
+            || header->lengthInSamples > INT_MAX) {
+            report(where + "can't read " + input.getFullPathName().toStdString() + " (mono or stereo WAV/AIFF)");
+            ++unreadable;
+            continue;
+        }
+        OfflineBatchJob job;
+        job.operatorSettings = operatorSettingsOf(reference, settings, header->sampleRate);
+        job.sampleRate = header->sampleRate;
+        job.numChannels = static_cast<int>(header->numChannels);
+        job.makeProcessor = factoryFor(baseState, settings);
+        job.load = [&formats, input](juce::AudioBuffer<float>& clip) {
+            std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(input));
+            if (reader == nullptr)
+                return false;
+            clip.setSize(static_cast<int>(reader->numChannels), static_cast<int>(reader->lengthInSamples));
+            return reader->read(clip.getArrayOfWritePointers(), clip.getNumChannels(), 0, clip.getNumSamples());
+        };
+        const int inputBits = static_cast<int>(header->bitsPerSample);
+        const double sampleRate = header->sampleRate;
+        job.save = [&formats, &report, output, sampleRate, bits, inputBits](const juce::AudioBuffer<float>& clip) {
+            std::string writeError;
+            std::unique_ptr<juce::AudioFormatWriter> writer = openWriter(formats, output, sampleRate,
+                clip.getNumChannels(), bits, inputBits, writeError);
+            if (writer == nullptr) {
+                report(writeError);
+                return false;
+            }
+            return writer->writeFromFloatArrays(clip.getArrayOfReadPointers(), clip.getNumChannels(),
+                                                clip.getNumSamples());
+        };
+        jobs.push_back(std::move(job));
+    }
+
+    const OfflineBatchStats stats = renderBatch(jobs, hostBlockSize, numThreads);
+    const int failed = stats.failed + unreadable;
+    std::cout << stats.files + unreadable << " files (" << failed << " failed), " << stats.audioSeconds
+              << " s of audio in " << stats.seconds << " s: "
+              << (stats.seconds > 0.0 ? stats.files / stats.seconds : 0.0) << " files/s, "
+              << (stats.seconds > 0.0 ? stats.audioSeconds / stats.seconds : 0.0) << "x real time, "
+              << stats.operators << " operators, " << stats.threads << " threads\n"
+              << "stages (summed over the threads): load " << stats.loadSeconds << " s, operators "
+              << stats.operatorSeconds << " s, prepare " << stats.prepareSeconds << " s, render "
+              << stats.renderSeconds << " s, save " << stats.saveSeconds << " s" << std::endl;
+    if (stats.missedOperators > 0)
+        return fail(std::to_string(stats.missedOperators) + " blocks went out without their operator, it took too long");
+    return failed == 0 ? 0 : 1;
+}
+
+
+int main(int argc, char** argv) {
+    const bool manifest = argc >= 3 && std::string(argv[1]) == "--manifest";
+    if (argc < 3 || argv[2][0] == '-' || (argv[1][0] == '-' && !manifest))
+        return usage();
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;  // the parameter tree wants a message manager
+
+    std::string statePath;
+    Settings settings;
+    OfflineRenderOptions options;
+    double segmentSeconds = 5.0;
+    int bits = 0;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        const std::string option = argv[i];
+        const std::string value = argv[i + 1];
+        if (option == "--state") {
+            statePath = value;
+        } else if (option == "--set") {
+            if (!parseSetting(value, settings))
+                return usage();
+        } else if (option == "--block") {
+            options.hostBlockSize = std::atoi(value.c_str());
+        } else if (option == "--threads") {
+            options.numThreads = std::atoi(value.c_str());
+        } else if (option == "--segment" && !manifest) {
+            segmentSeconds = std::strtod(value.c_str(), nullptr);
+        } else if (option == "--bits") {
+            bits = std::atoi(value.c_str());
+        } else {
+            return usage();
+        }
+    }
+    if (argc % 2 != 1 || options.hostBlockSize <= 0 || segmentSeconds <= 0.0)
+        return usage();  // an option without its value
+
+    // applied once, then every instance gets the resulting state (Auto's solver choices included)
+    const juce::File here = juce::File::getCurrentWorkingDirectory();
+    juce::MemoryBlock saved;
+    if (!statePath.empty() && !here.getChildFile(statePath).loadFileAsData(saved))
+        return fail("can't read " + statePath);
+    auto state = std::make_shared<juce::MemoryBlock>();
+    std::string error;
+    if (!stateWith(saved, settings, *state, error))
+        return fail(error);
+
+    if (manifest)
+        return renderManifest(here.getChildFile(argv[2]), state, options.hostBlockSize, options.numThreads, bits);
+    return renderFile(here.getChildFile(argv[1]), here.getChildFile(argv[2]), factoryFor(state), options,
+                      segmentSeconds, bits);
+}
@@ -0,0 +1,111 @@
+// Fills an operator disk cache (see DefractalizerDiskCache.h) ahead of time, so a plugin pointed at the
+//   same directory (BIFRACTALIZER_OPERATOR_CACHE) never factorizes on first use.
+//
+//   PopulateOperatorCache <directory> [--rates 44100,48000] [--frequencies 93.8] [--sizes N,...]
+//                         [--betas 2,...] [--alphas 0,0.1,...] [--qualities 1] [--solvers 7]
+//
+// Block sizes are round(rate / frequency) for every pair unless --sizes lists them directly.
+// Qualities: 0 Draft, 1 Normal, 2 Exact. Solvers are the "solver" parameter choices, 7 is Auto.
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Bifractalizer/DefractalizerDiskCache.h"
+
+using namespace audio_plugin;
+
+
+static std::vector<double> parseList(const std::string& text) {
+    std::vector<double> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            values.push_back(std::strtod(item.c_str(), nullptr));
+    return values;
+}
+
+static std::vector<int> toInts(const std::vector<double>& values) {
+    std::vector<int> ints;
+    for (const double v : values)
+        ints.push_back(static_cast<int>(std::lround(v)));
+    return ints;
+}
+
+static int usage() {
+    std::cerr << "usage: PopulateOperatorCache <directory> [--rates r,...] [--frequencies hz,...] [--sizes N,...]\n"
+                 "                             [--betas b,...] [--alphas a,...] [--qualities q,...] [--solvers s,...]\n";
+    return 2;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argv[1][0] == '-')
+        return usage();
+
+    // defaults: the default frequency at the common sample rates, every beta and alpha the knobs offer
+    std::vector<double> rates = {44100.0, 48000.0, 88200.0, 96000.0};
+    std::vector<double> frequencies = {93.8};
+    std::vector<double> sizes, alphas;
+    for (int step = 0; step <= 90; step += 10)
+        alphas.push_back(step * 0.01);
+    DiskCacheGrid grid;
+    grid.betas = {2, 3, 4, 5, 6, 7, 8};
+    grid.qualities = {1};
+    grid.solvers = {static_cast<int>(DefractalizerKind::numKinds)};
+
+    for (int i = 2; i + 1 < argc; i += 2) {
+        const std::string option = argv[i];
+        const std::vector<double> values = parseList(argv[i + 1]);
+        if (option == "--rates")
+            rates = values;
+        else if (option == "--frequencies")
+            frequencies = values;
+        else if (option == "--sizes")
+            sizes = values;
+        else if (option == "--betas")
+            grid.betas = toInts(values);
+        else if (option == "--alphas")
+            alphas = values;
+        else if (option == "--qualities")
+            grid.qualities = toInts(values);
+        else if (option == "--solvers")
+            grid.solvers = toInts(values);
+        else
+            return usage();
+    }
+    if (argc % 2 != 0)
+        return usage();  // an option without its list
+
+    std::set<int> Ns;
+    for (const double N : sizes)
+        Ns.insert(static_cast<int>(std::lround(N)));
+    if (sizes.empty())
+        for (const double rate : rates)
+            for (const double frequency : frequencies)
+                if (frequency > 0.0)
+                    Ns.insert(static_cast<int>(std::lround(rate / frequency)));
+    grid.Ns.assign(Ns.begin(), Ns.end());
+    for (const double alpha : alphas)
+        grid.alphaSteps.push_back(static_cast<int>(std::lround(alpha * 100.0)));
+
+    DefractalizerDiskCache cache;
+    cache.setDirectory(argv[1]);
+    const size_t total = grid.Ns.size() * grid.betas.size() * grid.alphaSteps.size()
+                       * grid.qualities.size() * grid.solvers.size();
+    size_t done = 0;
+    // the plugin's Auto accuracy target, so the stored choice is the one it would have made
+    const int written = populateDiskCache(cache, grid, detectKernelLevel(), 1e-3f,
+        [&](const DefractalizerKey& key, bool stored) {
+            ++done;
+            std::cout << "[" << done << "/" << total << "] N=" << key.N << " beta=" << key.beta
+                      << " alpha=" << key.alphaStep * 0.01 << " quality=" << key.quality << " solver=" << key.solver
+                      << (stored ? " written" : " skipped") << std::endl;
+        });
+    std::cout << written << " operators written to " << argv[1] << std::endl;
+    return 0;
+}
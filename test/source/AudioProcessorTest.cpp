@@ -1,7 +1,110 @@
 // test/source/AudioProcessorTest.cpp
 #include <Bifractalizer/PluginProcessor.h>
+#include <Bifractalizer/FractalKernels.h>
+#include <Bifractalizer/FractalSeries.h>
+#include <Bifractalizer/BlockWork.h>
+#include <Bifractalizer/BlockDefractalizer.h>
+#include <Bifractalizer/IterativeDefractalizer.h>
+#include <Bifractalizer/DefractalizerBackends.h>
+#include <Bifractalizer/DefractalizerCache.h>
+#include <Bifractalizer/DefractalizerDiskCache.h>
+#include <Bifractalizer/WorkerPool.h>
+#include <Bifractalizer/OfflineRenderer.h>
+#include <Bifractalizer/BifractalizerCore.h>
 #include <gtest/gtest.h>
 #include <random>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <filesystem>
+#include <fstream>
+
+
+// -~-~-~-~-~-~-~-~-~-~-~-~-~-~- audio-thread allocation hook -~-~-~-~-~-~-~-~-~-~-~-~-~-~-
+// Every heap operation of a thread that has set heapForbidden is counted, the tests check the count.
+//   operator new/delete are replaced everywhere, malloc & co. where glibc lets us reach the real ones
+//   (and no sanitizer interposes them already).
+namespace audio_plugin_test {
+thread_local bool heapForbidden = false;
+std::atomic<int> forbiddenHeapCalls{0};
+
+inline void noteHeapCall() {
+    if (heapForbidden)
+        forbiddenHeapCalls.fetch_add(1);
+}
+}  // namespace audio_plugin_test
+
+void* operator new(std::size_t size) {
+    audio_plugin_test::noteHeapCall();
+    if (void* p = std::malloc(size != 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    audio_plugin_test::noteHeapCall();
+    return std::malloc(size != 0 ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    audio_plugin_test::noteHeapCall();
+    const std::size_t align = std::max(static_cast<std::size_t>(alignment), sizeof(void*));
+    if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void operator delete(void* p) noexcept {
+    if (p != nullptr)
+        audio_plugin_test::noteHeapCall();
+    std::free(p);
+}
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete(void* p, std::align_val_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { operator delete(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { operator delete(p); }
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+extern "C" {
+void* __libc_malloc(std::size_t);
+void* __libc_calloc(std::size_t, std::size_t);
+void* __libc_realloc(void*, std::size_t);
+void* __libc_memalign(std::size_t, std::size_t);
+void __libc_free(void*);
+
+// Eigen (and the C library) allocate through these, not through operator new
+void* malloc(std::size_t size) {
+    audio_plugin_test::noteHeapCall();
+    return __libc_malloc(size);
+}
+void* calloc(std::size_t count, std::size_t size) {
+    audio_plugin_test::noteHeapCall();
+    return __libc_calloc(count, size);
+}
+void* realloc(void* p, std::size_t size) {
+    audio_plugin_test::noteHeapCall();
+    return __libc_realloc(p, size);
+}
+void* aligned_alloc(std::size_t alignment, std::size_t size) {
+    audio_plugin_test::noteHeapCall();
+    return __libc_memalign(alignment, size);
+}
+int posix_memalign(void** p, std::size_t alignment, std::size_t size) {
+    audio_plugin_test::noteHeapCall();
+    *p = __libc_memalign(alignment, size);
+    return *p != nullptr ? 0 : 12;  // ENOMEM
+}
+void free(void* p) {
+    if (p != nullptr)
+        audio_plugin_test::noteHeapCall();
+    __libc_free(p);
+}
+}
+#endif
 
 
 namespace audio_plugin_test {
@@ -15,6 +118,35 @@ protected:
     std::unique_ptr<audio_plugin::AudioPluginAudioProcessor> processor;
 };
 
+// An offline render by one instance: the input and then silence for the latency, latency compensated
+static juce::AudioBuffer<float> renderWithOneInstance(audio_plugin::AudioPluginAudioProcessor& instance,
+                                                      const juce::AudioBuffer<float>& input, double sampleRate,
+                                                      int hostBlockSize) {
+    const int numChannels = input.getNumChannels();
+    const int numSamples = input.getNumSamples();
+    instance.setNonRealtime(true);
+    instance.setPlayConfigDetails(numChannels, numChannels, sampleRate, hostBlockSize);
+    instance.prepareToPlay(sampleRate, hostBlockSize);
+    const int latency = instance.getLatencySamples();
+    juce::AudioBuffer<float> output(numChannels, numSamples);
+    juce::MidiBuffer midiBuffer;
+    juce::AudioBuffer<float> block(numChannels, hostBlockSize);
+    for (int pos = 0; pos < numSamples + latency; pos += hostBlockSize) {
+        const int size = std::min(hostBlockSize, numSamples + latency - pos);
+        block.setSize(numChannels, size, false, false, true);
+        block.clear();
+        for (int ch = 0; ch < numChannels; ++ch)
+            if (pos < numSamples)
+                block.copyFrom(ch, 0, input, ch, pos, std::min(size, numSamples - pos));
+        instance.processBlock(block, midiBuffer);
+        for (int i = 0; i < size; ++i)
+            if (pos + i >= latency)
+                for (int ch = 0; ch < numChannels; ++ch)
+                    output.getWritePointer(ch)[pos + i - latency] = block.getSample(ch, i);
+    }
+    return output;
+}
+
 // Testing the correctness of block splitting at different frequencies
 //     with different phases
 TEST_F(AudioProcessorTest, BypassDoesNotCorruptAudio) {
@@ -23,7 +155,7 @@ TEST_F(AudioProcessorTest, BypassDoesNotCorruptAudio) {
     const int numHostBlocks[] = {  3,   3,   3,   3,   3,   5,   5,    5,   10,   10};
     const int blockSizes[] =    {150, 256, 333, 500, 512, 666, 777, 1024, 1400, 2048};
     const float phases[] =      {0.2, 0.1,   0, 0.4,   0, 0.6, 0.9,  0.3,  0.8,  0.5};
-    const int resultOffsets[] = {180,  26, 333, 700,   0,1066,1476, 1331, 2520, 3072};
+    const int resultOffsets[] = {149, 255, 332, 499, 511, 665, 776, 1023, 1399, 2047};  // N - 1
     const int numIters = sizeof(blockSizes)/4;
     const double sampleRate = 48000;
 
@@ -117,25 +249,37 @@ void checkFractalizeAndDefractalize(audio_plugin::AudioPluginAudioProcessor *pro
     *processor->getAPVTS().getRawParameterValue("blockOffset") = 0.0f;
     *processor->getAPVTS().getRawParameterValue("gain") = 0.0f;
 
-    // FORWARD AND BACKWARD
+    // FORWARD AND BACKWARD, each through a stream of the block and silence, the result is latency samples late
+    juce::AudioBuffer<float> tail(numChannels, hostBlockSize);
     for (int iter = 0; iter < 2; ++iter) {
         for (int ch = 0; ch < numChannels; ++ch) {
             outputBuffer.copyFrom(ch, 0, inputBuffer, ch, 0, hostBlockSize);
         }
 
-        processor->prepareToPlay(sampleRate, hostBlockSize);
-
-        *processor->getAPVTS().getRawParameterValue("mode") = iter * 1.0f;
-        processor->processBlock(outputBuffer, midiBuffer);
-        *processor->getAPVTS().getRawParameterValue("mode") = 1.0f - iter;
-        processor->processBlock(outputBuffer, midiBuffer);
+        for (int pass = 0; pass < 2; ++pass) {
+            processor->prepareToPlay(sampleRate, hostBlockSize);
+            const int latency = processor->getLatencySamples();
+            *processor->getAPVTS().getRawParameterValue("mode") = pass == 0 ? iter * 1.0f : 1.0f - iter;
+            tail.clear();
+            processor->processBlock(outputBuffer, midiBuffer);
+            processor->processBlock(tail, midiBuffer);
+            for (int ch = 0; ch < numChannels; ++ch) {
+                float* outputBuffer_data = outputBuffer.getWritePointer(ch);
+                std::memmove(outputBuffer_data, outputBuffer_data + latency,
+                             sizeof(float) * static_cast<size_t>(hostBlockSize - latency));
+                std::memcpy(outputBuffer_data + hostBlockSize - latency, tail.getReadPointer(ch),
+                            sizeof(float) * static_cast<size_t>(latency));
+            }
+        }
 
         for (int ch = 0; ch < numChannels; ++ch) {
             const auto* inputBuffer_data = inputBuffer.getReadPointer(ch);
             const auto* outputBuffer_data = outputBuffer.getReadPointer(ch);
             
             for (int i = 0; i < hostBlockSize; ++i) {
-                jassert(juce::approximatelyEqual(inputBuffer_data[i], outputBuffer_data[i]));
+                ASSERT_NEAR(inputBuffer_data[i], outputBuffer_data[i], 1e-4f)
+                    << "Sample mismatch at " << i << ", channel " << ch << ", host block " << hostBlockSize
+                    << (iter == 0 ? ", fractalize -> defractalize" : ", defractalize -> fractalize");
             }
         }
     }
@@ -152,4 +296,1641 @@ TEST_F(AudioProcessorTest, FractalizeAndDefractalize) {
     }
 }
 
+// Testing that host blocks of any size up to the one given to prepareToPlay (empty ones included) give
+//   exactly, bit by bit, the output of fixed-size blocks, with the same latency
+TEST_F(AudioProcessorTest, VariableHostBlocksMatchFixedBlocks) {
+    const int numChannels = 2;
+    const double sampleRate = 48000;
+    const int maxBlockSize = 512;
+    const int numSamples = 24000;
+
+    juce::AudioBuffer<float> input(numChannels, numSamples);
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < numSamples; ++i)
+            input.getWritePointer(ch)[i] = dist(gen);
+
+    auto render = [&](int mode, bool variableBlocks, juce::AudioBuffer<float>& output, int& latency) {
+        audio_plugin::AudioPluginAudioProcessor instance;
+        instance.setPlayConfigDetails(numChannels, numChannels, sampleRate, maxBlockSize);
+        instance.setBypassed(false);
+        auto& params = instance.getAPVTS();
+        *params.getRawParameterValue("frequency") = 150.0f;  // N = 320
+        *params.getRawParameterValue("blockOffset") = 0.3f;
+        *params.getRawParameterValue("mode") = static_cast<float>(mode);
+        *params.getRawParameterValue("solver") = static_cast<float>(audio_plugin::DefractalizerKind::denseLU);
+        instance.prepareToPlay(sampleRate, maxBlockSize);
+        latency = instance.getLatencySamples();
+
+        // the same silent warm-up for both, so the same prepared operator runs from the first measured sample
+        juce::MidiBuffer midiBuffer;
+        juce::AudioBuffer<float> block(numChannels, maxBlockSize);
+        auto silence = [&](int count) {
+            for (int b = 0; b < count; ++b) {
+                block.setSize(numChannels, maxBlockSize, false, false, true);
+                block.clear();
+                instance.processBlock(block, midiBuffer);
+            }
+        };
+        silence(4);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        silence(4);
+
+        output.setSize(numChannels, numSamples);
+        std::mt19937 sizes(11);
+        std::uniform_int_distribution<int> sizeDist(0, maxBlockSize);
+        for (int pos = 0; pos < numSamples;) {
+            const int size = std::min(variableBlocks ? sizeDist(sizes) : maxBlockSize, numSamples - pos);
+            block.setSize(numChannels, size, false, false, true);
+            for (int ch = 0; ch < numChannels; ++ch)
+                block.copyFrom(ch, 0, input, ch, pos, size);
+            instance.processBlock(block, midiBuffer);
+            for (int ch = 0; ch < numChannels; ++ch)
+                output.copyFrom(ch, pos, block, ch, 0, size);
+            ASSERT_EQ(instance.getLatencySamples(), latency) << "latency changed at sample " << pos;
+            pos += size;
+        }
+    };
+
+    for (int mode = 0; mode < 2; ++mode) {
+        int fixedLatency = 0, variableLatency = 0;
+        juce::AudioBuffer<float> fixed, variable;
+        render(mode, false, fixed, fixedLatency);
+        render(mode, true, variable, variableLatency);
+        if (HasFatalFailure())
+            return;
+        ASSERT_EQ(fixedLatency, 319) << "N - 1";
+        ASSERT_EQ(variableLatency, fixedLatency);
+        for (int ch = 0; ch < numChannels; ++ch) {
+            const float* expected = fixed.getReadPointer(ch);
+            const float* actual = variable.getReadPointer(ch);
+            float energy = 0.0f;
+            for (int i = 0; i < numSamples; ++i) {
+                ASSERT_EQ(std::memcmp(&expected[i], &actual[i], sizeof(float)), 0)
+                    << "Sample mismatch at " << i << ", channel " << ch << ", mode " << mode
+                    << ": " << expected[i] << " vs " << actual[i];
+                energy += expected[i] * expected[i];
+            }
+            ASSERT_GT(energy, 1.0f) << "silent output, channel " << ch << ", mode " << mode;
+        }
+    }
+}
+
+// Testing that the whole blocks of big host buffers, batched and worked on side by side (offline on the pool,
+//   in real time on the realtime workers), come out bit for bit as with small buffers that never hold two of them
+TEST_F(AudioProcessorTest, BatchedBlocksMatchOneAtATime) {
+    const int numChannels = 2;
+    const double sampleRate = 48000;
+    const int numSamples = 48000;
+
+    juce::AudioBuffer<float> input(numChannels, numSamples);
+    std::mt19937 gen(13);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < numSamples; ++i)
+            input.getWritePointer(ch)[i] = dist(gen);
+
+    struct Config {
+        int mode, series, solver;
+    };
+    const Config configs[] = {
+        {0, 0, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU)},
+        {0, 1, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU)},
+        {1, 1, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU)},
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::closedForm)},
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU)},
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::blockLU)},
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::denseLU)}};
+
+    auto render = [&](const Config& config, bool offline, int hostBlockSize, juce::AudioBuffer<float>& output) {
+        audio_plugin::AudioPluginAudioProcessor instance;
+        instance.setNonRealtime(offline);
+        instance.setPlayConfigDetails(numChannels, numChannels, sampleRate, hostBlockSize);
+        instance.setBypassed(false);
+        auto& params = instance.getAPVTS();
+        *params.getRawParameterValue("frequency") = 150.0f;  // N = 320
+        *params.getRawParameterValue("blockOffset") = 0.3f;
+        *params.getRawParameterValue("mode") = static_cast<float>(config.mode);
+        *params.getRawParameterValue("series") = static_cast<float>(config.series);
+        *params.getRawParameterValue("solver") = static_cast<float>(config.solver);
+        instance.prepareToPlay(sampleRate, hostBlockSize);
+
+        juce::MidiBuffer midiBuffer;
+        juce::AudioBuffer<float> block(numChannels, hostBlockSize);
+        auto silence = [&](int samples) {
+            block.clear();
+            for (int pos = 0; pos < samples; pos += hostBlockSize)
+                instance.processBlock(block, midiBuffer);
+        };
+        // the same length for both sizes, so the blocks line up
+        silence(8192);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        silence(8192);
+
+        output.setSize(numChannels, numSamples);
+        for (int pos = 0; pos < numSamples; pos += hostBlockSize) {
+            const int size = std::min(hostBlockSize, numSamples - pos);
+            block.setSize(numChannels, size, false, false, true);
+            for (int ch = 0; ch < numChannels; ++ch)
+                block.copyFrom(ch, 0, input, ch, pos, size);
+            instance.processBlock(block, midiBuffer);
+            for (int ch = 0; ch < numChannels; ++ch)
+                output.copyFrom(ch, pos, block, ch, 0, size);
+        }
+    };
+
+    for (int offline = 0; offline < 2; ++offline) {
+        for (const Config& config : configs) {
+            juce::AudioBuffer<float> single, batched;
+            // the first run builds the operator into the shared cache, the compared ones find it there
+            render(config, offline == 1, 256, single);
+            render(config, offline == 1, 256, single);
+            render(config, offline == 1, 8192, batched);  // 25 blocks a callback
+            for (int ch = 0; ch < numChannels; ++ch) {
+                const float* expected = single.getReadPointer(ch);
+                const float* actual = batched.getReadPointer(ch);
+                float energy = 0.0f;
+                for (int i = 0; i < numSamples; ++i) {
+                    ASSERT_EQ(std::memcmp(&expected[i], &actual[i], sizeof(float)), 0)
+                        << "Sample mismatch at " << i << ", channel " << ch << ", mode " << config.mode
+                        << ", series " << config.series << ", solver " << config.solver << ", offline " << offline
+                        << ": " << expected[i] << " vs " << actual[i];
+                    energy += expected[i] * expected[i];
+                }
+                ASSERT_GT(energy, 1.0f) << "silent output, channel " << ch << ", mode " << config.mode;
+            }
+        }
+    }
+}
+
+// Testing the offline mode: a bounce started right after a knob move (a new N, an operator nobody built yet)
+//   is fully processed from its first block, with no fade or mute, bit for bit what real time plays at
+//   Exact quality and 2 refinement steps once its operator is there
+TEST_F(AudioProcessorTest, OfflineBounceWaitsForItsOperatorAndSkipsTheFades) {
+    const int numChannels = 2;
+    const double sampleRate = 48000;
+    const int hostBlockSize = 256;
+    const int N = 320;  // 150 Hz
+    const int numSamples = 10 * N;
+
+    juce::AudioBuffer<float> input(numChannels, numSamples);
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < numSamples; ++i)
+            input.getWritePointer(ch)[i] = dist(gen);
+
+    struct Config {
+        int mode, series, solver;
+    };
+    const Config configs[] = {
+        {0, 0, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU)},
+        {0, 1, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU)},
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU)},
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::denseLU)},
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::closedForm)}};
+
+    auto render = [&](audio_plugin::AudioPluginAudioProcessor& instance, juce::AudioBuffer<float>& output) {
+        juce::MidiBuffer midiBuffer;
+        juce::AudioBuffer<float> block(numChannels, hostBlockSize);
+        output.setSize(numChannels, numSamples);
+        for (int pos = 0; pos < numSamples; pos += hostBlockSize) {
+            const int size = std::min(hostBlockSize, numSamples - pos);
+            block.setSize(numChannels, size, false, false, true);
+            for (int ch = 0; ch < numChannels; ++ch)
+                block.copyFrom(ch, 0, input, ch, pos, size);
+            instance.processBlock(block, midiBuffer);
+            for (int ch = 0; ch < numChannels; ++ch)
+                output.copyFrom(ch, pos, block, ch, 0, size);
+        }
+    };
+    auto setUp = [&](audio_plugin::AudioPluginAudioProcessor& instance, const Config& config, float frequency) {
+        instance.setPlayConfigDetails(numChannels, numChannels, sampleRate, hostBlockSize);
+        instance.setBypassed(false);
+        auto& params = instance.getAPVTS();
+        *params.getRawParameterValue("frequency") = frequency;
+        *params.getRawParameterValue("alpha") = 0.37f;  // nothing another test left in the shared cache
+        *params.getRawParameterValue("mode") = static_cast<float>(config.mode);
+        *params.getRawParameterValue("series") = static_cast<float>(config.series);
+        *params.getRawParameterValue("solver") = static_cast<float>(config.solver);
+        instance.prepareToPlay(sampleRate, hostBlockSize);
+    };
+
+    for (const Config& config : configs) {
+        // offline: prepared for another N, the frequency knob moves, the bounce starts at once
+        juce::AudioBuffer<float> bounced;
+        {
+            audio_plugin::AudioPluginAudioProcessor instance;
+            instance.setNonRealtime(true);
+            setUp(instance, config, 100.0f);
+            *instance.getAPVTS().getRawParameterValue("frequency") = 150.0f;
+            render(instance, bounced);
+        }
+
+        // real time, settled on the bounce's settings (the operator is cached by now)
+        juce::AudioBuffer<float> live;
+        {
+            audio_plugin::AudioPluginAudioProcessor instance;
+            setUp(instance, config, 150.0f);
+            *instance.getAPVTS().getRawParameterValue("quality") = 2.0f;
+            *instance.getAPVTS().getRawParameterValue("refinement") = 2.0f;
+            juce::MidiBuffer midiBuffer;
+            juce::AudioBuffer<float> silence(numChannels, N);  // whole blocks: the measured part starts on one
+            for (int b = 0; b < 4; ++b) {
+                silence.clear();
+                instance.processBlock(silence, midiBuffer);
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            render(instance, live);
+        }
+
+        for (int ch = 0; ch < numChannels; ++ch) {
+            float energy = 0.0f;
+            for (int i = 0; i < numSamples; ++i) {
+                ASSERT_EQ(std::memcmp(bounced.getReadPointer(ch) + i, live.getReadPointer(ch) + i, sizeof(float)), 0)
+                    << "Sample mismatch at " << i << ", channel " << ch << ", mode " << config.mode
+                    << ", series " << config.series << ", solver " << config.solver
+                    << ": " << bounced.getSample(ch, i) << " vs " << live.getSample(ch, i);
+                energy += bounced.getSample(ch, i) * bounced.getSample(ch, i);
+            }
+            ASSERT_GT(energy, 1.0f) << "silent bounce, channel " << ch << ", mode " << config.mode;
+        }
+    }
+}
+
+// A file cut into segments rendered side by side comes out as one instance renders it, latency compensated
+TEST_F(AudioProcessorTest, SegmentedOfflineRenderMatchesOneInstance) {
+    const int numChannels = 2;
+    const double sampleRate = 48000;
+    const int hostBlockSize = 256;
+    const int N = 320;  // 150 Hz
+    const int numSamples = 23 * N + 77;
+
+    juce::AudioBuffer<float> input(numChannels, numSamples);
+    std::mt19937 gen(23);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < numSamples; ++i)
+            input.getWritePointer(ch)[i] = dist(gen);
+
+    struct Config {
+        int mode, series, solver, spread;
+        float blockOffset, gain;
+    };
+    const Config configs[] = {
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU), 0, 0.3f, -6.0f},
+        {0, 0, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU), 1, 0.0f, 0.0f},
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::iterative), 2, 0.5f, 3.0f},
+        {1, 1, static_cast<int>(audio_plugin::DefractalizerKind::closedForm), 0, 0.9f, -3.0f}};
+
+    for (const Config& config : configs) {
+        auto makeProcessor = [&] {
+            auto instance = std::make_unique<audio_plugin::AudioPluginAudioProcessor>();
+            instance->setBypassed(false);
+            auto& params = instance->getAPVTS();
+            *params.getRawParameterValue("frequency") = 150.0f;
+            *params.getRawParameterValue("alpha") = 0.43f;
+            *params.getRawParameterValue("mode") = static_cast<float>(config.mode);
+            *params.getRawParameterValue("series") = static_cast<float>(config.series);
+            *params.getRawParameterValue("solver") = static_cast<float>(config.solver);
+            *params.getRawParameterValue("spread") = static_cast<float>(config.spread);
+            *params.getRawParameterValue("blockOffset") = config.blockOffset;
+            *params.getRawParameterValue("gain") = config.gain;
+            return instance;
+        };
+
+        const juce::AudioBuffer<float> whole = renderWithOneInstance(*makeProcessor(), input, sampleRate, hostBlockSize);
+
+        audio_plugin::OfflineRenderOptions options;
+        options.sampleRate = sampleRate;
+        options.numChannels = numChannels;
+        options.numSamples = numSamples;
+        options.hostBlockSize = hostBlockSize;
+        options.numThreads = 3;
+        options.segmentSamples = 3 * N;
+        juce::AudioBuffer<float> segmented(numChannels, numSamples);
+        int64_t writtenUpTo = 0;
+        const auto stats = audio_plugin::renderOffline(
+            makeProcessor, options,
+            [&](float* const* channels, int64_t start, int count) {
+                for (int ch = 0; ch < numChannels; ++ch)
+                    for (int i = 0; i < count; ++i)
+                        channels[ch][i] = start + i < numSamples ? input.getSample(ch, static_cast<int>(start + i)) : 0.0f;
+            },
+            [&](const float* const* channels, int64_t start, int count) {
+                ASSERT_EQ(start, writtenUpTo) << "out of order";
+                for (int ch = 0; ch < numChannels; ++ch)
+                    segmented.copyFrom(ch, static_cast<int>(start), channels[ch], count);
+                writtenUpTo = start + count;
+            });
+        ASSERT_EQ(writtenUpTo, numSamples);
+        ASSERT_EQ(stats.segments, 8) << "mode " << config.mode;
+        ASSERT_EQ(stats.threads, 3);
+
+        for (int ch = 0; ch < numChannels; ++ch) {
+            float energy = 0.0f;
+            for (int i = 0; i < numSamples; ++i) {
+                ASSERT_EQ(std::memcmp(segmented.getReadPointer(ch) + i, whole.getReadPointer(ch) + i, sizeof(float)), 0)
+                    << "Sample mismatch at " << i << ", channel " << ch << ", mode " << config.mode
+                    << ", solver " << config.solver << ", spread " << config.spread
+                    << ": " << segmented.getSample(ch, i) << " vs " << whole.getSample(ch, i);
+                energy += segmented.getSample(ch, i) * segmented.getSample(ch, i);
+            }
+            ASSERT_GT(energy, 1.0f) << "silent render, channel " << ch << ", mode " << config.mode;
+        }
+    }
+}
+
+// A batch of clips with two settings: two operators, every clip comes out as one instance renders it alone
+TEST_F(AudioProcessorTest, BatchRenderGroupsByOperatorAndMatchesOneClipAtATime) {
+    const int numChannels = 2;
+    const double sampleRate = 48000;
+    const int hostBlockSize = 256;
+    const int N = 320;  // 150 Hz
+    const int numClips = 8;
+
+    struct Settings {
+        int mode, solver;
+        float alpha, blockOffset;
+    };
+    const Settings settings[] = {
+        {1, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU), 0.47f, 0.25f},
+        {1, static_cast<int>(audio_plugin::DefractalizerKind::denseLU), 0.53f, 0.0f}};
+    auto factoryFor = [&](const Settings& clipSettings) -> audio_plugin::ProcessorFactory {
+        return [&clipSettings] {
+            auto instance = std::make_unique<audio_plugin::AudioPluginAudioProcessor>();
+            instance->setBypassed(false);
+            auto& params = instance->getAPVTS();
+            *params.getRawParameterValue("frequency") = 150.0f;
+            *params.getRawParameterValue("mode") = static_cast<float>(clipSettings.mode);
+            *params.getRawParameterValue("solver") = static_cast<float>(clipSettings.solver);
+            *params.getRawParameterValue("alpha") = clipSettings.alpha;
+            *params.getRawParameterValue("blockOffset") = clipSettings.blockOffset;
+            return instance;
+        };
+    };
+
+    std::vector<juce::AudioBuffer<float>> inputs, outputs(numClips);
+    std::mt19937 gen(29);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<audio_plugin::OfflineBatchJob> jobs;
+    for (int c = 0; c < numClips; ++c) {
+        inputs.emplace_back(numChannels, (c + 2) * N + 37 * c);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < inputs.back().getNumSamples(); ++i)
+                inputs.back().getWritePointer(ch)[i] = dist(gen);
+        audio_plugin::OfflineBatchJob job;
+        job.sampleRate = sampleRate;
+        job.numChannels = numChannels;
+        job.makeProcessor = factoryFor(settings[c % 2]);
+        job.operatorSettings.N = audio_plugin::AudioPluginAudioProcessor::blockSizeFor(sampleRate, 150.0f);
+        job.operatorSettings.alpha = settings[c % 2].alpha;
+        job.operatorSettings.defractalize = settings[c % 2].mode == 1;
+        job.operatorSettings.solver = settings[c % 2].solver;
+        job.load = [&inputs, c](juce::AudioBuffer<float>& clip) {
+            clip = inputs[static_cast<size_t>(c)];
+            return true;
+        };
+        job.save = [&outputs, c](const juce::AudioBuffer<float>& clip) {
+            outputs[static_cast<size_t>(c)] = clip;
+            return true;
+        };
+        jobs.push_back(job);
+    }
+
+    const audio_plugin::OfflineBatchStats stats = audio_plugin::renderBatch(jobs, hostBlockSize, 3);
+    ASSERT_EQ(stats.files, numClips);
+    ASSERT_EQ(stats.failed, 0);
+    ASSERT_EQ(stats.operators, 2);
+    ASSERT_EQ(stats.threads, 3);
+    ASSERT_GT(stats.audioSeconds, 0.0);
+    ASSERT_GT(stats.renderSeconds, 0.0);
+
+    for (int c = 0; c < numClips; ++c) {
+        const juce::AudioBuffer<float> alone = renderWithOneInstance(*jobs[static_cast<size_t>(c)].makeProcessor(),
+                                                                     inputs[static_cast<size_t>(c)], sampleRate,
+                                                                     hostBlockSize);
+        const juce::AudioBuffer<float>& batched = outputs[static_cast<size_t>(c)];
+        ASSERT_EQ(batched.getNumSamples(), alone.getNumSamples()) << "clip " << c;
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < alone.getNumSamples(); ++i)
+                ASSERT_EQ(std::memcmp(batched.getReadPointer(ch) + i, alone.getReadPointer(ch) + i, sizeof(float)), 0)
+                    << "Sample mismatch at " << i << ", channel " << ch << ", clip " << c
+                    << ": " << batched.getSample(ch, i) << " vs " << alone.getSample(ch, i);
+    }
+}
+
+// Testing the core API: a prepared operator gives what an offline bounce of the plugin gives (block offset 0,
+//   gain 0 dB), planar and interleaved alike, one buffer or a batch, and never touches the heap doing so
+TEST_F(AudioProcessorTest, PreparedOperatorMatchesOfflinePluginAndNeverAllocates) {
+    const int numChannels = 3;
+    const double sampleRate = 48000;
+    const int hostBlockSize = 256;
+    const int N = 320;  // 150 Hz
+    const int numFrames = 5 * N + 77;  // the partial block at the end is left alone
+    const int wholeFrames = numFrames / N * N;
+
+    struct Settings {
+        int mode, series, solver;
+    };
+    const int autoSolver = static_cast<int>(audio_plugin::DefractalizerKind::numKinds);
+    const Settings settings[] = {{1, 0, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU)},
+                                 {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::iterative)},
+                                 {1, 1, autoSolver}, {0, 0, autoSolver}, {0, 1, autoSolver}};
+
+    std::mt19937 gen(31);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    juce::AudioBuffer<float> input(numChannels, numFrames);
+    std::vector<float> planar(static_cast<size_t>(numChannels * numFrames));
+    std::vector<float> interleaved(planar.size());
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < numFrames; ++i) {
+            const float x = dist(gen);
+            input.getWritePointer(ch)[i] = x;
+            planar[static_cast<size_t>(ch * numFrames + i)] = x;
+            interleaved[static_cast<size_t>(i * numChannels + ch)] = x;
+        }
+
+    for (const Settings& setting : settings) {
+        audio_plugin::AudioPluginAudioProcessor instance;
+        instance.setBypassed(false);
+        auto& params = instance.getAPVTS();
+        *params.getRawParameterValue("frequency") = 150.0f;
+        *params.getRawParameterValue("blockOffset") = 0.0f;
+        *params.getRawParameterValue("gain") = 0.0f;
+        *params.getRawParameterValue("alpha") = 0.47f;
+        *params.getRawParameterValue("mode") = static_cast<float>(setting.mode);
+        *params.getRawParameterValue("series") = static_cast<float>(setting.series);
+        *params.getRawParameterValue("solver") = static_cast<float>(setting.solver);
+        const juce::AudioBuffer<float> bounced = renderWithOneInstance(instance, input, sampleRate, hostBlockSize);
+        ASSERT_EQ(instance.getBlockSize(), N);
+
+        audio_plugin::OperatorSettings operatorSettings;
+        operatorSettings.N = N;
+        operatorSettings.beta = static_cast<int>(params.getRawParameterValue("beta")->load());
+        operatorSettings.alpha = 0.47f;
+        operatorSettings.defractalize = setting.mode == 1;
+        operatorSettings.infiniteSeries = setting.series == 1;
+        operatorSettings.quality = 2;
+        operatorSettings.solver = setting.solver;
+        const auto op = audio_plugin::PreparedOperator::prepare(operatorSettings);
+        ASSERT_NE(op, nullptr) << "mode " << setting.mode << ", series " << setting.series;
+        auto workspace = op->makeWorkspace(numChannels);
+
+        std::vector<float> planarOut(planar.size(), 7.0f), interleavedOut(planar.size(), 7.0f),
+                           batchOut(planar.size(), 7.0f);
+        forbiddenHeapCalls.store(0);
+        heapForbidden = true;
+        const int planarFrames = op->process(planar, planarOut, audio_plugin::SampleLayout::planar, workspace);
+        const int interleavedFrames = op->process(interleaved, interleavedOut,
+                                                  audio_plugin::SampleLayout::interleaved, workspace);
+        // two clips of the same buffer in one call: 3 blocks, then the rest
+        const size_t split = static_cast<size_t>(3 * N * numChannels);
+        const std::span<const float> ins[] = {std::span<const float>(interleaved).first(split),
+                                              std::span<const float>(interleaved).subspan(split)};
+        const std::span<float> outs[] = {std::span<float>(batchOut).first(split),
+                                         std::span<float>(batchOut).subspan(split)};
+        const int batchFrames = op->processBatch(ins, outs, audio_plugin::SampleLayout::interleaved, workspace);
+        heapForbidden = false;
+        ASSERT_EQ(forbiddenHeapCalls.load(), 0) << "heap used processing, mode " << setting.mode
+                                                << ", series " << setting.series << ", solver " << setting.solver;
+        ASSERT_EQ(planarFrames, wholeFrames);
+        ASSERT_EQ(interleavedFrames, wholeFrames);
+        ASSERT_EQ(batchFrames, wholeFrames);
+        if (operatorSettings.defractalize && !operatorSettings.infiniteSeries) {
+            ASSERT_LT(workspace.residual(), 1e-3) << "solver " << setting.solver;
+        }
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < numFrames; ++i) {
+                const float p = planarOut[static_cast<size_t>(ch * numFrames + i)];
+                const float v = interleavedOut[static_cast<size_t>(i * numChannels + ch)];
+                const float b = batchOut[static_cast<size_t>(i * numChannels + ch)];
+                if (i >= wholeFrames) {
+                    ASSERT_EQ(p, 7.0f);
+                    ASSERT_EQ(v, 7.0f);
+                    continue;
+                }
+                const float expected = bounced.getSample(ch, i);
+                ASSERT_EQ(std::memcmp(&p, &expected, sizeof(float)), 0)
+                    << "Sample mismatch at " << i << ", channel " << ch << ", mode " << setting.mode << ", series "
+                    << setting.series << ", solver " << setting.solver << ": " << p << " vs " << expected;
+                ASSERT_EQ(std::memcmp(&v, &p, sizeof(float)), 0) << "interleaved, at " << i << ", channel " << ch;
+                ASSERT_EQ(std::memcmp(&b, &p, sizeof(float)), 0) << "batched, at " << i << ", channel " << ch;
+            }
+    }
+
+    audio_plugin::OperatorSettings invalid;
+    invalid.alpha = 1.0f;
+    ASSERT_EQ(audio_plugin::PreparedOperator::prepare(invalid), nullptr);
+}
+
+// Testing an \alpha off the knob's 0.01 steps: it's rounded like the knob would, so it runs (and caches) the
+//   same operator as the step it rounds to, and one that rounds up to 1 is refused
+TEST_F(AudioProcessorTest, PreparedOperatorSnapsAlphaToTheKnobsSteps) {
+    const int numChannels = 2;
+    const int N = 320;
+    const int numFrames = 3 * N;
+
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<float> input(static_cast<size_t>(numChannels * numFrames));
+    for (float& x : input)
+        x = dist(gen);
+
+    for (int mode = 0; mode < 2; ++mode)
+        for (int series = 0; series < 2; ++series) {
+            audio_plugin::OperatorSettings onStep;
+            onStep.N = N;
+            onStep.alpha = 0.47f;
+            onStep.defractalize = mode == 1;
+            onStep.infiniteSeries = series == 1;
+            audio_plugin::OperatorSettings offStep = onStep;
+            offStep.alpha = 0.4731f;
+
+            const auto expectedOp = audio_plugin::PreparedOperator::prepare(onStep);
+            const auto op = audio_plugin::PreparedOperator::prepare(offStep);
+            ASSERT_NE(expectedOp, nullptr) << "mode " << mode << ", series " << series;
+            ASSERT_NE(op, nullptr) << "mode " << mode << ", series " << series;
+            ASSERT_EQ(op->settings().alpha, 0.47f);
+
+            auto expectedWorkspace = expectedOp->makeWorkspace(numChannels);
+            auto workspace = op->makeWorkspace(numChannels);
+            std::vector<float> expected(input.size()), output(input.size());
+            ASSERT_EQ(expectedOp->process(input, expected, audio_plugin::SampleLayout::planar, expectedWorkspace),
+                      numFrames);
+            ASSERT_EQ(op->process(input, output, audio_plugin::SampleLayout::planar, workspace), numFrames);
+            ASSERT_EQ(std::memcmp(output.data(), expected.data(), output.size() * sizeof(float)), 0)
+                << "mode " << mode << ", series " << series;
+        }
+
+    audio_plugin::OperatorSettings roundsToOne;
+    roundsToOne.N = N;
+    roundsToOne.alpha = 0.996f;
+    ASSERT_EQ(audio_plugin::PreparedOperator::prepare(roundsToOne), nullptr);
+}
+
+// Testing "spread": with N = 2400 and 32-sample callbacks the output is the one of whole blocks one block
+//   later (bit for bit), and no callback does more than its share of a block's work plus one piece
+TEST_F(AudioProcessorTest, SpreadWorkMatchesWholeBlocksOneBlockLater) {
+    const int numChannels = 2;
+    const double sampleRate = 48000;
+    const int hostBlockSize = 32;
+    const int N = 2400;  // 20 Hz
+    const int numSamples = 8 * N;
+
+    juce::AudioBuffer<float> input(numChannels, numSamples);
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < numSamples; ++i)
+            input.getWritePointer(ch)[i] = dist(gen);
+
+    struct Config {
+        int mode, series, solver;
+        float worstShare;  // the bound with spreading on
+    };
+    const float sampleShare = static_cast<float>(hostBlockSize + 1 + audio_plugin::SlicedGatherPlan::sliceWidth) / N;
+    const Config configs[] = {
+        {0, 0, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU), sampleShare},
+        {0, 1, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU), sampleShare},
+        {1, 1, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU), sampleShare},
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::closedForm), sampleShare},
+        // a backend solve is one piece: one channel's worth
+        {1, 0, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU), 0.5f}};
+
+    // spread: 0 off, 1 over the next block, 2 on a worker
+    auto render = [&](const Config& config, int spread, juce::AudioBuffer<float>& output, int& latency,
+                      float& worstShare, int* missedDeadlines = nullptr) {
+        audio_plugin::AudioPluginAudioProcessor instance;
+        instance.setPlayConfigDetails(numChannels, numChannels, sampleRate, hostBlockSize);
+        instance.setBypassed(false);
+        auto& params = instance.getAPVTS();
+        *params.getRawParameterValue("frequency") = 20.0f;
+        *params.getRawParameterValue("mode") = static_cast<float>(config.mode);
+        *params.getRawParameterValue("series") = static_cast<float>(config.series);
+        *params.getRawParameterValue("solver") = static_cast<float>(config.solver);
+        *params.getRawParameterValue("spread") = static_cast<float>(spread);
+        instance.prepareToPlay(sampleRate, hostBlockSize);
+        latency = instance.getLatencySamples();
+
+        juce::MidiBuffer midiBuffer;
+        juce::AudioBuffer<float> block(numChannels, hostBlockSize);
+        auto silence = [&](int count) {
+            block.clear();
+            for (int b = 0; b < count; ++b)
+                instance.processBlock(block, midiBuffer);
+        };
+        // a block asks for the operator, the sleep lets it land: the same one runs from the first measured block
+        silence(2 * N / hostBlockSize);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        silence(2 * N / hostBlockSize);
+        instance.resetCallbackLoad();
+        const int missedBefore = instance.getMissedDeadlines();
+
+        output.setSize(numChannels, numSamples);
+        for (int pos = 0; pos < numSamples; pos += hostBlockSize) {
+            for (int ch = 0; ch < numChannels; ++ch)
+                block.copyFrom(ch, 0, input, ch, pos, hostBlockSize);
+            instance.processBlock(block, midiBuffer);
+            for (int ch = 0; ch < numChannels; ++ch)
+                output.copyFrom(ch, pos, block, ch, 0, hostBlockSize);
+            // the worker has a deadline: callbacks come at (roughly) the pace a host's would
+            if (spread == 2)
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        worstShare = instance.getWorstCallbackShare();
+        if (missedDeadlines != nullptr)
+            *missedDeadlines = instance.getMissedDeadlines() - missedBefore;
+    };
+
+    for (const Config& config : configs) {
+        juce::AudioBuffer<float> whole, spread, offloaded;
+        int wholeLatency = 0, spreadLatency = 0, offloadedLatency = 0, missedDeadlines = 0;
+        float wholeShare = 0.0f, spreadShare = 0.0f, offloadedShare = 0.0f;
+        // the first run builds the operator into the shared cache, the compared ones find it there
+        render(config, 0, whole, wholeLatency, wholeShare);
+        render(config, 0, whole, wholeLatency, wholeShare);
+        render(config, 1, spread, spreadLatency, spreadShare);
+        render(config, 2, offloaded, offloadedLatency, offloadedShare, &missedDeadlines);
+        ASSERT_EQ(wholeLatency, N - 1);
+        ASSERT_EQ(spreadLatency, wholeLatency + N) << "one block more";
+        ASSERT_EQ(offloadedLatency, wholeLatency + N) << "one block more";
+        EXPECT_EQ(offloadedShare, 0.0f) << "the worker does it all";
+        EXPECT_GE(wholeShare, 1.0f) << "a whole block in one callback, mode " << config.mode;
+        EXPECT_LE(spreadShare, config.worstShare)
+            << "mode " << config.mode << ", series " << config.series << ", solver " << config.solver;
+
+        for (int ch = 0; ch < numChannels; ++ch) {
+            const float* expected = whole.getReadPointer(ch);
+            const float* actual = spread.getReadPointer(ch);
+            float energy = 0.0f;
+            for (int i = 0; i + N < numSamples; ++i) {
+                ASSERT_EQ(std::memcmp(&expected[i], &actual[i + N], sizeof(float)), 0)
+                    << "Sample mismatch at " << i << ", channel " << ch << ", mode " << config.mode
+                    << ", series " << config.series << ", solver " << config.solver
+                    << ": " << expected[i] << " vs " << actual[i + N];
+                energy += expected[i] * expected[i];
+            }
+            ASSERT_GT(energy, 1.0f) << "silent output, channel " << ch << ", mode " << config.mode;
+        }
+
+        // on the worker: block by block the same, or (deadline missed) the dry block
+        int processedBlocks = 0, dryBlocks = 0;
+        for (int lo = 0; lo + N < numSamples; lo = lo == 0 ? N - 1 : lo + N) {
+            const int hi = std::min(lo == 0 ? N - 1 : lo + N, numSamples - N);
+            bool same = true, dry = true;
+            for (int ch = 0; ch < numChannels; ++ch) {
+                for (int i = lo; i < hi; ++i) {
+                    const float actual = offloaded.getSample(ch, i + N);
+                    same = same && std::memcmp(&actual, whole.getReadPointer(ch) + i, sizeof(float)) == 0;
+                    dry = dry && actual == (i >= N - 1 ? input.getSample(ch, i - (N - 1)) : 0.0f);
+                }
+            }
+            ASSERT_TRUE(same || dry) << "block at " << lo << ", mode " << config.mode
+                                     << ", series " << config.series << ", solver " << config.solver;
+            processedBlocks += same ? 1 : 0;
+            dryBlocks += same ? 0 : 1;
+        }
+        EXPECT_LE(dryBlocks, missedDeadlines);
+        EXPECT_GT(processedBlocks, dryBlocks) << "the worker missed most deadlines, mode " << config.mode;
+    }
+}
+
+// Testing that every SIMD fractalizer kernel available on this CPU gives exactly
+//   (bit by bit) the same output as the scalar gather, for stereo and mono
+TEST(FractalKernelsTest, SimdKernelsMatchScalarBitExactly) {
+    const int Ns[] =    {137, 160, 480, 511, 512, 1000, 2400, 9600};
+    const int betas[] = {  2,   3,   2,   2,   5,    7,    2,    3};
+    const float alpha = 0.7f;
+    const int numIters = sizeof(Ns)/4;
+    const int numChannels = 3;  // one stereo pair + one mono channel
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int iter = 0; iter < numIters; ++iter) {
+        const int N = Ns[iter];
+        std::vector<float> termWeights(20);
+        termWeights[0] = 1.0f;
+        for (size_t n = 1; n < termWeights.size(); ++n)
+            termWeights[n] = termWeights[n-1] * alpha;
+
+        audio_plugin::GatherPlan plan;
+        audio_plugin::SlicedGatherPlan sliced;
+        audio_plugin::buildGatherPlan(plan, N, betas[iter], termWeights);
+        audio_plugin::buildSlicedGatherPlan(sliced, plan);
+
+        juce::AudioBuffer<float> g(numChannels, N), expected(numChannels, N), actual(numChannels, N);
+        for (int ch = 0; ch < numChannels; ++ch) {
+            auto* g_data = g.getWritePointer(ch);
+            for (int i = 0; i < N; ++i)
+                g_data[i] = dist(gen);
+            audio_plugin::applyGatherPlan(plan, g.getReadPointer(ch), expected.getWritePointer(ch));
+        }
+
+        const int maxLevel = static_cast<int>(audio_plugin::detectKernelLevel());
+        for (int level = 0; level <= maxLevel; ++level) {
+            const auto kernelLevel = static_cast<audio_plugin::KernelLevel>(level);
+            actual.clear();
+            audio_plugin::applyFractalKernel(plan, sliced, g.getArrayOfReadPointers(),
+                                             actual.getArrayOfWritePointers(), numChannels, kernelLevel);
+            for (int ch = 0; ch < numChannels; ++ch) {
+                ASSERT_EQ(std::memcmp(expected.getReadPointer(ch), actual.getReadPointer(ch),
+                                      sizeof(float) * static_cast<size_t>(N)), 0)
+                    << audio_plugin::kernelLevelName(kernelLevel) << " kernel differs at channel "
+                    << ch << ", N " << N << ", beta " << betas[iter];
+            }
+        }
+    }
+}
+
+// Testing the log-depth doubling evaluator against the direct (term by term) sum
+TEST(FractalKernelsTest, DoublingMatchesDirectSum) {
+    const int Ns[] =      {137, 160, 480, 511, 1000, 2400, 2400, 9600};
+    const int betas[] =   {  2,   3,   2,   2,    7,    2,    8,    3};
+    const int numTerms[] ={ 20,  13,  20,  20,    8,    5,    7,   13};
+    const float alphas[] ={0.5f,0.9f,0.3f,0.9f, 0.75f,0.05f, 0.6f, 0.9f};
+    const int numIters = sizeof(Ns)/4;
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int iter = 0; iter < numIters; ++iter) {
+        const int N = Ns[iter];
+        std::vector<float> termWeights(static_cast<size_t>(numTerms[iter]));
+        termWeights[0] = 1.0f;
+        for (size_t n = 1; n < termWeights.size(); ++n)
+            termWeights[n] = termWeights[n-1] * alphas[iter];
+
+        audio_plugin::GatherPlan plan;
+        audio_plugin::buildGatherPlan(plan, N, betas[iter], termWeights);
+
+        std::vector<float> g(static_cast<size_t>(N)), expected(g.size()), actual(g.size()), scratch(3 * g.size());
+        for (auto& sample : g)
+            sample = dist(gen);
+        audio_plugin::applyGatherPlan(plan, g.data(), expected.data());
+        audio_plugin::fractalizeDoubling(g.data(), actual.data(), scratch.data(),
+                                         N, betas[iter], alphas[iter], numTerms[iter]);
+
+        for (size_t i = 0; i < g.size(); ++i) {
+            ASSERT_NEAR(expected[i], actual[i], 1e-4f)
+                << "Sample mismatch at " << i << ", N " << N << ", beta " << betas[iter]
+                << ", terms " << numTerms[iter];
+        }
+    }
+}
+
+// Testing how many terms the truncated series keeps: the first n with \alpha^n below the quality's
+//   tolerance, fewer for a coarser quality, never more than \beta allows
+TEST(FractalKernelsTest, SeriesTermCountFollowsAlphaAndQuality) {
+    // 0.05^5 = 3.1e-7, 0.05^6 = 1.6e-8
+    ASSERT_EQ(audio_plugin::seriesTermCount(2, 0.05f, 1e-7f), 6);
+
+    // beyond ~20 terms \beta^n passes 1e6 for \beta = 2: the cap for \alpha near 1 and for Exact
+    const int betaCap = audio_plugin::seriesTermCount(2, 0.5f, 0.0f);
+    ASSERT_EQ(betaCap, 20);
+    ASSERT_EQ(audio_plugin::seriesTermCount(2, 0.9f, 1e-7f), betaCap) << "0.9^153 < 1e-7, but \beta caps it";
+    ASSERT_EQ(audio_plugin::seriesTermCount(2, 0.99f, 1e-3f), betaCap);
+    ASSERT_LT(audio_plugin::seriesTermCount(8, 0.9f, 0.0f), betaCap) << "a bigger \beta needs fewer terms";
+
+    const int betas[] = {2, 3, 7};
+    for (const int beta : betas)
+        for (int step = 1; step < 100; ++step) {
+            const float alpha = static_cast<float>(step) / 100.0f;
+            int counts[3];
+            for (int quality = 0; quality < 3; ++quality)
+                counts[quality] = audio_plugin::seriesTermCount(beta, alpha, audio_plugin::qualityTolerance(quality));
+            // Draft <= Normal <= Exact
+            ASSERT_LE(counts[0], counts[1]) << "beta " << beta << ", alpha " << alpha;
+            ASSERT_LE(counts[1], counts[2]) << "beta " << beta << ", alpha " << alpha;
+            ASSERT_EQ(counts[2], audio_plugin::seriesTermCount(beta, alpha, 0.0f));
+
+            // not one term more than the tolerance asks for, unless \beta caps it
+            for (int quality = 0; quality < 2; ++quality) {
+                const double tolerance = audio_plugin::qualityTolerance(quality);
+                const int n = counts[quality];
+                ASSERT_GE(n, 1);
+                ASSERT_LE(n, counts[2]);
+                if (n < counts[2]) {
+                    ASSERT_LT(std::pow(static_cast<double>(alpha), n), tolerance * (1.0 + 1e-9))
+                        << "beta " << beta << ", alpha " << alpha << ", quality " << quality;
+                }
+                if (n > 1) {
+                    ASSERT_GE(std::pow(static_cast<double>(alpha), n - 1), tolerance * (1.0 - 1e-9))
+                        << "beta " << beta << ", alpha " << alpha << ", quality " << quality;
+                }
+            }
+        }
+}
+
+// Testing the exact infinite series: it must match a very long truncated sum
+//   and defractalizeInfinite must invert it
+TEST(FractalKernelsTest, InfiniteSeriesMatchesLongSumAndInverts) {
+    const int Ns[] =      {137, 160, 480, 511, 1000, 2400, 9600};
+    const int betas[] =   {  2,   3,   2,   2,    7,    8,    3};
+    const float alphas[] ={0.5f,0.9f,0.3f,0.9f, 0.75f, 0.6f, 0.9f};
+    const int numIters = sizeof(Ns)/4;
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int iter = 0; iter < numIters; ++iter) {
+        const int N = Ns[iter];
+        std::vector<float> termWeights(400);  // 0.9^400 < 1e-18
+        termWeights[0] = 1.0f;
+        for (size_t n = 1; n < termWeights.size(); ++n)
+            termWeights[n] = termWeights[n-1] * alphas[iter];
+
+        audio_plugin::GatherPlan plan;
+        audio_plugin::OrbitPlan orbits;
+        audio_plugin::buildGatherPlan(plan, N, betas[iter], termWeights);
+        audio_plugin::buildOrbitPlan(orbits, N, betas[iter]);
+
+        std::vector<float> g(static_cast<size_t>(N)), expected(g.size()), actual(g.size()), back(g.size());
+        for (auto& sample : g)
+            sample = dist(gen);
+        audio_plugin::applyGatherPlan(plan, g.data(), expected.data());
+        audio_plugin::fractalizeInfinite(orbits, alphas[iter], g.data(), actual.data());
+        audio_plugin::defractalizeInfinite(N, betas[iter], alphas[iter], actual.data(), back.data());
+
+        for (size_t i = 0; i < g.size(); ++i) {
+            ASSERT_NEAR(expected[i], actual[i], 1e-4f)
+                << "Sample mismatch at " << i << ", N " << N << ", beta " << betas[iter];
+            ASSERT_NEAR(g[i], back[i], 1e-4f)
+                << "Inverse mismatch at " << i << ", N " << N << ", beta " << betas[iter];
+        }
+    }
+}
+
+// Testing the closed-form defractalizer: defractalizeClosedForm(plan(g)) == g
+TEST(FractalKernelsTest, ClosedFormDefractalizerInvertsTruncatedSeries) {
+    const int Ns[] =      {137, 160, 480, 511, 1000, 2400, 9600};
+    const int betas[] =   {  2,   3,   2,   2,    7,    8,    3};
+    const float alphas[] ={0.5f,0.9f,0.3f,0.9f, 0.75f, 0.6f, 0.9f};
+    const int numIters = sizeof(Ns)/4;
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int iter = 0; iter < numIters; ++iter) {
+        const int N = Ns[iter];
+        const int numTerms = audio_plugin::seriesTermCount(betas[iter], alphas[iter], 0.0f);
+        std::vector<float> termWeights(static_cast<size_t>(numTerms));
+        termWeights[0] = 1.0f;
+        for (size_t n = 1; n < termWeights.size(); ++n)
+            termWeights[n] = termWeights[n-1] * alphas[iter];
+
+        audio_plugin::GatherPlan plan;
+        audio_plugin::buildGatherPlan(plan, N, betas[iter], termWeights);
+        const int refinements = audio_plugin::closedFormRefinements(alphas[iter], numTerms, 1e-7f);
+
+        std::vector<float> g(static_cast<size_t>(N)), f(g.size()), back(g.size()), scratch(2 * g.size());
+        for (auto& sample : g)
+            sample = dist(gen);
+        audio_plugin::applyGatherPlan(plan, g.data(), f.data());
+        audio_plugin::defractalizeClosedForm(f.data(), back.data(), scratch.data(),
+                                             N, betas[iter], alphas[iter], numTerms, refinements);
+
+        for (size_t i = 0; i < g.size(); ++i) {
+            ASSERT_NEAR(g[i], back[i], 1e-4f)
+                << "Sample mismatch at " << i << ", N " << N << ", beta " << betas[iter];
+        }
+    }
+}
+
+// Testing the orbit-decomposed solver: solving chunk by chunk must invert the fractalizer
+TEST(FractalKernelsTest, BlockDefractalizerInvertsFractalizer) {
+    const int Ns[] =      {137, 160, 480, 511, 512, 1000, 2400};
+    const int betas[] =   {  2,   3,   2,   2,   2,    7,    8};
+    const float alphas[] ={0.5f,0.9f,0.3f,0.8f, 0.5f, 0.75f, 0.6f};
+    const int numIters = sizeof(Ns)/4;
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int iter = 0; iter < numIters; ++iter) {
+        const int N = Ns[iter];
+        const int numTerms = audio_plugin::seriesTermCount(betas[iter], alphas[iter], 1e-7f);
+        std::vector<float> termWeights(static_cast<size_t>(numTerms));
+        termWeights[0] = 1.0f;
+        for (size_t n = 1; n < termWeights.size(); ++n)
+            termWeights[n] = termWeights[n-1] * alphas[iter];
+
+        audio_plugin::GatherPlan plan;
+        audio_plugin::OrbitPlan orbits;
+        audio_plugin::BlockDefractalizer solver;
+        audio_plugin::buildGatherPlan(plan, N, betas[iter], termWeights);
+        audio_plugin::buildOrbitPlan(orbits, N, betas[iter]);
+        ASSERT_TRUE(solver.prepare(plan, orbits, 4));
+
+        std::vector<float> g(static_cast<size_t>(N)), f(g.size()), back(g.size()), scratch(2 * g.size());
+        for (auto& sample : g)
+            sample = dist(gen);
+        audio_plugin::applyGatherPlan(plan, g.data(), f.data());
+        for (int chunk = 0; chunk < solver.numChunks(); ++chunk)
+            solver.solveChunk(f.data(), back.data(), scratch.data(), chunk);
+
+        for (size_t i = 0; i < g.size(); ++i) {
+            ASSERT_NEAR(g[i], back[i], 1e-3f)
+                << "Sample mismatch at " << i << ", N " << N << ", beta " << betas[iter]
+                << ", components " << solver.numComponents();
+        }
+
+        // the stored factors solve bit for bit the same, split into other chunks or not; cut short they're refused
+        const std::vector<uint8_t> state = solver.serialize();
+        audio_plugin::BlockDefractalizer loaded;
+        ASSERT_TRUE(loaded.deserialize(state.data(), state.size(), N, 2)) << "N " << N;
+        ASSERT_EQ(loaded.numComponents(), solver.numComponents());
+        ASSERT_EQ(loaded.memoryFootprint(), solver.memoryFootprint());
+        std::vector<float> loadedBack(g.size());
+        loaded.solve(f.data(), loadedBack.data(), scratch.data());
+        ASSERT_EQ(std::memcmp(loadedBack.data(), back.data(), sizeof(float) * back.size()), 0) << "N " << N;
+        ASSERT_FALSE(loaded.deserialize(state.data(), state.size() - 1, N, 2));
+        ASSERT_EQ(loaded.numComponents(), 0);
+        ASSERT_FALSE(loaded.deserialize(state.data(), state.size(), N + 1, 2));
+    }
+}
+
+// Testing the iterative defractalizer: it must converge to g and, warm-started
+//   from the same block, not need another iteration
+TEST(FractalKernelsTest, IterativeDefractalizerConvergesAndWarmStarts) {
+    const int Ns[] =      {137, 480, 511, 1000, 2400};
+    const int betas[] =   {  2,   2,   2,    7,    3};
+    const float alphas[] ={0.5f,0.3f,0.9f, 0.75f, 0.6f};
+    const int numIters = sizeof(Ns)/4;
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int iter = 0; iter < numIters; ++iter) {
+        const int N = Ns[iter];
+        const int numTerms = audio_plugin::seriesTermCount(betas[iter], alphas[iter], 1e-7f);
+        std::vector<float> termWeights(static_cast<size_t>(numTerms));
+        termWeights[0] = 1.0f;
+        for (size_t n = 1; n < termWeights.size(); ++n)
+            termWeights[n] = termWeights[n-1] * alphas[iter];
+
+        audio_plugin::GatherPlan plan;
+        audio_plugin::SlicedGatherPlan sliced;
+        audio_plugin::buildGatherPlan(plan, N, betas[iter], termWeights);
+        audio_plugin::buildSlicedGatherPlan(sliced, plan);
+        const auto kernelLevel = audio_plugin::detectKernelLevel();
+
+        std::vector<float> g(static_cast<size_t>(N)), f(g.size()), back(g.size());
+        for (auto& sample : g)
+            sample = dist(gen);
+        audio_plugin::applyGatherPlan(plan, g.data(), f.data());
+
+        audio_plugin::IterativeDefractalizer solver;
+        solver.prepare(N, 1);
+        solver.solve(plan, sliced, kernelLevel, betas[iter], alphas[iter], f.data(), back.data(), 0, 1e-6f, 100);
+        for (size_t i = 0; i < g.size(); ++i) {
+            ASSERT_NEAR(g[i], back[i], 1e-4f)
+                << "Sample mismatch at " << i << ", N " << N << ", beta " << betas[iter];
+        }
+        EXPECT_EQ(solver.solve(plan, sliced, kernelLevel, betas[iter], alphas[iter],
+                               f.data(), back.data(), 0, 1e-6f, 100), 0);
+
+        // a target below what float gets to stops in the rounding noise, not at the cap
+        solver.forget(0);
+        EXPECT_LT(solver.solve(plan, sliced, kernelLevel, betas[iter], alphas[iter],
+                               f.data(), back.data(), 0, 1e-9f, 64), 40) << "N " << N << ", beta " << betas[iter];
+        EXPECT_LT(solver.lastRelativeResidual(), 1e-6f) << "N " << N << ", beta " << betas[iter];
+    }
+}
+
+// Testing every defractalizer backend behind the common interface, and that the auto-selection
+//   returns one that meets the accuracy target
+TEST(FractalKernelsTest, DefractalizerBackendsInvertAndAutoSelectionMeetsTarget) {
+    const int Ns[] =      {137, 480, 511, 1000, 2400};
+    const int betas[] =   {  2,   2,   3,    7,    2};
+    const float alphas[] ={0.5f,0.3f,0.9f, 0.75f, 0.6f};
+    const int numIters = sizeof(Ns)/4;
+    const float accuracyTarget = 1e-3f;
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int iter = 0; iter < numIters; ++iter) {
+        const int N = Ns[iter];
+        const int numTerms = audio_plugin::seriesTermCount(betas[iter], alphas[iter], 1e-7f);
+        const auto problem = audio_plugin::makeDefractalizerProblem(N, betas[iter], alphas[iter], numTerms, 1e-7f,
+                                                                    audio_plugin::detectKernelLevel(), 4);
+
+        std::vector<float> g(static_cast<size_t>(N)), f(g.size()), back(g.size());
+        for (auto& sample : g)
+            sample = dist(gen);
+        audio_plugin::applyGatherPlan(problem->plan, g.data(), f.data());
+
+        for (int k = 0; k < static_cast<int>(audio_plugin::DefractalizerKind::numKinds); ++k) {
+            const auto kind = static_cast<audio_plugin::DefractalizerKind>(k);
+            auto backend = audio_plugin::makeDefractalizerBackend(kind);
+            ASSERT_TRUE(backend->prepare(problem)) << audio_plugin::defractalizerKindName(kind);
+            audio_plugin::DefractalizerWorkspace workspace;
+            backend->prepareWorkspace(workspace, 1);
+            backend->solve(f.data(), back.data(), 0, workspace);
+            for (size_t i = 0; i < g.size(); ++i) {
+                ASSERT_NEAR(g[i], back[i], 1e-3f)
+                    << audio_plugin::defractalizerKindName(kind) << " mismatch at " << i
+                    << ", N " << N << ", beta " << betas[iter];
+            }
+        }
+
+        std::vector<audio_plugin::BackendTiming> report;
+        const auto best = audio_plugin::selectDefractalizerBackend(problem, accuracyTarget, {}, &report);
+        ASSERT_NE(best, nullptr);
+        for (const auto& timing : report) {
+            if (timing.kind == best->kind()) {
+                EXPECT_LE(timing.relativeError, accuracyTarget)
+                    << audio_plugin::defractalizerKindName(timing.kind) << ", N " << N;
+            }
+        }
+
+        // on a worker whose job got cancelled (its instance is closing) the selection stops before a backend
+        audio_plugin::WorkerPool::Options options;
+        options.numThreads = 1;
+        audio_plugin::WorkerPool pool(options);
+        std::atomic<bool> started{false}, finished{false};
+        std::unique_ptr<audio_plugin::DefractalizerBackend> cancelled;
+        std::vector<audio_plugin::BackendTiming> cancelledReport;
+        audio_plugin::WorkerPool::Job selection([&] {
+            started.store(true);
+            while (!audio_plugin::WorkerPool::cancellationRequested())
+                std::this_thread::yield();
+            cancelled = audio_plugin::selectDefractalizerBackend(problem, accuracyTarget, {}, &cancelledReport);
+            finished.store(true);
+        });
+        pool.submit(selection, audio_plugin::WorkPriority::normal);
+        while (!started.load())
+            std::this_thread::yield();
+        pool.retract(selection);
+        ASSERT_TRUE(finished.load());
+        ASSERT_EQ(cancelled, nullptr) << "N " << N;
+        ASSERT_TRUE(cancelledReport.empty()) << "N " << N;
+    }
+}
+
+// Testing the mixed-precision refinement: for high alpha the refined solution must have
+//   a smaller residual than the plain float solve and be close to float precision
+TEST(FractalKernelsTest, MixedPrecisionRefinementReducesResidual) {
+    const int Ns[] =      {137, 480, 511, 1000, 2400};
+    const int betas[] =   {  2,   2,   2,    3,    2};
+    const float alphas[] ={0.9f,0.9f,0.88f,0.9f, 0.85f};
+    const int numIters = sizeof(Ns)/4;
+    const audio_plugin::DefractalizerKind kinds[] = {audio_plugin::DefractalizerKind::sparseLU,
+                                                     audio_plugin::DefractalizerKind::blockLU,
+                                                     audio_plugin::DefractalizerKind::closedForm};
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int iter = 0; iter < numIters; ++iter) {
+        const int N = Ns[iter];
+        const int numTerms = audio_plugin::seriesTermCount(betas[iter], alphas[iter], 0.0f);
+        const auto problem = audio_plugin::makeDefractalizerProblem(N, betas[iter], alphas[iter], numTerms, 1e-7f,
+                                                                    audio_plugin::detectKernelLevel(), 1);
+
+        std::vector<float> g(static_cast<size_t>(N)), f(g.size()), plain(g.size()), refined(g.size());
+        for (auto& sample : g)
+            sample = dist(gen);
+        audio_plugin::applyGatherPlan(problem->plan, g.data(), f.data());
+
+        for (const auto kind : kinds) {
+            auto backend = audio_plugin::makeDefractalizerBackend(kind);
+            ASSERT_TRUE(backend->prepare(problem));
+            audio_plugin::DefractalizerWorkspace workspace;
+            backend->prepareWorkspace(workspace, 1);
+            const double plainResidual = audio_plugin::solveRefined(*backend, f.data(), plain.data(), 0, workspace, 0);
+            const double refinedResidual = audio_plugin::solveRefined(*backend, f.data(), refined.data(), 0, workspace, 2);
+            EXPECT_LE(refinedResidual, plainResidual * 1.01 + 1e-9)
+                << audio_plugin::defractalizerKindName(kind) << ", N " << N << ", alpha " << alphas[iter];
+            EXPECT_LT(refinedResidual, 1e-6)
+                << audio_plugin::defractalizerKindName(kind) << ", N " << N << ", alpha " << alphas[iter];
+            for (size_t i = 0; i < g.size(); ++i) {
+                ASSERT_NEAR(g[i], refined[i], 1e-4f)
+                    << audio_plugin::defractalizerKindName(kind) << " mismatch at " << i << ", N " << N;
+            }
+        }
+    }
+}
+
+// Testing the operator cache: hits return the same prepared operator, once over the
+//   memory cap the least recently used entries go first, but never one that is still in use
+TEST(FractalKernelsTest, DefractalizerCacheEvictsLeastRecentlyUsed) {
+    const int Ns[] = {137, 160, 200, 240};
+    const int numIters = sizeof(Ns)/4;
+
+    std::vector<std::shared_ptr<const audio_plugin::DefractalizerBackend>> backends;
+    std::vector<const audio_plugin::DefractalizerBackend*> raw;
+    std::vector<size_t> entryBytes;
+    for (int iter = 0; iter < numIters; ++iter) {
+        const int numTerms = audio_plugin::seriesTermCount(2, 0.5f, 1e-7f);
+        auto backend = audio_plugin::makeDefractalizerBackend(audio_plugin::DefractalizerKind::sparseLU);
+        ASSERT_TRUE(backend->prepare(audio_plugin::makeDefractalizerProblem(
+            Ns[iter], 2, 0.5f, numTerms, 1e-7f, audio_plugin::KernelLevel::scalar, 1)));
+        entryBytes.push_back(backend->memoryFootprint() + backend->problem().memoryFootprint());
+        raw.push_back(backend.get());
+        backends.push_back(std::move(backend));
+    }
+
+    // room for exactly the entries that must survive, the first three fit as well
+    const size_t cap = entryBytes[0] + entryBytes[2] + entryBytes[3];
+    ASSERT_LE(entryBytes[1], entryBytes[3]);
+    audio_plugin::DefractalizerCache cache(cap);
+    for (int iter = 0; iter < 3; ++iter)
+        cache.insert({Ns[iter], 2, 50, 1, 1}, std::move(backends[static_cast<size_t>(iter)]));
+    ASSERT_EQ(cache.size(), 3u);
+    ASSERT_EQ(cache.find({Ns[0], 2, 50, 1, 1}).get(), raw[0]) << "A hit must return the cached operator";
+    ASSERT_EQ(cache.find({Ns[0], 2, 50, 2, 1}), nullptr) << "Another quality must miss";
+
+    // Ns[0] was just used, so Ns[1] is the least recently used one
+    cache.insert({Ns[3], 2, 50, 1, 1}, std::move(backends[3]));
+    EXPECT_TRUE(cache.contains({Ns[0], 2, 50, 1, 1}));
+    EXPECT_FALSE(cache.contains({Ns[1], 2, 50, 1, 1}));
+    EXPECT_TRUE(cache.contains({Ns[2], 2, 50, 1, 1}));
+    EXPECT_TRUE(cache.contains({Ns[3], 2, 50, 1, 1}));
+    EXPECT_EQ(cache.memoryUsed(), cap);
+
+    // an operator somebody holds (e.g. a plugin instance) outlives the cap
+    auto inUse = cache.find({Ns[2], 2, 50, 1, 1});
+    ASSERT_EQ(inUse.get(), raw[2]);
+    ASSERT_EQ(cache.find({Ns[3], 2, 50, 1, 1}).get(), raw[3]);  // the newest again
+    cache.setMemoryCap(0);
+    EXPECT_EQ(cache.size(), 2u) << "The newest entry and the one in use must stay";
+    EXPECT_TRUE(cache.contains({Ns[2], 2, 50, 1, 1}));
+    inUse.reset();
+    cache.setMemoryCap(0);
+    EXPECT_EQ(cache.size(), 1u) << "Released operators may go";
+}
+
+// Testing that instances share operators: whatever one instance built, another one gets
+//   as the very same object from the process-wide store
+TEST(FractalKernelsTest, SharedDefractalizerStoreIsProcessWide) {
+    auto& store = audio_plugin::sharedDefractalizerCache();
+    ASSERT_EQ(&store, &audio_plugin::sharedDefractalizerCache());
+
+    const int numTerms = audio_plugin::seriesTermCount(3, 0.42f, 1e-7f);
+    auto first = audio_plugin::makeDefractalizerBackend(audio_plugin::DefractalizerKind::blockLU);
+    ASSERT_TRUE(first->prepare(audio_plugin::makeDefractalizerProblem(
+        977, 3, 0.42f, numTerms, 1e-7f, audio_plugin::KernelLevel::scalar, 1)));
+    auto second = audio_plugin::makeDefractalizerBackend(audio_plugin::DefractalizerKind::blockLU);
+    ASSERT_TRUE(second->prepare(audio_plugin::makeDefractalizerProblem(
+        977, 3, 0.42f, numTerms, 1e-7f, audio_plugin::KernelLevel::scalar, 1)));
+
+    const audio_plugin::DefractalizerKey key{977, 3, 42, 1, 2};
+    const auto published = store.insert(key, std::move(first));
+    // a racing builder of the same operator must get the published one back, not its own
+    EXPECT_EQ(store.insert(key, std::move(second)), published);
+    EXPECT_EQ(store.find(key), published);
+}
+
+// Testing instances loading one session together: concurrent requests for one key build it once, the others
+//   get the plans and then the operator of that build
+TEST(FractalKernelsTest, ConcurrentAcquiresOfOneKeyBuildOnce) {
+    const int numThreads = 6;
+    const audio_plugin::DefractalizerKey key{1201, 2, 37, 1, static_cast<int>(audio_plugin::DefractalizerKind::sparseLU)};
+    ASSERT_FALSE(audio_plugin::sharedDefractalizerCache().contains(key));
+
+    std::atomic<bool> go{false};
+    std::mutex mutex;
+    std::vector<const audio_plugin::DefractalizerProblem*> problems;
+    std::vector<std::shared_ptr<const audio_plugin::DefractalizerBackend>> backends(numThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+        threads.emplace_back([&, t] {
+            while (!go.load()) {
+            }
+            backends[static_cast<size_t>(t)] = audio_plugin::acquireDefractalizerOperator(
+                key, 0.37f, audio_plugin::KernelLevel::scalar, {}, 1e-4f, -1,
+                [&](const std::shared_ptr<const audio_plugin::DefractalizerProblem>& problem) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    problems.push_back(problem.get());
+                    return true;
+                });
+        });
+    go.store(true);
+    for (auto& thread : threads)
+        thread.join();
+
+    ASSERT_NE(backends[0], nullptr);
+    for (const auto& backend : backends)
+        EXPECT_EQ(backend, backends[0]) << "Every request must get the one operator";
+    ASSERT_FALSE(problems.empty());
+    for (const auto* problem : problems)
+        EXPECT_EQ(problem, &backends[0]->problem()) << "Plans were built for a request that could have waited";
+}
+
+// Testing the operator disk cache: a populated grid loads back into operators that solve exactly like
+//   freshly prepared ones, nothing is written twice and damaged files are refused
+TEST(FractalKernelsTest, DefractalizerDiskCacheRoundTrips) {
+    const auto directory = std::filesystem::temp_directory_path() / "bifractalizer_disk_cache_test";
+    std::filesystem::remove_all(directory);
+    audio_plugin::DefractalizerDiskCache cache;
+    ASSERT_FALSE(cache.enabled());
+    cache.setDirectory(directory);
+
+    const int N = 301;
+    const int beta = 3;
+    const float alpha = 60 / 100.0f;  // what a grid alpha step stands for
+    const int autoSolver = static_cast<int>(audio_plugin::DefractalizerKind::numKinds);
+    audio_plugin::DiskCacheGrid grid;
+    grid.Ns = {N};
+    grid.betas = {beta};
+    grid.alphaSteps = {60};
+    grid.qualities = {1};
+    grid.solvers = {static_cast<int>(audio_plugin::DefractalizerKind::denseLU),
+                    static_cast<int>(audio_plugin::DefractalizerKind::sparseLU),
+                    static_cast<int>(audio_plugin::DefractalizerKind::blockLU), autoSolver};
+    const auto kernelLevel = audio_plugin::detectKernelLevel();
+    ASSERT_EQ(audio_plugin::populateDiskCache(cache, grid, kernelLevel, 1e-3f), 4);
+    ASSERT_EQ(audio_plugin::populateDiskCache(cache, grid, kernelLevel, 1e-3f), 0);
+
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<float> g(static_cast<size_t>(N)), f(g.size()), loadedG(g.size()), builtG(g.size());
+    for (auto& sample : g)
+        sample = dist(gen);
+
+    for (const int solver : grid.solvers) {
+        const audio_plugin::DefractalizerKey key{N, beta, 60, 1, solver};
+        const auto loaded = cache.load(key, kernelLevel);
+        ASSERT_TRUE(loaded) << "solver " << solver;
+        if (solver != autoSolver) {
+            ASSERT_EQ(static_cast<int>(loaded->kind()), solver);
+        }
+        const auto built = audio_plugin::buildDefractalizerOperator(key, alpha, kernelLevel, {}, 1e-3f,
+                                                                    static_cast<int>(loaded->kind()));
+        ASSERT_EQ(loaded->problem().plan.weights, built->problem().plan.weights);
+        // the factors came from the file, not from factorizing again
+        ASSERT_EQ(loaded->saveState(), built->saveState()) << "solver " << solver;
+        if (solver != autoSolver) {
+            ASSERT_FALSE(loaded->saveState().empty()) << "solver " << solver;
+        }
+
+        audio_plugin::applyGatherPlan(built->problem().plan, g.data(), f.data());
+        audio_plugin::DefractalizerWorkspace loadedWorkspace, builtWorkspace;
+        loaded->prepareWorkspace(loadedWorkspace, 1);
+        built->prepareWorkspace(builtWorkspace, 1);
+        loaded->solve(f.data(), loadedG.data(), 0, loadedWorkspace);
+        built->solve(f.data(), builtG.data(), 0, builtWorkspace);
+        for (size_t i = 0; i < g.size(); ++i) {
+            ASSERT_EQ(loadedG[i], builtG[i]) << "solver " << solver << " mismatch at " << i;
+            ASSERT_NEAR(loadedG[i], g[i], 1e-4f) << "solver " << solver << " mismatch at " << i;
+        }
+    }
+
+    // a flipped byte fails the checksum, a file under another key's name doesn't match its header
+    const audio_plugin::DefractalizerKey denseKey{N, beta, 60, 1, grid.solvers[0]};
+    const std::filesystem::path densePath = cache.pathFor(denseKey);
+    const audio_plugin::DefractalizerKey otherKey{N, beta, 61, 1, grid.solvers[0]};
+    std::filesystem::copy_file(densePath, cache.pathFor(otherKey));
+    EXPECT_TRUE(cache.contains(denseKey));
+    EXPECT_FALSE(cache.contains(otherKey));
+    EXPECT_FALSE(cache.load(otherKey, kernelLevel));
+    {
+        std::fstream file(densePath, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(std::filesystem::file_size(densePath) / 2));
+        const char byte = static_cast<char>(file.get() ^ 0x5a);
+        file.seekp(static_cast<std::streamoff>(std::filesystem::file_size(densePath) / 2));
+        file.put(byte);
+    }
+    EXPECT_FALSE(cache.load(denseKey, kernelLevel));
+    EXPECT_FALSE(cache.contains(denseKey));
+
+    // a file with a good checksum whose plans index past N (another build, say) is turned down too
+    const audio_plugin::DefractalizerKey staleKey{N, beta, 62, 1,
+                                                  static_cast<int>(audio_plugin::DefractalizerKind::closedForm)};
+    auto stale = std::make_shared<audio_plugin::DefractalizerProblem>(
+        *audio_plugin::makeDefractalizerProblem(staleKey, 0.62f, kernelLevel));
+    if (stale->plan.compactIndices)
+        stale->plan.indices16[stale->plan.nonZeros() / 2] = static_cast<uint16_t>(N);
+    else
+        stale->plan.indices32[stale->plan.nonZeros() / 2] = static_cast<uint32_t>(N);
+    auto staleBackend = audio_plugin::makeDefractalizerBackend(audio_plugin::DefractalizerKind::closedForm);
+    ASSERT_TRUE(staleBackend->prepare(stale));
+    ASSERT_TRUE(cache.save(staleKey, *staleBackend));
+    EXPECT_FALSE(cache.load(staleKey, kernelLevel));
+    std::filesystem::remove_all(directory);
+}
+
+// Testing the operator handover: the audio thread gets the newest published operator, a superseded
+//   one is freed by the publisher and retired ones only when a worker reclaims them
+TEST(FractalKernelsTest, DefractalizerHandoverPublishesNewestAndReclaimsOffThread) {
+    auto problem = audio_plugin::makeDefractalizerProblem(
+        211, 2, 0.5f, audio_plugin::seriesTermCount(2, 0.5f, 1e-7f), 1e-7f, audio_plugin::KernelLevel::scalar, 1);
+    std::shared_ptr<const audio_plugin::DefractalizerBackend> backends[3];
+    for (auto& backend : backends) {
+        auto fresh = audio_plugin::makeDefractalizerBackend(audio_plugin::DefractalizerKind::closedForm);
+        ASSERT_TRUE(fresh->prepare(problem));
+        backend = std::move(fresh);
+    }
+    auto publish = [&](audio_plugin::DefractalizerHandover& handover, int i) {
+        auto op = std::make_unique<audio_plugin::PublishedDefractalizer>();
+        op->key = {211, 2, 50, 1, i};
+        op->backend = backends[i];
+        handover.publish(std::move(op));
+    };
+
+    audio_plugin::DefractalizerHandover handover;
+    ASSERT_EQ(handover.take(), nullptr);
+    publish(handover, 0);
+    publish(handover, 1);
+    EXPECT_EQ(backends[0].use_count(), 1) << "the superseded operator must be freed by the publisher";
+    audio_plugin::PublishedDefractalizer* live = handover.take();
+    ASSERT_NE(live, nullptr);
+    EXPECT_EQ(live->key.solver, 1);
+    EXPECT_EQ(handover.take(), nullptr);
+
+    publish(handover, 2);
+    audio_plugin::PublishedDefractalizer* next = handover.take();
+    ASSERT_NE(next, nullptr);
+    handover.retire(live);
+    EXPECT_EQ(backends[1].use_count(), 2) << "retiring must not free anything";
+    handover.reclaim();
+    EXPECT_EQ(backends[1].use_count(), 1);
+
+    // concurrently: the audio side always ends up with the last operator published
+    std::atomic<bool> done{false};
+    std::thread worker([&] {
+        for (int i = 0; i < 2000; ++i) {
+            publish(handover, i % 3);
+            handover.reclaim();
+        }
+        publish(handover, 2);
+        done.store(true);
+    });
+    while (!done.load()) {
+        if (auto* fresh = handover.take()) {
+            handover.retire(next);
+            next = fresh;
+        }
+    }
+    worker.join();
+    if (auto* fresh = handover.take()) {
+        handover.retire(next);
+        next = fresh;
+    }
+    EXPECT_EQ(next->key.solver, 2);
+    handover.retire(next);
+    handover.reclaim();
+    for (const auto& backend : backends)
+        EXPECT_EQ(backend.use_count(), 1);
+}
+
+// Testing the shared worker pool: priority order, coalesced submissions, cancellation, and a parallelFor
+//   that finishes while every worker is busy
+TEST(FractalKernelsTest, WorkerPoolRunsByPriorityAndCancels) {
+    audio_plugin::WorkerPool::Options options;
+    options.numThreads = 1;
+    options.realtimeThreads = 1;
+    audio_plugin::WorkerPool pool(options);
+
+    // the only worker waits on gate, so everything below queues up behind it
+    std::atomic<bool> gate{false}, blocking{false};
+    audio_plugin::WorkerPool::Job blocker([&] {
+        blocking.store(true);
+        while (!gate.load())
+            std::this_thread::yield();
+    });
+    pool.submit(blocker, audio_plugin::WorkPriority::normal);
+    while (!blocking.load())
+        std::this_thread::yield();
+
+    // realtime work doesn't wait for it, the realtime worker takes it
+    std::atomic<bool> ranRealtime{false};
+    audio_plugin::WorkerPool::Job realtime([&] { ranRealtime.store(true); });
+    pool.submit(realtime, audio_plugin::WorkPriority::realtime);
+    while (!ranRealtime.load())
+        std::this_thread::yield();
+    pool.retract(realtime);
+
+    std::mutex orderMutex;
+    std::vector<int> order;
+    auto record = [&](int id) {
+        std::lock_guard<std::mutex> lock(orderMutex);
+        order.push_back(id);
+    };
+    audio_plugin::WorkerPool::Job background([&] { record(0); });
+    audio_plugin::WorkerPool::Job normal([&] { record(1); });
+    audio_plugin::WorkerPool::Job high([&] { record(2); });
+    audio_plugin::WorkerPool::Job cancelled([&] { record(3); });
+    pool.submit(background, audio_plugin::WorkPriority::background);
+    pool.submit(normal, audio_plugin::WorkPriority::normal);
+    for (int i = 0; i < 3; ++i)
+        pool.submit(high, audio_plugin::WorkPriority::high);  // queued once, runs once
+    pool.submit(cancelled, audio_plugin::WorkPriority::high);
+    pool.cancel(cancelled);
+
+    // the worker is busy, the caller does all the chunks itself
+    std::vector<int> chunks(16, 0);
+    pool.parallelFor(16, [&](int i) { chunks[static_cast<size_t>(i)] += 1; });
+    for (int i = 0; i < 16; ++i)
+        ASSERT_EQ(chunks[static_cast<size_t>(i)], 1) << "chunk " << i;
+
+    // queued last at the lowest priority, so it runs last
+    std::atomic<bool> drained{false};
+    audio_plugin::WorkerPool::Job last([&] { drained.store(true); });
+    pool.submit(last, audio_plugin::WorkPriority::background);
+    gate.store(true);
+    while (!drained.load())
+        std::this_thread::yield();
+    pool.retract(last);
+    {
+        std::lock_guard<std::mutex> lock(orderMutex);
+        ASSERT_EQ(order, (std::vector<int>{2, 1, 0})) << "highest priority first, the cancelled job never runs";
+    }
+
+    // a running job sees a newer submission as a cancellation, then runs again for it
+    std::atomic<int> runs{0}, gaveUp{0};
+    std::atomic<bool> started{false};
+    audio_plugin::WorkerPool::Job superseded([&] {
+        const int run = runs.fetch_add(1);
+        started.store(true);
+        if (run == 0) {
+            while (!audio_plugin::WorkerPool::cancellationRequested())
+                std::this_thread::yield();
+            gaveUp.fetch_add(1);
+        }
+    });
+    pool.submit(superseded, audio_plugin::WorkPriority::normal);
+    while (!started.load())
+        std::this_thread::yield();
+    pool.submit(superseded, audio_plugin::WorkPriority::normal);
+    while (runs.load() < 2)
+        std::this_thread::yield();
+    pool.retract(superseded);
+    ASSERT_EQ(gaveUp.load(), 1);
+    ASSERT_EQ(runs.load(), 2) << "a submission while running makes exactly one more run";
+
+    // realtimeOnly work waits for the (busy) realtime worker even though the normal one is free
+    std::atomic<bool> realtimeGate{false}, realtimeBlocking{false}, ranRealtimeOnly{false};
+    std::thread::id blockerThread, realtimeOnlyThread;
+    audio_plugin::WorkerPool::Job realtimeBlocker([&] {
+        blockerThread = std::this_thread::get_id();
+        realtimeBlocking.store(true);
+        while (!realtimeGate.load())
+            std::this_thread::yield();
+    });
+    audio_plugin::WorkerPool::Job realtimeOnly([&] {
+        realtimeOnlyThread = std::this_thread::get_id();
+        ranRealtimeOnly.store(true);
+    });
+    pool.submit(realtimeBlocker, audio_plugin::WorkPriority::realtimeOnly);
+    while (!realtimeBlocking.load())
+        std::this_thread::yield();
+    pool.submit(realtimeOnly, audio_plugin::WorkPriority::realtimeOnly);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_FALSE(ranRealtimeOnly.load()) << "a normal worker took realtimeOnly work";
+    realtimeGate.store(true);
+    while (!ranRealtimeOnly.load())
+        std::this_thread::yield();
+    pool.retract(realtimeOnly);
+    pool.retract(realtimeBlocker);
+    ASSERT_EQ(realtimeOnlyThread, blockerThread) << "not on the realtime worker";
+
+    // and with workers free, parallelFor spreads over them and still covers every index once
+    std::vector<std::atomic<int>> hits(1000);
+    pool.parallelFor(1000, [&](int i) { hits[static_cast<size_t>(i)].fetch_add(1); });
+    for (int i = 0; i < 1000; ++i)
+        ASSERT_EQ(hits[static_cast<size_t>(i)].load(), 1) << "index " << i;
+}
+
+// Testing BlockWork: every engine run in random pieces writes exactly (bit by bit) what one run writes,
+//   the infinite series with a long cycle (N prime, beta a primitive root) included
+TEST(FractalKernelsTest, BlockWorkInPiecesMatchesOneGo) {
+    using Engine = audio_plugin::BlockWork::Engine;
+    const int Ns[] =    {480, 2399, 1000};
+    const int betas[] = {  2,   2,    3};
+    const int numChannels = 3;
+    const float alpha = 0.7f;
+
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (int iter = 0; iter < 3; ++iter) {
+        const int N = Ns[iter];
+        const int numTerms = audio_plugin::seriesTermCount(betas[iter], alpha, 1e-7f);
+        const auto problem = audio_plugin::makeDefractalizerProblem(N, betas[iter], alpha, numTerms, 1e-7f,
+                                                                    audio_plugin::detectKernelLevel(), 1);
+        auto backend = audio_plugin::makeDefractalizerBackend(audio_plugin::DefractalizerKind::sparseLU);
+        ASSERT_TRUE(backend->prepare(problem));
+        audio_plugin::DefractalizerWorkspace workspace;
+        backend->prepareWorkspace(workspace, numChannels);
+
+        juce::AudioBuffer<float> in(numChannels, N), once(numChannels, N), pieces(numChannels, N);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < N; ++i)
+                in.getWritePointer(ch)[i] = dist(gen);
+        std::vector<float> scratch(3 * static_cast<size_t>(N));
+
+        const Engine engines[] = {Engine::copy, Engine::fractalizeInfinite, Engine::fractalizeDoubling,
+                                  Engine::fractalizeGather, Engine::defractalizeInfinite,
+                                  Engine::defractalizeClosedForm, Engine::defractalizeBackend};
+        for (const Engine engine : engines) {
+            audio_plugin::BlockWork::Setup setup;
+            setup.engine = engine;
+            setup.N = N;
+            setup.beta = betas[iter];
+            setup.alpha = alpha;
+            setup.numTerms = numTerms;
+            setup.closedFormSteps = problem->closedFormSteps;
+            setup.refinementSteps = 1;
+            setup.plans = problem.get();
+            setup.backend = backend.get();
+            setup.workspace = &workspace;
+            setup.kernelLevel = audio_plugin::detectKernelLevel();
+            setup.scratch = scratch.data();
+
+            audio_plugin::BlockWork work;
+            work.start(setup, in.getArrayOfReadPointers(), once.getArrayOfWritePointers(), numChannels);
+            ASSERT_EQ(work.runUntil(work.units()), work.units());
+            ASSERT_TRUE(work.finished());
+
+            work.start(setup, in.getArrayOfReadPointers(), pieces.getArrayOfWritePointers(), numChannels);
+            std::uniform_int_distribution<int> step(0, std::max(1, work.units() / 50));
+            int pieceCount = 0;
+            while (!work.finished()) {
+                const int target = work.unitsDone() + step(gen);
+                const int ran = work.runUntil(target);
+                ASSERT_GE(work.unitsDone(), std::min(target, work.units()));
+                ASSERT_LE(ran, target - (work.unitsDone() - ran) + audio_plugin::SlicedGatherPlan::sliceWidth);
+                ++pieceCount;
+            }
+            ASSERT_GT(pieceCount, 1);
+            for (int ch = 0; ch < numChannels; ++ch) {
+                ASSERT_EQ(std::memcmp(once.getReadPointer(ch), pieces.getReadPointer(ch), sizeof(float) * N), 0)
+                    << "engine " << static_cast<int>(engine) << ", N " << N << ", channel " << ch;
+            }
+        }
+    }
+}
+
+// Testing that processBlock never touches the heap on the audio thread: every mode, series and solver,
+//   knob moves (operators rebuilt in the background), block size changes and both kinds of spreading included
+TEST_F(AudioProcessorTest, ProcessBlockNeverAllocates) {
+    const int numChannels = 2;
+    const double sampleRate = 48000;
+    const int hostBlockSize = 512;  // two whole blocks at 350 Hz: a batch
+    processor->setPlayConfigDetails(numChannels, numChannels, sampleRate, hostBlockSize);
+    processor->setBypassed(false);
+    auto& params = processor->getAPVTS();
+    *params.getRawParameterValue("frequency") = 93.8f;
+    processor->prepareToPlay(sampleRate, hostBlockSize);
+    forbiddenHeapCalls.store(0);  // checked from the very first callback on
+
+    juce::AudioBuffer<float> buffer(numChannels, hostBlockSize);
+    juce::MidiBuffer midiBuffer;
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    auto processBlocks = [&](int count) {
+        for (int b = 0; b < count; ++b) {
+            for (int ch = 0; ch < numChannels; ++ch)
+                for (int i = 0; i < hostBlockSize; ++i)
+                    buffer.getWritePointer(ch)[i] = dist(gen);
+            heapForbidden = true;
+            processor->processBlock(buffer, midiBuffer);
+            heapForbidden = false;
+            // on a worker: the blocks come back between the callbacks, as they would in real time
+            if (static_cast<int>(params.getRawParameterValue("spread")->load()) == 2)
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    };
+
+    const float frequencies[] = {93.8f, 20.0f, 350.0f};
+    const float alphas[] = {0.5f, 0.9f};
+    for (int spread = 0; spread <= 2; ++spread) {
+        *params.getRawParameterValue("spread") = static_cast<float>(spread);
+        for (const float frequency : frequencies) {
+            *params.getRawParameterValue("frequency") = frequency;
+            for (int solver = 0; solver <= static_cast<int>(audio_plugin::DefractalizerKind::numKinds); ++solver) {
+                *params.getRawParameterValue("solver") = static_cast<float>(solver);
+                for (const float alpha : alphas) {
+                    *params.getRawParameterValue("alpha") = alpha;
+                    for (int mode = 0; mode < 2; ++mode) {
+                        *params.getRawParameterValue("mode") = static_cast<float>(mode);
+                        for (int series = 0; series < 2; ++series) {
+                            *params.getRawParameterValue("series") = static_cast<float>(series);
+                            processBlocks(4);
+                        }
+                    }
+                    // let the background build land, so the published operators run too
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                    processBlocks(12);
+                }
+            }
+            ASSERT_EQ(forbiddenHeapCalls.load(), 0) << "heap used on the audio thread, frequency " << frequency
+                                                    << ", spread " << spread;
+        }
+    }
+}
+
 }  // namespace audio_plugin_test
\ No newline at end of file